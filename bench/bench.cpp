@@ -0,0 +1,107 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+
+using namespace std;
+
+
+/**
+ * @brief Opens a socket connected to the server.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param type SOCK_DGRAM for udp or SOCK_STREAM for tcp
+ *
+ * @return socket's descriptor
+ */
+int open_socket(const string& host, const string& port, int type) {
+
+    struct addrinfo hints{}, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = type;
+    assert_(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0, "Failed getaddrinfo call\n")
+
+    int fd = socket(AF_INET, type, 0);
+    assert_(fd != -1, "Could not create socket\n")
+    assert_(connect(fd, res->ai_addr, res->ai_addrlen) == 0, "Could not connect to the server\n")
+    freeaddrinfo(res);
+    return fd;
+
+}
+
+
+/**
+ * @brief Sends a request over udp and waits for its response.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param request request, ended by \n
+ *
+ * @return server's response
+ */
+string request_udp(const string& host, const string& port, const string& request) {
+
+    int fd = open_socket(host, port, SOCK_DGRAM);
+    struct timeval timeout{BENCH_UDP_TIMEOUT, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    assert_(send(fd, request.data(), request.size(), 0) == (ssize_t) request.size(), "Could not send request\n")
+
+    char buffer[BENCH_UDP_SIZE];
+    ssize_t n = recv(fd, buffer, sizeof buffer, 0);
+    assert_(n > 0, "Could not receive response\n")
+    close(fd);
+    return string(buffer, n);
+
+}
+
+
+/**
+ * @brief Sends a request over a new tcp connection, followed by the bytes of a file if it has one, and reads the
+ * response until the server closes the connection.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param request request, ended by \n
+ * @param data file's bytes, empty if there is no file
+ *
+ * @return server's response
+ */
+string request_tcp(const string& host, const string& port, const string& request, const string& data) {
+
+    int fd = open_socket(host, port, SOCK_STREAM);
+    for (const string* part: {&request, &data}) {
+        for (size_t sent = 0; sent < part->size();) {
+            ssize_t n = send(fd, part->data() + sent, part->size() - sent, MSG_NOSIGNAL);
+            assert_(n > 0, "Could not send request\n")
+            sent += n;
+        }
+    }
+
+    string response;
+    char buffer[BENCH_TCP_SIZE];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof buffer, 0)) > 0) response.append(buffer, n);
+    close(fd);
+    return response;
+
+}
+
+
+/**
+ * @brief Gets the number of seconds that went by since a point in time.
+ *
+ * @param start point in time
+ *
+ * @return seconds since start
+ */
+double elapsed(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,64 @@
+#ifndef PROJETO_RC_39_V2_BENCH_H
+#define PROJETO_RC_39_V2_BENCH_H
+
+#include "../server/src/misc/helpers.h"
+
+#include <string>
+#include <chrono>
+
+#define BENCH_HOST "localhost"
+#define BENCH_PORT "58039"
+#define BENCH_UDP_SIZE (1 << 16)
+#define BENCH_UDP_TIMEOUT 2
+#define BENCH_TCP_SIZE (1 << 16)
+
+
+using namespace std;
+
+
+/**
+ * @brief Opens a socket connected to the server.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param type SOCK_DGRAM for udp or SOCK_STREAM for tcp
+ *
+ * @return socket's descriptor
+ */
+int open_socket(const string& host, const string& port, int type);
+
+/**
+ * @brief Sends a request over udp and waits for its response.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param request request, ended by \n
+ *
+ * @return server's response
+ */
+string request_udp(const string& host, const string& port, const string& request);
+
+/**
+ * @brief Sends a request over a new tcp connection, followed by the bytes of a file if it has one, and reads the
+ * response until the server closes the connection.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param request request, ended by \n
+ * @param data file's bytes, empty if there is no file
+ *
+ * @return server's response
+ */
+string request_tcp(const string& host, const string& port, const string& request, const string& data = "");
+
+/**
+ * @brief Gets the number of seconds that went by since a point in time.
+ *
+ * @param start point in time
+ *
+ * @return seconds since start
+ */
+double elapsed(chrono::steady_clock::time_point start);
+
+
+#endif //PROJETO_RC_39_V2_BENCH_H
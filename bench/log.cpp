@@ -0,0 +1,205 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "bench.h"
+#include "../server/src/models/group.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define SCRIPTS_DIRECTORY "test/in"
+#define PAGES 2000
+#define COLD_PAGES 200
+#define POSTERS 200
+#define FILE_EVERY 4
+#define SETTLE_INTERVAL_MS 100
+#define SETTLE_TRIES 50
+
+
+/*-------------------------------------- Benchmark global vars -----------------------------------*/
+
+
+uint64_t disk_bytes = 0;  /* Holds bytes taken by the files that were walked */
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/**
+ * @brief Reads the texts posted by the client scripts, which are the lines like post "text" [file].
+ *
+ * @param directory directory with the scripts
+ *
+ * @return texts
+ */
+vector<string> load_texts(const string& directory) {
+
+    DIR* dp = opendir(directory.c_str());
+    assert_(dp, "Could not open the scripts directory\n")
+
+    vector<string> texts;
+    struct dirent* entry;
+    while ((entry = readdir(dp))) {
+        if (entry->d_name[0] == '.') continue;
+        ifstream script(directory + "/" + entry->d_name);
+        string line;
+        while (getline(script, line)) {
+            if (line.compare(0, 6, "post \"") != 0) continue;
+            size_t end = line.find('"', 6);
+            if (end != string::npos) texts.push_back(line.substr(6, end - 6));
+        }
+    }
+
+    closedir(dp);
+    assert_(!texts.empty(), "Scripts have no posts\n")
+    return texts;
+
+}
+
+
+/**
+ * @brief Gets how many bytes the files of a directory take, once segments that are being sealed are done.
+ *
+ * @param directory directory that is walked
+ *
+ * @return bytes taken by its files
+ */
+uint64_t settled_size(const string& directory) {
+
+    auto add_file = [](const char*, const struct stat* st, int type, struct FTW*) -> int {
+        if (type == FTW_F) disk_bytes += st->st_size;
+        return 0;
+    };
+
+    /* Segments are compressed in the background, so the size is taken once it stops changing */
+    uint64_t last = UINT64_MAX;
+    for (int i = 0; i < SETTLE_TRIES; i++) {
+        disk_bytes = 0;
+        nftw(directory.c_str(), add_file, 16, FTW_PHYS);
+        if (disk_bytes == last) break;
+        last = disk_bytes;
+        this_thread::sleep_for(chrono::milliseconds(SETTLE_INTERVAL_MS));
+    }
+    return disk_bytes;
+
+}
+
+
+/**
+ * @brief Drops the page cache, which can only be done by root.
+ *
+ * @return true if it was dropped
+ */
+bool drop_caches() {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd == -1) return false;
+    bool dropped = write(fd, "3", 1) == 1;
+    close(fd);
+    return dropped;
+}
+
+
+/**
+ * @brief Reads pages of a group starting at random messages.
+ *
+ * @param group group that is read
+ * @param rng generator of the messages where pages start
+ * @param count number of pages
+ * @param last id of the last message where a page may start
+ *
+ * @return microseconds per page
+ */
+double read_pages(Group* group, mt19937& rng, int count, uint32_t last) {
+
+    size_t bytes = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        MessageRange range;
+        assert_(group->retrieveMessages(rng() % last + 1, range), "Could not read the log\n")
+        for (const Message& message: range) bytes += message.getMessageText().size();
+    }
+    double seconds = elapsed(start);
+
+    assert_(bytes > 0, "Pages were empty\n")
+    return seconds * 1e6 / count;
+
+}
+
+
+/**
+ * Measures a group's log in a data directory: how long posts take, how much disk it takes and how long pages take
+ * to read, with the page cache dropped if possible and then warm. Texts are the ones posted by the client scripts,
+ * and one in FILE_EVERY messages has a file.
+ *
+ * Usage: BenchLog -d directory [-c posts] [-z] [-i scripts]
+ *
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ * @return 0 if success and 1 if error
+ */
+int main(int argc, char const *argv[]) {
+
+    string directory;  /* Holds where the group's log is kept, which has to be new */
+    string scripts{SCRIPTS_DIRECTORY};  /* Holds where the client scripts are */
+    int posts = 1000000;  /* Holds number of messages posted */
+    bool compress = false;  /* Is true if sealed segments are compressed */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) { directory = argv[++i]; }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) { scripts = argv[++i]; }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) { posts = max(PAGE_SIZE + 1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-z") == 0) { compress = true; }
+    }
+    assert_(!directory.empty(), "Usage: BenchLog -d directory [-c posts] [-z] [-i scripts]\n")
+
+    vector<string> texts = load_texts(scripts);
+    GroupTable groups;
+    groups.setDirectory(directory, compress);
+    Group* group = groups.add("Alpha");
+    mt19937 rng(1);
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < posts; i++) {
+        const string& text = texts[rng() % texts.size()];
+        bool file = rng() % FILE_EVERY == 0;
+        group->postMessage(10000 + rng() % POSTERS, string_view(text).substr(0, TEXT_MAX_SIZE),
+                           file ? "Battle_of_Waterloo.PNG" : "", file ? 100000 + rng() % 900000 : 0);
+    }
+    double post_us = elapsed(start) * 1e6 / posts;
+
+    uint64_t size = settled_size(directory);
+    printf("%d posts%s: %.2f us/post, %.1f MiB on disk\n", posts, compress ? " (-z)" : "", post_us,
+           (double) size / (1 << 20));
+
+    /* Pages never start in the last one, which is still being written */
+    auto last = (uint32_t) (posts - PAGE_SIZE);
+    bool cold = drop_caches();
+    double first_us = read_pages(group, rng, COLD_PAGES, last);
+
+    /* Same pages are read twice, so the second time they are in the page cache */
+    mt19937 warm_rng(7);
+    read_pages(group, warm_rng, PAGES, last);
+    warm_rng.seed(7);
+    double warm_us = read_pages(group, warm_rng, PAGES, last);
+
+    printf("first %d pages %.1f us/page (%s cache), warm %.1f us/page\n", COLD_PAGES, first_us,
+           cold ? "cold" : "warm", warm_us);
+
+    return EXIT_SUCCESS;
+
+}
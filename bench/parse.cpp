@@ -0,0 +1,141 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "../server/src/misc/tokenizer.h"
+#include "../server/src/misc/helpers.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define ITERATIONS 500000
+#define WARMUP_ITERATIONS 1000
+
+
+/*-------------------------------------- Benchmark global vars -----------------------------------*/
+
+
+long allocations = 0;  /* Holds number of allocations made so far */
+volatile size_t sink;  /* Keeps the compiler from dropping what was parsed */
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/* Every allocation is counted */
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size);
+    if (p == nullptr) throw bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+/**
+ * @brief Splits a request the way requests were split before the tokenizer, which validated fields afterwards.
+ *
+ * @param request client's request
+ */
+void parse_split(const string& request) {
+    string command = get_command(request);
+    vector<string> fields;
+    split(request, fields);
+    sink += command.size() + fields.size();
+}
+
+
+/**
+ * @brief Splits and validates a request the way the server does, with the classic field widths.
+ *
+ * @param request client's request
+ */
+void parse_tokenizer(string_view request) {
+
+    Tokenizer tokens(request);
+    string_view command = tokens.next();
+    size_t size = 0;
+
+    if (command == "REG" || command == "LOG") {
+        size += tokens.digits(5, 5).size() + tokens.alphanumeric(8, 8).size();
+    } else if (command == "GSR") {
+        size += tokens.digits(5, 5).size() + tokens.digits(1, 2).size() + tokens.alphanumeric(1, 24, "-_").size();
+    } else if (command == "ULS") {
+        size += tokens.digits(1, 2).size();
+    } else if (command == "PST") {
+        size += tokens.digits(5, 5).size() + tokens.digits(1, 2).size();
+        string_view text_size = tokens.digits(1, 3);
+        size += Tokenizer::toNumber(text_size) == (long) tokens.text(240).size();
+        if (tokens.hasNext()) size += tokens.alphanumeric(1, 24, "-_.").size() + tokens.digits(1, 10).size();
+    } else if (command == "RTV") {
+        size += tokens.digits(5, 5).size() + tokens.digits(1, 2).size() + tokens.digits(1, 4).size();
+    }
+
+    sink += size + tokens.done();
+
+}
+
+
+/**
+ * @brief Times a parser over a request.
+ *
+ * @param parse parser
+ * @param request client's request
+ * @param allocs where the number of allocations per request is written
+ *
+ * @return nanoseconds per request
+ */
+template <typename Parser>
+double measure(Parser parse, const string& request, double* allocs) {
+
+    for (int i = 0; i < WARMUP_ITERATIONS; i++) parse(request);
+
+    long before = allocations;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) parse(request);
+    double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    *allocs = (double) (allocations - before) / ITERATIONS;
+    return nanoseconds / ITERATIONS;
+
+}
+
+
+/**
+ * Measures how long it takes to parse each kind of request, and how many allocations it makes, when it is split
+ * by spaces and when it goes through the tokenizer.
+ *
+ * Usage: BenchParse
+ *
+ * @return 0 if success
+ */
+int main() {
+
+    const char* requests[] = {
+        "REG 12345 pword001",
+        "LOG 12345 pword001",
+        "GLS",
+        "GSR 12345 00 Alpha-group",
+        "ULS 01",
+        "PST 12345 01 44 \"the quick brown fox jumps over the lazy dogs\" Tuga.txt 1234",
+        "RTV 12345 01 0001"
+    };
+
+    for (const char* request: requests) {
+        double split_allocs, tokenizer_allocs;
+        double split_ns = measure(parse_split, request, &split_allocs);
+        double tokenizer_ns = measure(parse_tokenizer, request, &tokenizer_allocs);
+        printf("%.3s  split %7.1f ns %4.1f allocs | tokenizer %6.1f ns %4.1f allocs\n", request, split_ns,
+               split_allocs, tokenizer_ns, tokenizer_allocs);
+    }
+
+    return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,118 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "bench.h"
+#include "../server/src/api.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define UID 12345
+#define TEXT_SIZE 100
+#define FILE_EVERY 10
+#define FILE_SIZE 123456
+#define FILES_DIRECTORY "server/files/messages/"
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/**
+ * @brief Puts together a page the way the server does for RTV, with the records gathered in segments that end
+ * where a file has to be sent.
+ *
+ * @param status status of the retrieval
+ * @param gid group's id
+ * @param result messages of the page
+ * @param segments where the segments of the page are put
+ *
+ * @return number of bytes the page has, files included
+ */
+size_t serialize_page(const string& status, uint32_t gid, const MessageRange& result, vector<string>& segments) {
+
+    size_t count = 0, size = 0;
+    for (const Message& itr: result) {
+        size_t header = itr.getMessageHeader(true).size();
+        if (header == 0) continue;
+        count++;
+        size += header + itr.getMessageBody().size();
+    }
+
+    string res = "RRT " + status + " " + to_string(count) + "\n";
+    res.reserve(res.size() + size);
+
+    /* Every file is sent from its own path, right after its record */
+    size_t bytes = 0;
+    for (const Message& itr: result) {
+        string_view header = itr.getMessageHeader(true);
+        if (header.empty()) continue;
+        res.append(header).append(itr.getMessageBody());
+        if (!itr.hasFile()) continue;
+        string path = FILES_DIRECTORY + to_string(gid) + "-" + to_string(itr.getMessageId());
+        bytes += res.size() + path.size() + itr.getMessageFileSize();
+        segments.push_back(move(res));
+        res.clear();
+    }
+
+    bytes += res.size();
+    segments.push_back(move(res));
+    return bytes;
+
+}
+
+
+/**
+ * Measures how many RTV pages per second are put together from a full group, starting at random messages.
+ * Every TEXT_SIZE character message has a file once every FILE_EVERY messages.
+ *
+ * Usage: BenchRetrieve [-c pages]
+ *
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ * @return 0 if success and 1 if error
+ */
+int main(int argc, char const *argv[]) {
+
+    int pages = 200000;  /* Holds number of pages put together */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) { pages = max(1, atoi(argv[++i])); }
+    }
+
+    Format format = {DIALECT_CLASSIC, "", 5, 5, 2, 4, 3, USER_LIMIT, GROUP_LIMIT, MID_LIMIT, TEXT_MAX_SIZE};
+    UserTable users;
+    GroupTable groups;
+    string pass = "pword001", name = "Alpha", text(TEXT_SIZE, 'x');
+
+    assert_(register_user(&users, UID, pass, format) == "OK" && login_user(&users, UID, pass) == "OK" &&
+            subscribe(&groups, &users, UID, 0, name, format) == "NEW", "Could not create the group\n")
+    for (int i = 0; i < MID_LIMIT; i++) {
+        bool file = i % FILE_EVERY == 0;
+        post_message(&groups, &users, UID, 1, text, format, file ? "report.txt" : "", file ? FILE_SIZE : 0);
+    }
+
+    mt19937 rng(1);
+    vector<string> segments;
+    size_t bytes = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < pages; i++) {
+        MessageRange result;
+        string status = retrieve_message(&groups, 1, rng() % MID_LIMIT + 1, result);
+        bytes += serialize_page(status, 1, result, segments);
+        segments.clear();
+    }
+    double seconds = elapsed(start);
+
+    printf("%d pages of %zu bytes: %.0f pages/s (%.2f us/page)\n", pages, bytes / pages, pages / seconds,
+           seconds * 1e6 / pages);
+    return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,145 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "bench.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define BATCH_SIZE 64
+#define RESPONSE_SIZE 512
+#define REQUEST_SIZE 64
+#define RESEND_TIMEOUT_US 200000
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/**
+ * @brief Writes the next request a client sends.
+ *
+ * @param out where the request is written, REQUEST_SIZE bytes long
+ * @param next_uid next user id to be registered, nullptr if groups are listed instead
+ *
+ * @return size of the request
+ */
+size_t make_request(char* out, atomic<uint32_t>* next_uid) {
+    if (next_uid == nullptr) return snprintf(out, REQUEST_SIZE, "GLS\n");
+    return snprintf(out, REQUEST_SIZE, "XREG %u pword001\n", next_uid->fetch_add(1));
+}
+
+
+/**
+ * @brief Keeps a number of requests in flight over udp, sending a new one for every response, until time runs
+ * out. Requests lost on the way are replaced after a while without responses.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param window number of requests in flight
+ * @param seconds how long requests are sent for
+ * @param next_uid next user id to be registered, shared by every client, nullptr if groups are listed instead
+ * @param responses where the number of responses received is written
+ */
+void run_client(const string& host, const string& port, int window, double seconds, atomic<uint32_t>* next_uid,
+                long* responses) {
+
+    int fd = open_socket(host, port, SOCK_DGRAM);
+    struct timeval timeout{0, RESEND_TIMEOUT_US};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    struct mmsghdr msgs[BATCH_SIZE];
+    struct iovec iovs[BATCH_SIZE];
+    static thread_local char buffers[BATCH_SIZE][RESPONSE_SIZE];
+    static thread_local char requests[BATCH_SIZE][REQUEST_SIZE];
+    long received = 0;
+
+    auto fill_window = [&]() {
+        for (int i = 0; i < window; i++) send(fd, requests[0], make_request(requests[0], next_uid), 0);
+    };
+    fill_window();
+
+    /* Every batch of responses is answered with as many requests, so the window stays full */
+    auto start = chrono::steady_clock::now();
+    while (elapsed(start) < seconds) {
+
+        memset(msgs, 0, sizeof msgs);
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            iovs[i] = {buffers[i], RESPONSE_SIZE};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n = recvmmsg(fd, msgs, BATCH_SIZE, MSG_WAITFORONE, nullptr);
+        if (n <= 0) {
+            fill_window();
+            continue;
+        }
+
+        received += n;
+        for (int i = 0; i < n; i++) iovs[i] = {requests[i], make_request(requests[i], next_uid)};
+        sendmmsg(fd, msgs, n, 0);
+
+    }
+
+    close(fd);
+    *responses = received;
+
+}
+
+
+/**
+ * Measures how many udp requests per second the server answers. Requests list the groups, or register users that
+ * do not exist yet, starting at a user id, with -x.
+ *
+ * Usage: BenchUdpLoad [-n host] [-p port] [-c clients] [-w window] [-s seconds] [-x first_uid]
+ *
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ * @return 0 if success and 1 if error
+ */
+int main(int argc, char const *argv[]) {
+
+    string host{BENCH_HOST}, port{BENCH_PORT};
+    int clients = 8;  /* Holds number of clients, each one with its own socket and thread */
+    int window = 4;  /* Holds number of requests each client keeps in flight */
+    double seconds = 3;  /* Holds how long the load lasts */
+    bool register_users = false;  /* Is true if requests register users instead of listing groups */
+    atomic<uint32_t> next_uid{1};  /* Holds next user id to be registered */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) { host = argv[++i]; }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) { port = argv[++i]; }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) { clients = max(1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) { window = max(1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) { seconds = atof(argv[++i]); }
+        else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) { register_users = true; next_uid = atol(argv[++i]); }
+    }
+
+    vector<long> responses(clients, 0);
+    vector<thread> threads;
+    for (int i = 0; i < clients; i++) {
+        threads.emplace_back(run_client, host, port, window, seconds, register_users ? &next_uid : nullptr,
+                             &responses[i]);
+    }
+
+    long total = 0;
+    for (int i = 0; i < clients; i++) {
+        threads[i].join();
+        total += responses[i];
+    }
+
+    printf("%d clients x %d in flight: %.0f req/s\n", clients, window, (double) total / seconds);
+    return EXIT_SUCCESS;
+
+}
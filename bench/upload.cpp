@@ -0,0 +1,157 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <random>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define PASSWORD "pword001"
+#define FILE_NAME "bench.bin"
+#define FRAME_SIZE 300
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/**
+ * @brief Registers and logs in a user and subscribes it to a new group.
+ *
+ * @param host server's host
+ * @param port server's port
+ * @param uid user's id
+ *
+ * @return id of the new group
+ */
+string setup_group(const string& host, const string& port, const string& uid) {
+
+    /* User may be left logged in by an earlier run */
+    request_udp(host, port, "REG " + uid + " " PASSWORD "\n");
+    request_udp(host, port, "OUT " + uid + " " PASSWORD "\n");
+    string response = request_udp(host, port, "LOG " + uid + " " PASSWORD "\n");
+    assert_(response == "RLO OK\n", "Could not log in\n")
+
+    response = request_udp(host, port, "GSR " + uid + " 00 Bench\n");
+    assert_(response == "RGS NEW\n", "Could not create a group\n")
+
+    /* Groups are numbered as they are created, so the new one is the last one. Response is RGL <count> ... */
+    response = request_udp(host, port, "GLS\n");
+    int count = atoi(response.c_str() + 4);
+    assert_(response.compare(0, 4, "RGL ") == 0 && count > 0, "Could not list groups\n")
+    return (count < 10 ? "0" : "") + to_string(count);
+
+}
+
+
+/**
+ * @brief Gets the bytes that are uploaded, either from a file or made up.
+ *
+ * @param path file's path, empty if the bytes are made up
+ * @param size number of bytes made up
+ *
+ * @return file's bytes
+ */
+string load_data(const string& path, long size) {
+
+    if (!path.empty()) {
+        ifstream file(path, ifstream::binary);
+        assert_(file, "Could not open file\n")
+        stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    /* Random bytes do not compress, so no server shrinks them */
+    string data(size, '\0');
+    mt19937_64 rng(1);
+    for (auto& byte: data) byte = (char) rng();
+    return data;
+
+}
+
+
+/**
+ * Measures how long PST uploads take and checks that the last one is retrieved byte for byte, then how fast it is
+ * retrieved if -r asks for it. Every upload goes through its own connection, and its first bytes are its number, so
+ * no two uploads have the same contents.
+ *
+ * Older servers expect the request line padded with zeros to FRAME_SIZE, which -a does. Servers from before PST
+ * uploads were taken as exactly the number of bytes declared expect the file padded to a multiple of it as well,
+ * which -A does.
+ *
+ * Usage: BenchUpload [-n host] [-p port] [-i uid] [-b bytes | -f file] [-c count] [-r count] [-a | -A]
+ *
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ * @return 0 if success and 1 if error
+ */
+int main(int argc, char const *argv[]) {
+
+    string host{BENCH_HOST}, port{BENCH_PORT};
+    string uid = "10001";  /* Holds user that posts the messages */
+    string path;  /* Holds file that is uploaded, empty if its bytes are made up */
+    long size = 1 << 20;  /* Holds number of bytes made up */
+    int count = 50;  /* Holds number of uploads */
+    int retrievals = 0;  /* Holds number of times the last upload is retrieved */
+    bool frame = false;  /* Is true if the request line is padded to FRAME_SIZE */
+    bool pad = false;  /* Is true if the file is padded to a multiple of FRAME_SIZE */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) { host = argv[++i]; }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) { port = argv[++i]; }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) { uid = argv[++i]; }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) { size = max(1L, atol(argv[++i])); }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) { path = argv[++i]; }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) { count = max(1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) { retrievals = max(0, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-a") == 0) { frame = true; }
+        else if (strcmp(argv[i], "-A") == 0) { frame = pad = true; }
+    }
+
+    string gid = setup_group(host, port, uid);
+    string data = load_data(path, size);
+    size_t length = data.size();
+    if (pad) data.append((FRAME_SIZE - length % FRAME_SIZE) % FRAME_SIZE, '\0');
+    string request = "PST " + uid + " " + gid + " 1 \"x\" " FILE_NAME " " + to_string(length) + "\n";
+    if (frame) request.append((FRAME_SIZE - request.size() % FRAME_SIZE) % FRAME_SIZE, '\0');
+
+    /* Response is RPT <mid> */
+    string response;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        string number = to_string(i);
+        number.copy(&data[0], min(number.size(), length));
+        response = request_tcp(host, port, request, data);
+        assert_(response.compare(0, 4, "RPT ") == 0 && response != "RPT NOK\n", "Could not post message\n")
+    }
+    double seconds = elapsed(start);
+
+    /* Retrieved message is followed by its file, which ends the response */
+    string mid = response.substr(4, 4);
+    string retrieve = "RTV " + uid + " " + gid + " " + mid + "\n";
+    string retrieved = request_tcp(host, port, retrieve);
+    bool exact = retrieved.size() > length &&
+                 retrieved.compare(retrieved.size() - length, length, data, 0, length) == 0;
+
+    printf("%zu bytes x %d: %.2f ms/upload, %.1f MiB/s, retrieved %s\n", length, count, seconds * 1e3 / count,
+           (double) length * count / seconds / (1 << 20), exact ? "exact" : "DIFFERENT");
+
+    /* Message is the last one of the group, so each page holds it alone */
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < retrievals; i++) request_tcp(host, port, retrieve);
+    seconds = elapsed(start);
+    if (retrievals > 0) {
+        printf("retrieved x %d: %.2f ms/retrieval, %.1f MiB/s\n", retrievals, seconds * 1e3 / retrievals,
+               (double) retrieved.size() * retrievals / seconds / (1 << 20));
+    }
+    return exact ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
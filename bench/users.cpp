@@ -0,0 +1,197 @@
+/*------------------------------------- Standard definitions -------------------------------------*/
+
+#include "bench.h"
+#include "../server/src/models/user.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <malloc.h>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+
+using namespace std;
+
+
+/* Const definitions */
+#define CHECKS 1000000
+#define PASSWORD "pword001"
+#define TYPED_UID_SIZE 5
+#define CLASSIC_GROUPS 99
+
+
+/*-------------------------------------- Benchmark global vars -----------------------------------*/
+
+
+volatile size_t sink;  /* Keeps the compiler from dropping the checks */
+
+
+/*----------------------------------------- Functions --------------------------------------------*/
+
+
+/**
+ * @brief User as it was kept before the table of users, in a map by its id as typed. Getters return copies, as
+ * they did back then.
+ */
+class MapUser {
+
+    private:
+
+        string _id;
+        string _password;
+        list<string> _group_ids;
+        bool _status;
+
+    public:
+
+        MapUser(string& id, string& password) : _id(id), _password(password), _status(false) {}
+        string getUserPassword() { return _password; }
+        list<string> getUserGroups() { return _group_ids; }
+        bool getUserStatus() { return _status; }
+        void addGroup(string gid) { _group_ids.push_back(gid); }
+
+};
+
+
+/**
+ * @brief Gets how many bytes are allocated on the heap.
+ *
+ * @return bytes in use
+ */
+size_t heap_in_use() {
+    return mallinfo2().uordblks;
+}
+
+
+/**
+ * @brief Gets the id of a user as it is typed, with 5 digits.
+ *
+ * @param uid user's id
+ *
+ * @return id as typed
+ */
+string typed_id(uint32_t uid) {
+    char id[TYPED_UID_SIZE + 1];
+    snprintf(id, sizeof id, "%05u", uid);
+    return id;
+}
+
+
+/**
+ * @brief Gets the id of a group as it is typed, with 2 digits.
+ *
+ * @param gid group's id
+ *
+ * @return id as typed
+ */
+string typed_gid(uint32_t gid) {
+    char id[3];
+    snprintf(id, sizeof id, "%02u", gid);
+    return id;
+}
+
+
+/**
+ * Measures how much memory every user takes and how long the checks made by each request take, with users kept in a
+ * map by their id as typed, as they were before the table of users, and in the table. Every possible user is
+ * registered and subscribed to a few random groups.
+ *
+ * Usage: BenchUsers [-c checks] [-g groups]
+ *
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ * @return 0 if success and 1 if error
+ */
+int main(int argc, char const *argv[]) {
+
+    int checks = CHECKS;  /* Holds number of random checks of each kind */
+    int subscriptions = 3;  /* Holds number of groups each user is subscribed to */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) { checks = max(1, atoi(argv[++i])); }
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            subscriptions = max(0, min(CLASSIC_GROUPS, atoi(argv[++i])));
+        }
+    }
+
+    /* Both sets of users are filled the same way */
+    mt19937 rng(1);
+    vector<vector<uint32_t>> groups(USER_LIMIT + 1);
+    for (auto& user_groups: groups) {
+        for (int i = 0; i < subscriptions; i++) user_groups.push_back(rng() % CLASSIC_GROUPS + 1);
+    }
+    vector<uint32_t> uids(checks), gids(checks);
+    for (int i = 0; i < checks; i++) {
+        uids[i] = rng() % USER_LIMIT + 1;
+        gids[i] = rng() % CLASSIC_GROUPS + 1;
+    }
+    string password = PASSWORD;
+
+    /* Map by id as typed */
+    size_t before = heap_in_use();
+    auto* map_users = new unordered_map<string, MapUser>();
+    for (uint32_t uid = 1; uid <= USER_LIMIT; uid++) {
+        string id = typed_id(uid);
+        MapUser& user = map_users->emplace(id, MapUser(id, password)).first->second;
+        for (uint32_t gid: groups[uid]) user.addGroup(typed_gid(gid));
+    }
+    size_t map_bytes = heap_in_use() - before;
+
+    /* Table by id */
+    before = heap_in_use();
+    auto* table = new UserTable();
+    for (uint32_t uid = 1; uid <= USER_LIMIT; uid++) {
+        User* user = table->add(uid, password);
+        for (uint32_t gid: groups[uid]) user->addGroup(gid);
+    }
+    size_t table_bytes = heap_in_use() - before;
+
+    /* Checks made by a login: user exists, is not logged in and has the password. Requests come with the id as
+     * typed, which the map takes as it is */
+    vector<string> typed(checks);
+    for (int i = 0; i < checks; i++) typed[i] = typed_id(uids[i]);
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < checks; i++) {
+        sink += map_users->count(typed[i]) != 0 && !map_users->at(typed[i]).getUserStatus() &&
+                map_users->at(typed[i]).getUserPassword() == password;
+    }
+    double map_login_ns = elapsed(start) * 1e9 / checks;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < checks; i++) {
+        User* user = table->find(uids[i]);
+        sink += user != nullptr && !user->getUserStatus() && user->checkPassword(password);
+    }
+    double table_login_ns = elapsed(start) * 1e9 / checks;
+
+    /* Checks if a user is subscribed to a group, as subscribing and unsubscribing do */
+    vector<string> typed_gids(checks);
+    for (int i = 0; i < checks; i++) typed_gids[i] = typed_gid(gids[i]);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < checks; i++) {
+        list<string> user_groups = map_users->at(typed[i]).getUserGroups();
+        sink += find(user_groups.begin(), user_groups.end(), typed_gids[i]) != user_groups.end();
+    }
+    double map_member_ns = elapsed(start) * 1e9 / checks;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < checks; i++) sink += table->find(uids[i])->isSubscribed(gids[i]);
+    double table_member_ns = elapsed(start) * 1e9 / checks;
+
+    printf("%d users, %d groups each\n", USER_LIMIT, subscriptions);
+    printf("map   %6.1f MiB  login %6.1f ns  subscribed %6.1f ns\n", (double) map_bytes / (1 << 20),
+           map_login_ns, map_member_ns);
+    printf("table %6.1f MiB  login %6.1f ns  subscribed %6.1f ns\n", (double) table_bytes / (1 << 20),
+           table_login_ns, table_member_ns);
+
+    delete map_users;
+    delete table;
+    return EXIT_SUCCESS;
+
+}
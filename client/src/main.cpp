@@ -74,15 +74,17 @@ int main(int argc, char const *argv[]) {
 
     string ds_port{PORT};  /* Holds server port */
     string ds_ip{LOCAL_IP};  /* Holds server ip */
+    bool keep_alive = false;  /* Is true if tcp commands share a single connection */
 
-    /* Goes over all the flags and setups port and ip address to connect to server */
-    for (int i = 1; i < argc; i += 2) {
-        if (strcmp(argv[i], "-p") == 0) { string s(argv[i + 1]); ds_port = s; }
-        else if (strcmp(argv[i], "-n") == 0) { string s(argv[i + 1]); ds_ip = s; }
+    /* Goes over all the flags and setups port, ip address and connection mode to connect to server */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) { string s(argv[++i]); ds_port = s; }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) { string s(argv[++i]); ds_ip = s; }
+        else if (strcmp(argv[i], "-k") == 0) { keep_alive = true; }
     }
 
     /* Creates connection with server, user and manager to execute commands */
-    Connect connect(ds_ip, ds_port);
+    Connect connect(ds_ip, ds_port, keep_alive);
     User user;
     Manager manager(connect, user);
 
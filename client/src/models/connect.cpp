@@ -26,30 +26,32 @@ void Connect::init_socket_udp() {
 
 
 /**
- * @brief Setups our tcp socket.
+ * @brief Setups our tcp socket. When keeping the connection alive, reuses the one already open.
  */
 void Connect::init_socket_tcp() {
 
-    int errcode;  /* Holds current error */
-    struct addrinfo hints{};  /* Used to request info from DNS to get our "endpoint" */
+    char peek;  /* Used to check if the server closed the connection */
+
+    /* Reuses open connection, unless the server closed it in the meantime */
+    if (this->getSocketTCP() != -1) {
+        if (this->_keep_alive && recv(this->getSocketTCP(), &peek, 1, MSG_PEEK | MSG_DONTWAIT) != 0) return;
+        close(this->getSocketTCP());
+    }
 
-    /* Creates tcp subgroup for internet */
+    /* Creates tcp subgroup for internet. Nothing that was left from an old connection applies to it */
+    this->_in.clear();
     this->_fd_tcp = socket(AF_INET, SOCK_STREAM, 0);
     assert_(this->_fd_tcp != -1, "Could not create tcp socket")
 
-    /* Inits TCP server's struct to access the DNS */
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags = AI_PASSIVE;
-
-    /* Uses its URL to consult DNS and get a TCP server's IP address */
-    errcode = getaddrinfo(this->getIP().c_str(), this->getPort().c_str(), &hints, &this->res);
-    assert_(errcode == 0, "Failed getaddrinfo call for tcp")
-
-    /* Creates connection between server and client */
+    /* Creates connection between server and client. Server's address was already resolved for udp */
     assert_(connect(this->getSocketTCP(), res->ai_addr, res->ai_addrlen) != -1, "Could not connect to server")
 
+    /* Asks the server to keep the connection open. Servers that do not support it just get one request each */
+    if (this->_keep_alive) {
+        this->sendByTCP("PIP\n");
+        if (this->receivesByTCP() != "RIP OK") this->_keep_alive = false;
+    }
+
 }
 
 
@@ -85,15 +87,76 @@ int Connect::TimerOFF(int sd) {
 }
 
 
+/**
+ * @brief Reads a line sent by the server through TCP. Anything that arrives after it is kept for
+ * the next read.
+ *
+ * @param line will hold the line without the trailing \n
+ *
+ * @return false if the server closed the connection before sending the whole line
+ */
+bool Connect::readLineByTCP(string& line) {
+
+    char buffer[TCP_READ_SIZE];  /* Holds temporarily the information sent to the socket */
+    size_t scanned = 0;  /* Bytes already known not to hold a \n */
+    size_t end;
+
+    /* Responses can be as long as they need, so we keep reading until the \n shows up */
+    while ((end = this->_in.find('\n', scanned)) == string::npos) {
+        scanned = this->_in.size();
+        ssize_t received = read(this->getSocketTCP(), buffer, TCP_READ_SIZE);
+        assert_(received != -1, "Failed to retrieve response from server")
+        if (received == 0) return false;
+        this->_in.append(buffer, received);
+    }
+
+    line = this->_in.substr(0, end);
+    this->_in.erase(0, end + 1);
+
+    return true;
+
+}
+
+
+/**
+ * @brief Reads up to length bytes sent by the server through TCP, starting with those that were kept
+ * from previous reads.
+ *
+ * @param buffer where the bytes are going to be stored
+ * @param length maximum number of bytes to be read
+ *
+ * @return number of bytes read, 0 if the server closed the connection
+ */
+ssize_t Connect::readByTCP(char* buffer, size_t length) {
+
+    /* Bytes that arrived together with the last line come first */
+    if (!this->_in.empty()) {
+        size_t n = min(length, this->_in.size());
+        memcpy(buffer, this->_in.data(), n);
+        this->_in.erase(0, n);
+        return (ssize_t) n;
+    }
+
+    ssize_t received = read(this->getSocketTCP(), buffer, length);
+    assert_(received != -1, "Failed to retrieve response from server")
+
+    return received;
+
+}
+
+
 /**
  * @brief Connect class constructor.
  *
  * @param ip ip of the server
  * @param port port of the server
+ * @param keep_alive checks if every tcp command should go through the same connection
  */
-Connect::Connect(const string& ip, const string& port) {
+Connect::Connect(const string& ip, const string& port, bool keep_alive) {
     this->_ip = ip;
     this->_port = port;
+    this->_fd_tcp = -1;
+    this->_keep_alive = keep_alive;
     this->init_socket_udp();
 }
 
@@ -159,17 +222,12 @@ void Connect::sendByUDP(const string& request) {
 void Connect::sendByTCP(const string& request) {
 
     auto remaining = (ssize_t) request.length();  /* Gets request size */
-    int sent;
-
-    /* We use a buffer to avoid a non-null terminated string */
-    char buffer[MAX_REQUEST_SIZE];
-    memset(buffer, 0, MAX_REQUEST_SIZE);
-    memcpy(buffer, request.c_str(), request.length());
+    ssize_t sent;
 
-    /* Keeps sending messages to sever until everything is sent */
-    char* ptr = const_cast<char *>(&buffer[0]);
+    /* Keeps sending until everything is sent. Only the request's own bytes go on the wire */
+    const char* ptr = request.data();
     while (remaining > 0) {
-        assert_((sent = write(this->getSocketTCP(), ptr, MAX_REQUEST_SIZE)) > 0, "Could not send message to server")
+        assert_((sent = write(this->getSocketTCP(), ptr, remaining)) > 0, "Could not send message to server")
         remaining -= sent; ptr += sent;
     }
 
@@ -182,17 +240,25 @@ void Connect::sendByTCP(const string& request) {
  * @param file file that has been already opened and from where we will be reading
  * @param file_length size of the file
  */
-void Connect::sendByTCPWithFile(ifstream& file, int file_length) {
+void Connect::sendByTCPWithFile(ifstream& file, long file_length) {
 
-    char file_data[MAX_REQUEST_SIZE];  /* Temporary buffer to hold file information */
-    int bytes_sent;  /* Tells us how many bytes have been read from each iteration */
+    vector<char> file_data(FILE_CHUNK_SIZE);  /* Temporary buffer to hold file information */
+    ssize_t bytes_sent;  /* Tells us how many bytes have been sent in each iteration */
 
-    /* Sends file data to server bit by but */
+    /* Sends file data to server as is, exactly file_length bytes, chunk by chunk */
     while (file_length > 0) {
-        file.read(file_data, MAX_REQUEST_SIZE);
-        assert_((bytes_sent = write(this->getSocketTCP(), file_data, MAX_REQUEST_SIZE)) > 0, "Could not send data message to server")
-        file_length -= bytes_sent;
-        memset(file_data, 0, MAX_REQUEST_SIZE);
+
+        file.read(file_data.data(), min((long) FILE_CHUNK_SIZE, file_length));
+        long chunk_length = file.gcount();
+        assert_(chunk_length > 0, "Could not read file to be sent")
+
+        char* ptr = file_data.data();
+        for (long remaining = chunk_length; remaining > 0; remaining -= bytes_sent, ptr += bytes_sent) {
+            assert_((bytes_sent = write(this->getSocketTCP(), ptr, remaining)) > 0, "Could not send data message to server")
+        }
+
+        file_length -= chunk_length;
+
     }
 
 }
@@ -252,20 +318,10 @@ string Connect::receivesByUDP() {
  */
 string Connect::receivesByTCP() {
 
-    ssize_t received;  /* Holds amount of bytes received */
-    char buffer[MAX_REQUEST_SIZE];  /* Holds temporarily the information sent to the socket */
     string response;  /* Used to build the server's response */
 
-    /* Keeps on reading until everything has been read from the server */
-    do {
-        received = read(this->getSocketTCP(), buffer, MAX_REQUEST_SIZE);
-        assert_(received != -1, "Failed to retrieve response from server")
-        if (received == 0) return "CONNECTION CLOSED";  /* If a client closes a socket, we need to ignore */
-        response.append(buffer, strlen(buffer));
-    } while (buffer[strlen(buffer) - 1] != '\n');
-
-    /* Removes \n from end of response. Makes things easier down the line */
-    response[response.length() - 1] = '\0';
+    /* Responses end with \n, which is removed. Makes things easier down the line */
+    if (!this->readLineByTCP(response)) return "CONNECTION CLOSED";  /* If a client closes a socket, we need to ignore */
 
     return response;
 
@@ -280,16 +336,15 @@ string Connect::receivesByTCP() {
 string Connect::receivesByTCPWithFile() {
 
     ssize_t received;  /* Holds amount of bytes received */
-    char buffer[MAX_REQUEST_SIZE];  /* Holds temporarily the information sent to the socket */
     char status[4] = {0};  /* Response status */
     int n_msgs = 0;  /* Number of messages that the server is going to send us */
+    string line;  /* Holds each line sent by the server */
     string response;  /* Used to build the server's response */
     string msg;
 
-    /* Reads first reply that will contain the information to set up the rest of the loops */
-    ssize_t n = read(this->getSocketTCP(), buffer, MAX_REQUEST_SIZE);
-    assert_(n != -1, "Failed to retrieve response from server")
-    sscanf(buffer, "%*s %s %d\n", status, &n_msgs);
+    /* Reads first line that will contain the information to set up the rest of the loops */
+    if (!this->readLineByTCP(line)) return "CONNECTION CLOSED";
+    sscanf(line.c_str(), "%*s %3s %d", status, &n_msgs);
 
     /* If status is not OK, we can interrupt */
     string status_str(status);
@@ -302,19 +357,15 @@ string Connect::receivesByTCPWithFile() {
         char msg_id[5] = {0}; string msg_id_str;
         char uid[6] = {0}; string uid_str;
         int txt_length = 0;
-        char text[MAX_POST_TEXT_SIZE] = {0}; string text_str;
-        char check_file;
-        char filename[MAX_FILENAME_SIZE] = {0};
-        int filesize = 0;
-
-        /* Reads message from server */
-        memset(buffer, 0, MAX_REQUEST_SIZE);
-        received = read(this->getSocketTCP(), buffer, MAX_REQUEST_SIZE);
-        assert_(received != -1, "Failed to retrieve response from server")
-        if (received == 0) return "CONNECTION CLOSED";  /* If a client closes a socket, we need to ignore */
+        char text[MAX_POST_TEXT_SIZE + 1] = {0}; string text_str;
+        char filename[MAX_FILENAME_SIZE + 1] = {0};
+        long filesize = 0;
+
+        /* Each message is a line. Messages with a file end with its name and size, and its data follows */
+        if (!this->readLineByTCP(line)) return "CONNECTION CLOSED";
 
         /* Gets information from response to be used to print to the user */
-        sscanf(buffer, R"(%s %s %d "%240[^"]"%c)", msg_id, uid, &txt_length, text, &check_file);
+        sscanf(line.c_str(), R"(%4s %5s %d "%240[^"]")", msg_id, uid, &txt_length, text);
 
         /* Converts into string to be easier to concatenate to a final string */
         msg_id_str = msg_id; uid_str = uid; text_str = text;
@@ -322,45 +373,26 @@ string Connect::receivesByTCPWithFile() {
         /* Creates final string */
         msg = "MSG-ID: " + msg_id_str + " | USER-ID: " + uid_str + " | TEXT: \"" + text_str + "\"";
 
-        /* If true, then we have a file incoming */
-        if (check_file == ' ') {
-
-            /* Reads file info from server */
-            memset(buffer, 0, MAX_REQUEST_SIZE);
-            received = read(this->getSocketTCP(), buffer, MAX_REQUEST_SIZE);
-            assert_(received != -1, "Failed to retrieve response from server")
-            if (received == 0) return "CONNECTION CLOSED";  /* If a client closes a socket, we need to ignore */
-
-            /* Gets information about attached file */
-            sscanf(buffer, "/ %s %d \n", filename, &filesize);
-
-            memset(buffer, 0, MAX_REQUEST_SIZE);
-            long remaining = 0;
+        /* If the text is followed by a file's information, then we have a file incoming */
+        size_t text_end = line.find('"', line.find('"') + 1);
+        if (text_end != string::npos && sscanf(line.c_str() + text_end + 1, " / %24s %ld", filename, &filesize) == 2) {
 
             /* Gets the file path */
             char *project_directory = get_current_dir_name();
             string new_file_path = string(project_directory) + "/client/files/" + filename;
+            free(project_directory);
 
             /* Creates a new file */
             ofstream file(string(new_file_path), ofstream::out | ofstream::binary);
 
-            /* Keeps reading the file data*/
-            do {
-
-                /* Reads from socket and puts in buffer */
-                received = read(this->getSocketTCP(), buffer, MAX_REQUEST_SIZE);
-                assert_(received != -1, "Failed to read from temporary socket")
-
-                /* Writes from buffer to file */
-                file.write(buffer, strlen(buffer));
-
-                /* Cleans buffer for next iteration */
-                memset(buffer, 0, MAX_REQUEST_SIZE);
-
+            /* File is sent as is, so we read exactly its size. Anything after it belongs to the next message */
+            vector<char> chunk(FILE_CHUNK_SIZE);
+            while (filesize > 0) {
+                received = this->readByTCP(chunk.data(), min((long) FILE_CHUNK_SIZE, filesize));
                 if (received == 0) break;  /* If a client closes a socket, we need to ignore */
-                remaining += received;
-
-            } while (remaining < filesize);  /* Does this until we got the whole file */
+                file.write(chunk.data(), received);
+                filesize -= received;
+            }
 
             file.close();
 
@@ -381,10 +413,12 @@ string Connect::receivesByTCPWithFile() {
 
 
 /**
- * @brief Closes current TCP connection to the server.
+ * @brief Closes current TCP connection to the server, unless it is being kept alive.
  */
 void Connect::closeTCP() {
+    if (this->_keep_alive) return;
     close(this->getSocketTCP());
+    this->_fd_tcp = -1;
 }
 
 
@@ -393,6 +427,6 @@ void Connect::closeTCP() {
  */
 void Connect::clean() {
     freeaddrinfo(this->res);
-    close(this->getSocketTCP());  // It is not needed per se but should not hurt to be sure
+    if (this->getSocketTCP() != -1) close(this->getSocketTCP());
     close(this->getSocketUDP());
 }
@@ -12,12 +12,15 @@
 #include <cstring>
 #include <unistd.h>
 #include <fstream>
+#include <vector>
 
 #define TIMEOUT_TIME_S 15
 #define UDP_N_TRIES 3
 #define MAX_REQUEST_SIZE 300
 #define MAX_POST_TEXT_SIZE 240
 #define MAX_FILENAME_SIZE 24
+#define FILE_CHUNK_SIZE 65536
+#define TCP_READ_SIZE 4096
 
 
 using namespace std;
@@ -55,6 +58,16 @@ class Connect {
          */
         struct addrinfo *res;
 
+        /**
+         * @brief Is true if the tcp connection is kept open and reused by every tcp command.
+         */
+        bool _keep_alive;
+
+        /**
+         * @brief Bytes received through tcp that were not consumed yet.
+         */
+        string _in;
+
     private:
 
         /**
@@ -76,6 +89,27 @@ class Connect {
          */
         static int TimerOFF(int sd);
 
+        /**
+         * @brief Reads a line sent by the server through TCP. Anything that arrives after it is kept for
+         * the next read.
+         *
+         * @param line will hold the line without the trailing \n
+         *
+         * @return false if the server closed the connection before sending the whole line
+         */
+        bool readLineByTCP(string& line);
+
+        /**
+         * @brief Reads up to length bytes sent by the server through TCP, starting with those that were kept
+         * from previous reads.
+         *
+         * @param buffer where the bytes are going to be stored
+         * @param length maximum number of bytes to be read
+         *
+         * @return number of bytes read, 0 if the server closed the connection
+         */
+        ssize_t readByTCP(char* buffer, size_t length);
+
     public:
 
         /**
@@ -84,7 +118,7 @@ class Connect {
         void init_socket_udp();
 
         /**
-         * @brief Setups our tcp socket.
+         * @brief Setups our tcp socket. When keeping the connection alive, reuses the one already open.
          */
         void init_socket_tcp();
 
@@ -93,8 +127,9 @@ class Connect {
          *
          * @param ip ip of the server
          * @param port port of the server
+         * @param keep_alive checks if every tcp command should go through the same connection
          */
-        explicit Connect(const string& ip, const string& port);
+        explicit Connect(const string& ip, const string& port, bool keep_alive = false);
 
 
         /**
@@ -145,7 +180,7 @@ class Connect {
          * @param file file that has been already opened and from where we will be reading
          * @param file_length size of the file
          */
-        void sendByTCPWithFile(ifstream& file, int file_length);
+        void sendByTCPWithFile(ifstream& file, long file_length);
 
         /**
          * @brief Receives a response from the server after sending a request by UDP.
@@ -169,7 +204,7 @@ class Connect {
         string receivesByTCPWithFile();
 
         /**
-         * @brief Closes current TCP connection to the server.
+         * @brief Closes current TCP connection to the server, unless it is being kept alive.
          */
         void closeTCP();
 
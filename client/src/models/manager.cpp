@@ -590,7 +590,7 @@ void Manager::doPost(const string& input) {
 
         ifstream file(string(file_path), ifstream::in | ifstream::binary | ifstream::ate);
         file.seekg(0, ios::end);
-        int file_length = file.tellg();  /* Sends request size */
+        long file_length = file.tellg();  /* Sends request size */
         file.seekg(0, ios::beg);
 
         /* Transforms user input into a valid command to be sent to the server */
@@ -658,6 +658,7 @@ void Manager::doRetrieve(const string& input) {
     this->getConnection().sendByTCP(req);
 
     string response = this->getConnection().receivesByTCPWithFile();
+    this->getConnection().closeTCP();
 
     /* Splits response to be analysed */
     vector<string> outputs;
@@ -1,8 +1,9 @@
 #include "api.h"
+#include "misc/helpers.h"
 
+#include <algorithm>
 #include <utility>
 #include <iostream>
-#include <list>
 #include <cstdio>
 
 using namespace std;
@@ -11,26 +12,26 @@ using namespace std;
 /**
  * @brief Registers user
  *
- * @param users unordered map of users
- * @param uid user id (must have only 5 digits)
+ * @param users table of users
+ * @param uid user id
  * @param pass user password
+ * @param format format of the request
  *
  * @return status message
  */
-string register_user(unordered_map<string, User>* users, string& uid, string& pass) {
+string register_user(UserTable* users, uint32_t uid, string& pass, const Format& format) {
 
-    /* Verifies if user limit has been reached or that the user id is zero */
-    if (users->size() == USER_LIMIT || uid == "00000") {
+    /* Verifies if the user id is beyond the limit or zero */
+    if (uid > format.user_limit || uid == 0) {
         return "NOK";
 
     /* Verifies if user isn't already registered */
-    } else if (users->count(uid) > 0) {
+    } else if (users->find(uid) != nullptr) {
         return "DUP";
 
     /* Since everything went alright, registers user */
     } else {
-        User user(uid, pass);
-        users->insert(make_pair(uid, user));
+        users->add(uid, pass);
         return "OK";
     }
 
@@ -40,22 +41,26 @@ string register_user(unordered_map<string, User>* users, string& uid, string& pa
 /**
  * @brief Unregisters user
  *
- * @param users unordered map of users
- * @param groups unordered map of groups
+ * @param users table of users
+ * @param groups table of groups
  * @param uid user id
  * @param pass user password
  *
  * @return status message
  */
-string unregister_user(unordered_map<string, User>* users, unordered_map<string, Group>* groups, string& uid, string& pass) {
+string unregister_user(UserTable* users, GroupTable* groups, uint32_t uid, string& pass) {
+
+    User* user = users->find(uid);
 
-    /* Verifies if there are users registered, if the user is already registered and if password is correct */
-    if (users->empty() || users->count(uid) == 0 || users->at(uid).getUserPassword() != pass) {
+    /* Verifies if the user is registered and if password is correct */
+    if (user == nullptr || !user->checkPassword(pass)) {
         return "NOK";
     } else {
-        // Removes user from list of users and from all subscribed groups
-        users->erase(uid);
-        for (auto& ele: *groups) ele.second.unsubscribeUser(uid);
+        // Removes user from the groups it subscribed, which it keeps a list of, and from the table of users
+        for (uint32_t gid = user->nextGroup(0); gid != 0; gid = user->nextGroup(gid)) {
+            groups->find(gid)->unsubscribeUser(uid);
+        }
+        users->remove(uid);
         return "OK";
     }
 
@@ -70,17 +75,15 @@ string unregister_user(unordered_map<string, User>* users, unordered_map<string,
  * @param pass user password
  * @return status message
  */
-string login_user(unordered_map<string, User>* users, string& uid, string& pass) {
+string login_user(UserTable* users, uint32_t uid, string& pass) {
+
+    User* user = users->find(uid);
 
-    /* verifies if there are users registered. This is for safety measure*/
-    if(users->empty()) {
-        return "NOK";
-    }
     /* Verifies if user is registered, if he is not logged in and if password is correct*/
-    else if (users->count(uid) == 0 || users->at(uid).getUserStatus() || users->at(uid).getUserPassword() != pass) {
+    if (user == nullptr || user->getUserStatus() || !user->checkPassword(pass)) {
             return "NOK";
     } else {
-        users->at(uid).toggleStatus();  /* Sets user status to true */
+        user->toggleStatus();  /* Sets user status to true */
         return "OK";
     }
 
@@ -95,17 +98,15 @@ string login_user(unordered_map<string, User>* users, string& uid, string& pass)
  * @param pass user password
  * @return status message
  */
-string logout_user(unordered_map<string, User>* users, string& uid, string& pass) {
-    /* verifies if there are users registered. This is for safety measure*/
-    if(users->empty()) {
-        return "NOK";
-    }
+string logout_user(UserTable* users, uint32_t uid, string& pass) {
+
+    User* user = users->find(uid);
 
     /* Verifies if user is registered, if he is logged in and if password is correct*/
-    else if (users->count(uid) == 0 || !users->at(uid).getUserStatus() || users->at(uid).getUserPassword() != pass) {
+    if (user == nullptr || !user->getUserStatus() || !user->checkPassword(pass)) {
         return "NOK";
     } else {
-        users->at(uid).toggleStatus();  /* Sets user status to false */
+        user->toggleStatus();  /* Sets user status to false */
         return "OK";
     }
 
@@ -115,29 +116,13 @@ string logout_user(unordered_map<string, User>* users, string& uid, string& pass
 /**
  * @brief Lists groups
  *
- * @param groups unordered map of groups
+ * @param groups table of groups
+ * @param format format of the request
  *
- * @return list of group IDs and names
+ * @return RGL response with the group IDs, names and last message IDs, which is kept ready by the table
  */
-string list_groups(unordered_map<string, Group>* groups) {
-    string group, list;
-    char mid[5];
-
-    /* verifies if there are groups created. This is for safety measure*/
-    if(groups->empty()) {
-        return "";
-    }
-
-    for (auto & itr : *groups) {
-        sprintf(mid, "%04u", itr.second.getMid());
-        group = itr.first + " " + itr.second.getName() + " " + mid + " ";
-        list.append(group);
-    }
-
-    /* Removing last " " from the last group in the list*/
-    list.pop_back();
-
-    return list;
+const string& list_groups(GroupTable* groups, const Format& format) {
+    return groups->getListing(format.dialect);
 }
 
 
@@ -149,57 +134,55 @@ string list_groups(unordered_map<string, Group>* groups) {
  * @param uid user's id
  * @param gid group's id
  * @param group_name group's name
+ * @param format format of the request
  *
  * @return status message
  */
-string subscribe(unordered_map<string, Group>* groups, unordered_map<string, User>* users, string& uid, string& gid, string& group_name) {
-    char new_gid[3];
+string subscribe(GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid, string& group_name,
+                 const Format& format) {
+    User* user = users->find(uid);
+    Group* group = groups->find(gid);
 
     /* Verifies if there are users registered or if there are groups to subscribe. This is for safety measure s*/
-    if(users->empty() || (groups->empty() && gid != "00")) {
+    if(users->empty() || (groups->empty() && gid != 0)) {
         return "NOK";
 
     /* UID doesn't exist or isn't logged in*/
-    } else if ((users->count(uid) == 0) || !(users->at(uid).getUserStatus())) {
+    } else if (user == nullptr || !user->getUserStatus()) {
         return "E_USR";
 
-    /* Want to create a new group, but there are already 99 groups*/
-    } else if (gid == "00" && groups->size() == 99) {
+    /* Want to create a new group, but its id would be beyond the limit */
+    } else if (gid == 0 && groups->size() >= format.group_limit) {
         return "E_FULL";
 
     /* Group doesn't exist*/
-    } else if (gid != "00" && groups->count(gid) == 0) {
+    } else if (gid != 0 && group == nullptr) {
         return "E_GRP";
 
     /* Group name is incorrect */
-    } else if (gid != "00" && groups->at(gid).getName() != group_name) {
+    } else if (gid != 0 && group->getName() != group_name) {
         return "E_GNAME";
 
     /* Group already exists and user has already subscribed*/
-    } else if (gid != "00" && groups->count(gid) != 0 && groups->at(gid).getUsers().count(uid) != 0) {
+    } else if (gid != 0 && user->isSubscribed(gid)) {
         return "OK";
 
     /* Everything is fine */
     } else {
 
-        if (gid == "00") {
-
-            /* Formats group id to hold 2 chars */
-            sprintf(new_gid, "%02lu", groups->size() + 1);
+        bool created = gid == 0;
 
-            /* Create new group*/
-            Group group(new_gid, group_name);
-            groups->insert(make_pair(new_gid, group));
-
-        } else {
-            strcpy(new_gid, gid.c_str());
+        /* Create new group*/
+        if (created) {
+            group = groups->add(group_name);
+            gid = (uint32_t) groups->size();
         }
 
         /* Subscribes user to group. Add user to group subscribers and the group to user's group */
-        groups->at(new_gid).subscribeUser(&users->at(uid));
-        users->at(uid).addGroup(new_gid);
-        
-        if (gid == "00") {
+        group->subscribeUser(uid);
+        user->addGroup(gid);
+
+        if (created) {
             return "NEW";
         } else {
             return "OK";
@@ -218,19 +201,22 @@ string subscribe(unordered_map<string, Group>* groups, unordered_map<string, Use
  * @param gid group's id
  * @return status message
  */
-string unsubscribe(unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid, string gid) {
+string unsubscribe(GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid) {
+    User* user = users->find(uid);
+    Group* group = groups->find(gid);
+
     /*Verifies if the user exists */
-    if(!users->empty() && users->count(uid) == 0){
+    if(user == nullptr){
         return "E_USR";
 
     /*Verifies if the group exists */
-    } else if (!groups->empty() && groups->count(gid) == 0){
+    } else if (group == nullptr){
         return "E_GRP";
 
     } else {
         /*Unsubscribe user */
-        groups->at(gid).unsubscribeUser(uid);
-        users->at(uid).removeGroup(gid);
+        group->unsubscribeUser(uid);
+        user->removeGroup(gid);
 
         return "OK";
     }
@@ -242,40 +228,38 @@ string unsubscribe(unordered_map<string, Group>* groups, unordered_map<string, U
  * @param groups structure that holds all groups in the server
  * @param users structure that holds all users in the server
  * @param uid user's id
+ * @param format format of the request, groups it can't name are left out
  * @return number of groups and list of groups
  */
-string groups_subscribed(unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid){
-    string out, group;
-    char mid[5];
-    list<string> user_groups;
+string groups_subscribed(GroupTable* groups, UserTable* users, uint32_t uid, const Format& format){
+    string out;
+    User* user = users->find(uid);
 
     /*Verifies if the user exists */
-    if(!users->empty() && users->count(uid) == 0) {
+    if(user == nullptr) {
         return "E_USR";
 
         /* User not logged in*/
-    } else if (!users->at(uid).getUserStatus()){
+    } else if (!user->getUserStatus()){
         return "E_USR";
 
     } else {
-        user_groups = users->at(uid).getUserGroups();
-
-        if (user_groups.empty()){
-            return "0";
-        }
-
-        //TODO: @Sofia-Morgado-> isto vai ter consequências no código
-        for (auto & itr : user_groups ) {
-            /* Formats message id to hold 4 chars */
-            sprintf(mid, "%04u", groups->at(itr).getMid());
-            group = groups->at(itr).getGroupId() + " " + groups->at(itr).getName() + " " + mid + " ";
-            out.append(group);
+        /* Groups are gone over in order, so the ones the format can name come first */
+        int count = user->countGroups(format.group_limit);
+
+        out = to_string(count);
+        out.reserve(out.size() + count * (format.gid_size + GROUP_NAME_MAX_SIZE + format.mid_size + 3));
+
+        for (uint32_t gid = user->nextGroup(0); gid != 0 && gid <= format.group_limit; gid = user->nextGroup(gid)) {
+            Group* group = groups->find(gid);
+            /* Formats group id and message id to the widths of the format */
+            out.push_back(' ');
+            append_number(out, gid, (int) format.gid_size);
+            out.append(" ").append(group->getName()).append(" ");
+            append_number(out, min(group->getMid(), format.mid_limit), (int) format.mid_size);
         }
 
-        /* Removing last " " from the last group in the list*/
-        out.pop_back();
-
-        return to_string(user_groups.size()) + " " + out;
+        return out;
     }
 
 }
@@ -285,34 +269,29 @@ string groups_subscribed(unordered_map<string, Group>* groups, unordered_map<str
  * Sends a list of the users subscribed to this group
  * @param groups structure that holds all groups in the server
  * @param gid group's id
+ * @param format format of the request, users it can't name are left out
  * @return status message and list of users (if applicable)
  */
-string users_subscribed(unordered_map<string, Group>* groups, string gid){
-    string out, user;
-    unordered_map<string, User*> users_subscribed;
+string users_subscribed(GroupTable* groups, uint32_t gid, const Format& format){
+    string out;
+    Group* group = groups->find(gid);
 
     /*Verifies if the group exists */
-    if (!groups->empty() && groups->count(gid) == 0){
+    if (group == nullptr){
         return "NOK";
 
     } else {
-        /* Gets all users subscribed to the group*/
-        users_subscribed = groups->at(gid).getUsers();
-
-        if (users_subscribed.empty()){
-            return "OK " + groups->at(gid).getName();
-        }
-
-        /* For each user, gets its id */
-        for (auto & itr : users_subscribed ) {
-            user = itr.first + " ";
-            out.append(user);
+        out.reserve(3 + group->getName().size() + group->getUsers().size() * (format.uid_size + 1));
+        out.append("OK ").append(group->getName());
+
+        /* For each user, gets its id. Users are kept in order, so the ones the format can't name are the last */
+        for (uint32_t uid : group->getUsers()) {
+            if (uid > format.user_limit) break;
+            out.push_back(' ');
+            append_number(out, uid, (int) format.uid_size);
         }
 
-        /* Removing last " " from the last group in the list*/
-        out.pop_back();
-
-        return "OK " + groups->at(gid).getName() + " " + out;
+        return out;
     }
 
 }
@@ -324,33 +303,35 @@ string users_subscribed(unordered_map<string, Group>* groups, string gid){
  * @param users structure that holds all the users in the server
  * @param uid user's id
  * @param gid group's id
- * @param txt_size text size
  * @param text text
+ * @param format format of the request
+ * @param filename file's name, empty if there is no file
+ * @param filesize file's size
  * @return status message
  */
-string post_message(unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid, string gid, string txt_size, string text, string filename, string filesize) {
+string post_message(GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid, string_view text,
+                    const Format& format, string_view filename, long filesize) {
 
-    char mid[5];
+    string mid;
+    User* user = users->find(uid);
+    Group* group = groups->find(gid);
 
     /*Verifies if the user exists */
-    if(!users->empty() && users->count(uid) == 0) {
+    if(user == nullptr) {
         return "NOK";
 
     /*Verifies if the group exists */
-    } else if (!groups->empty() && groups->count(gid) == 0) {
+    } else if (group == nullptr) {
         return "NOK";
 
     /*Verifies if it's possible to post a new message*/
-    } else if (groups->at(gid).getMid() == MID_LIMIT) {
+    } else if (group->getMid() >= format.mid_limit) {
         return "NOK";
     }
 
-    /* Formats message id to hold 4 chars */
-    sprintf(mid, "%04u", groups->at(gid).getMid() + 1);
-
-    /* Create a new message and post it on the group*/
-    Message m(mid, uid, text, filename, filesize);
-    groups->at(gid).postMessage(m);
+    /* Posts the message on the group and formats its id to the width of the format */
+    append_number(mid, group->postMessage(uid, text, filename, filesize), (int) format.mid_size);
+    groups->messagePosted(gid);
 
     /* Returns message identifier*/
     return mid;
@@ -360,22 +341,26 @@ string post_message(unordered_map<string, Group>* groups, unordered_map<string,
 /**
  * @brief Retrieves 20 messages from a group after a certain mid.
  *
- * @param groups map of groups
+ * @param groups table of groups
  * @param gid request groups
  * @param mid start message id
- * @param out vector of messages that are going to be read and parsed by manager
+ * @param out messages that are going to be read and parsed by manager, straight from the group
  *
  * @return status string
  */
-string retrieve_message(unordered_map<string, Group>* groups, string& gid, string& mid, vector<Message>& out) {
+string retrieve_message(GroupTable* groups, uint32_t gid, uint32_t mid, MessageRange& out) {
+
+    Group* group = groups->find(gid);
 
     /* Verifies if the group exists */
-    if (!groups->empty() && groups->count(gid) == 0) {
+    if (group == nullptr) {
         return "NOK";
     }
 
-    /* Get messages from the input message to the end or until 20 */
-    out = groups->at(gid).retrieveMessages(stoi(mid));
+    /* Get messages from the input message to the end or until 20. Log that can't be read fails the request */
+    if (!group->retrieveMessages(mid, out)) {
+        return "NOK";
+    }
 
     /* No messages available */
     if (out.empty()) {
@@ -5,24 +5,51 @@
 #include "models/user.h"
 #include "models/group.h"
 
-#define USER_LIMIT 99999
-#define MID_LIMIT 9999
+#define EXT_TEXT_LIMIT 65535
 
 using namespace std;
 
-string register_user(unordered_map<string, User>* users, string& uid, string& pass);
-string unregister_user(unordered_map<string, User>* users, unordered_map<string, Group>* groups, string& uid,
-                       string& pass);
-string login_user(unordered_map<string, User>* users, string& uid, string& pass);
-string logout_user(unordered_map<string, User>* users, string& uid, string& pass);
-string list_groups(unordered_map<string, Group>* groups);
-string subscribe (unordered_map<string, Group>* groups, unordered_map<string, User>* users, string& uid, string& gid,
-                  string& group_name);
-string unsubscribe(unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid, string gid);
-string groups_subscribed (unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid);
-string users_subscribed (unordered_map<string, Group>* groups, string gid);
-string post_message (unordered_map<string, Group>* groups, unordered_map<string, User>* users, string uid, string gid, string text_size, string text, string filename = "", string filesize  = "");
-string retrieve_message (unordered_map<string, Group>* groups, string& gid, string& mid, vector<Message>& out);
+
+/**
+ * @brief How far the server lets users, groups and messages go. Set when the server starts.
+ */
+struct Limits {
+    uint32_t users;     /* Highest user id */
+    uint32_t groups;    /* Most groups */
+    uint32_t messages;  /* Most messages in each group */
+    uint32_t text;      /* Most characters in a message's text */
+};
+
+
+/**
+ * @brief How the requests and responses of a dialect are laid out, and how far they can reach.
+ */
+struct Format {
+    Dialect dialect;
+    string_view prefix;     /* Put before the opcode of every response */
+    size_t uid_min_size;    /* Fewest digits of a user id in a request */
+    size_t uid_size;        /* Most digits of a user id in a request, and its width in responses */
+    size_t gid_size;        /* Most digits of a group id in a request, and its width in responses */
+    size_t mid_size;        /* Most digits of a message id in a request, and its width in responses */
+    size_t text_size_size;  /* Most digits of a text's size */
+    uint32_t user_limit;    /* Highest user id */
+    uint32_t group_limit;   /* Highest group id */
+    uint32_t mid_limit;     /* Highest message id in each group */
+    uint32_t text_limit;    /* Most characters in a message's text */
+};
+
+
+string register_user(UserTable* users, uint32_t uid, string& pass, const Format& format);
+string unregister_user(UserTable* users, GroupTable* groups, uint32_t uid, string& pass);
+string login_user(UserTable* users, uint32_t uid, string& pass);
+string logout_user(UserTable* users, uint32_t uid, string& pass);
+const string& list_groups(GroupTable* groups, const Format& format);
+string subscribe (GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid, string& group_name, const Format& format);
+string unsubscribe(GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid);
+string groups_subscribed (GroupTable* groups, UserTable* users, uint32_t uid, const Format& format);
+string users_subscribed (GroupTable* groups, uint32_t gid, const Format& format);
+string post_message (GroupTable* groups, UserTable* users, uint32_t uid, uint32_t gid, string_view text, const Format& format, string_view filename = "", long filesize = 0);
+string retrieve_message (GroupTable* groups, uint32_t gid, uint32_t mid, MessageRange& out);
 
 
 #endif
@@ -5,16 +5,24 @@
 #include "models/message.h"
 #include "models/manager.h"
 #include "models/connect.h"
+#include "models/journal.h"
+#include "models/snapshot.h"
+#include "models/attachment.h"
 #include "misc/helpers.h"
 
 #include <unistd.h>
 #include <cstdio>
 #include <cstdlib>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <csignal>
 #include <cstring>
-#include <dirent.h>
+#include <cerrno>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
 
 
 using namespace std;
@@ -22,6 +30,10 @@ using namespace std;
 
 /* Const definitions */
 #define PORT "58039"
+#define DEFAULT_GROUP_LIMIT 100000
+#define DEFAULT_MESSAGE_LIMIT 10000000
+#define DEFAULT_TEXT_LIMIT 4096
+#define DEFAULT_SNAPSHOT_MB 64
 
 
 /*-------------------------------------- Server global vars --------------------------------------*/
@@ -29,48 +41,33 @@ using namespace std;
 
 bool isVerbose = false;  /* Is true if the server is set to verbose mode */
 
-/* Creates unique pointer to manager */
-unique_ptr<Manager> manager;
+/* Creates unique pointers to managers. There is one per event loop */
+vector<unique_ptr<Manager>> managers;
+
+/* Keep users and groups across restarts. Only exist if the server was given a data directory */
+unique_ptr<Journal> journal;
+unique_ptr<Snapshot> snapshot;
+
+/* Keeps the files posted with messages, once per distinct contents */
+unique_ptr<AttachmentStore> attachments;
+
+int stop_fd = -1;  /* Becomes readable once the server has to stop, which ends every event loop */
 
 
 /*----------------------------------------- Functions --------------------------------------------*/
 
 
 /**
- * @brief Function to handle Ctrl + C signal. Removes all files from the files directory and closes the server sockets
+ * @brief Function to handle Ctrl + C signal. Only tells every event loop to stop, as other threads may be in the
+ * middle of a request. Server is cleaned up by main once they are done
  *
  * @param sig_type type of signal
  */
 void termination_handler(int sig_type) {
-
-    struct dirent *entry;
-    DIR *dp;
-
-    /* Gets the current directory of the project*/
-    string filepath;
-    string files_directory = string(get_current_dir_name()) + "/server/files";
-
-    /* Opens the files directory */
-    dp = opendir(files_directory.c_str());
-    assert_(dp, "Failed to open the files directory");
-
-    /* Goes over each file and removes it */
-    while ((entry = readdir(dp))) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
-            continue;
-
-        filepath = files_directory +  "/" + entry->d_name;
-        /* Removes file*/
-        assert_((remove(filepath.c_str()) == 0), "Failed to delete file");
-    }
-
-    /* Closes the directory*/
-    closedir(dp);
-
-    manager->clean();  /* Cleans manager's memory */
-
-    /* Ends program */
-    exit(EXIT_SUCCESS);
+    int saved_errno = errno;
+    uint64_t one = 1;
+    while (write(stop_fd, &one, sizeof one) == -1 && errno == EINTR);
+    errno = saved_errno;
 }
 
 
@@ -105,6 +102,20 @@ void initialize_interrupters() {
 }
 
 
+/**
+ * @brief Reads a limit given in the command line, which has to be between 1 and a ceiling.
+ *
+ * @param arg limit as typed
+ * @param ceiling highest limit allowed
+ *
+ * @return limit
+ */
+uint32_t parse_limit(const char* arg, uint32_t ceiling) {
+    unsigned long long limit = strtoull(arg, nullptr, 10);
+    return (uint32_t) max(1ULL, min(limit, (unsigned long long) ceiling));
+}
+
+
 /**
  * Setups server loop.
  *
@@ -115,25 +126,84 @@ void initialize_interrupters() {
 int main(int argc, char const *argv[]) {
 
     string ds_port{PORT};  /* Holds server port */
+    int n_threads = 1;  /* Holds number of event loops */
+    bool useUring = false;  /* Is true if event loops run on io_uring instead of epoll */
+    Limits limits = {UINT32_MAX, DEFAULT_GROUP_LIMIT, DEFAULT_MESSAGE_LIMIT, DEFAULT_TEXT_LIMIT};
+    string data_directory;  /* Holds where users and groups are kept, empty if they are only kept in memory */
+    uint32_t snapshot_mb = DEFAULT_SNAPSHOT_MB;  /* Holds the journal size, in MiB, that triggers a snapshot */
+    bool compress = false;  /* Is true if stored files and sealed log segments are compressed */
 
     /* Initializes signal interrupters treatment */
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    assert_(stop_fd != -1, "Could not create the stop event\n")
     initialize_interrupters();
 
-    /* Goes over all the flags and setups port and verbose mode */
-    for (int i = 1; i < argc; i += 2) {
-        if (strcmp(argv[i], "-p") == 0) { string s(argv[i + 1]); ds_port = s; }
+    /* Goes over all the flags and setups port, verbose mode, number of threads, io backend, limits, data directory and
+     * compression */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) { string s(argv[++i]); ds_port = s; }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) { n_threads = max(1, atoi(argv[++i])); }
         else if (strcmp(argv[i], "-v") == 0) { isVerbose = true; }
+        else if (strcmp(argv[i], "-u") == 0) { useUring = true; }
+        else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc) { limits.users = parse_limit(argv[++i], UINT32_MAX); }
+        else if (strcmp(argv[i], "-G") == 0 && i + 1 < argc) { limits.groups = parse_limit(argv[++i], UINT32_MAX); }
+        else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) { limits.messages = parse_limit(argv[++i], UINT32_MAX); }
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) { limits.text = parse_limit(argv[++i], EXT_TEXT_LIMIT); }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) { data_directory = argv[++i]; }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) { snapshot_mb = parse_limit(argv[++i], UINT32_MAX >> 20); }
+        else if (strcmp(argv[i], "-z") == 0) { compress = true; }
     }
 
     /* Create structures that will allow us to run the server */
-    unordered_map<string, User> users;
-    unordered_map<string, Group> groups;
-    Connect connect(ds_port);
+    UserTable users;
+    GroupTable groups;
+    mutex lock;
+
+    /* Rebuilds users and groups from the last snapshot and the journal before any request is served */
+    if (!data_directory.empty()) {
+        assert_(mkdir(data_directory.c_str(), 0755) == 0 || errno == EEXIST, "Could not create the data directory\n")
+        groups.setDirectory(data_directory + "/groups", compress);
+        snapshot = make_unique<Snapshot>(data_directory, (uint64_t) snapshot_mb << 20);
+        uint64_t generation = snapshot->load(&users, &groups);
+        journal = make_unique<Journal>(data_directory);
+        size_t count = journal->replay(&users, &groups, generation);
+        verbose_(isVerbose, "Loaded snapshot " + to_string(generation) + " and replayed " + to_string(count) +
+                            " changes from the journal")
+    }
 
-    /* Creates manager that will control our server */
-    manager = make_unique<Manager>(&users, &groups, connect, isVerbose);
+    /* Files are kept in the project's files directory. Those no message refers to anymore are removed */
+    char* project_directory = get_current_dir_name();
+    attachments = make_unique<AttachmentStore>(string(project_directory) + "/server/files", compress);
+    free(project_directory);
+    size_t removed = attachments->collect();
+    verbose_(isVerbose, "Removed " + to_string(removed) + " files no message refers to")
+
+    /* Creates one manager per event loop. Each one has its own sockets bound to the same port */
+    for (int i = 0; i < n_threads; i++) {
+        Connect connect(ds_port, n_threads > 1);
+        managers.push_back(make_unique<Manager>(&users, &groups, connect, isVerbose, &lock, limits, journal.get(),
+                                               snapshot.get(), attachments.get()));
+    }
+
+    /* Inits every event loop but the first one in its own thread */
+    auto loop = useUring ? &Manager::start_server_uring : &Manager::start_server;
+    vector<thread> threads;
+    for (int i = 1; i < n_threads; i++) threads.emplace_back(loop, managers[i].get(), stop_fd);
 
     /* Inits main server loop */
-    manager->start_server();
+    (managers[0].get()->*loop)(stop_fd);
+
+    /* Nothing is cleaned up until every event loop is done with it */
+    for (auto& itr: threads) itr.join();
+
+    /* Files are kept if the server keeps its data, as the messages that refer to them come back on restart.
+     * Otherwise every file is removed, as no message refers to them anymore */
+    if (journal) journal->clean();
+    else attachments->clear();
+
+    for (auto& manager: managers) manager->clean();  /* Cleans managers' memory */
+    close(stop_fd);
+
+    return EXIT_SUCCESS;
 
 }
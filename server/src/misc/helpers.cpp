@@ -1,5 +1,16 @@
 #include "helpers.h"
 
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
 
 /*
  * Transforms a string with spaces in a vector with substring tokenized by the spaces.
@@ -59,3 +70,505 @@ string get_command(const string& str) {
     stringstream ss(str); string s; char delim = ' '; string cmd;
     getline(ss, cmd, delim); return cmd;
 }
+
+
+/*
+ * Appends a number with a fixed number of digits, padded with zeros.
+ *
+ * @param out string where the number is appended
+ * @param value number to be appended
+ * @param width number of digits
+ */
+void append_number(string &out, uint32_t value, int width) {
+    char digits[10];
+    for (int i = width - 1; i >= 0; i--, value /= 10) digits[i] = (char) ('0' + value % 10);
+    out.append(digits, width);
+}
+
+
+/*
+ * CRC-32 of each byte value, so CRCs are computed a byte at a time.
+ */
+static constexpr array<uint32_t, 256> CRC32_TABLE = [] {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}();
+
+
+/*
+ * Computes the CRC-32 (IEEE) of some bytes. Can be carried over several calls.
+ *
+ * @param data bytes to be checked
+ * @param size number of bytes
+ * @param crc CRC of the bytes that came before, 0 if none
+ *
+ * @return CRC of everything so far
+ */
+uint32_t crc32(const char* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = CRC32_TABLE[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+/*
+ * Syncs a directory, so that the entries created, renamed or removed in it are on disk.
+ *
+ * @param directory directory's path
+ */
+void sync_directory(const string& directory) {
+    int dir = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    assert_(dir != -1 && fsync(dir) == 0, "Could not sync the data directory\n")
+    close(dir);
+}
+
+
+/* Round constants of SHA-256 */
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+/*
+ * Rotates a 32 bit word to the right.
+ */
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+
+/*
+ * Adds whole 64 byte blocks to a SHA-256, one at a time.
+ *
+ * @param state hash of the blocks so far
+ * @param data bytes to be hashed
+ * @param blocks number of blocks
+ */
+static void sha256_blocks(uint32_t* state, const unsigned char* data, size_t blocks) {
+
+    for (; blocks > 0; blocks--, data += 64) {
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t) data[4 * i] << 24 | (uint32_t) data[4 * i + 1] << 16 |
+                   (uint32_t) data[4 * i + 2] << 8 | (uint32_t) data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+    }
+
+}
+
+
+#if defined(__x86_64__)
+
+/*
+ * Adds whole 64 byte blocks to a SHA-256 with the processor's SHA extensions, which hash several times faster.
+ * State is kept as ABEF and CDGH while blocks are hashed, as the instructions expect.
+ *
+ * @param state hash of the blocks so far
+ * @param data bytes to be hashed
+ * @param blocks number of blocks
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_ni(uint32_t* state, const unsigned char* data, size_t blocks) {
+
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);
+    __m128i cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B);
+    __m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+
+        __m128i abef_saved = abef, cdgh_saved = cdgh;
+
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), bswap);
+
+        /* Four rounds at a time. Words of the next four rounds are computed from the last sixteen */
+        #pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            __m128i msg = _mm_add_epi32(w[i % 4], _mm_loadu_si128((const __m128i*) &SHA256_K[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E));
+            if (i < 12) {
+                tmp = _mm_add_epi32(_mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]),
+                                    _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4));
+                w[i % 4] = _mm_sha256msg2_epu32(tmp, w[(i + 3) % 4]);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, abef_saved);
+        cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+
+    }
+
+    tmp = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*) &state[0], _mm_blend_epi16(tmp, cdgh, 0xF0));
+    _mm_storeu_si128((__m128i*) &state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+
+}
+
+#endif
+
+
+/* Hashes blocks with the SHA extensions when the processor has them */
+static void (* const SHA256_BLOCKS)(uint32_t*, const unsigned char*, size_t) = [] {
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA)) return sha256_blocks_ni;
+#endif
+    return sha256_blocks;
+}();
+
+
+/*
+ * Starts a SHA-256.
+ *
+ * @param sha state to be started
+ */
+void sha256_init(Sha256& sha) {
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(sha.state, initial, sizeof initial);
+    sha.length = 0;
+}
+
+
+/*
+ * Adds some bytes to a SHA-256.
+ *
+ * @param sha state of the hash
+ * @param data bytes to be hashed
+ * @param size number of bytes
+ */
+void sha256_update(Sha256& sha, const char* data, size_t size) {
+
+    auto* bytes = (const unsigned char*) data;
+    size_t used = sha.length % 64;
+    sha.length += size;
+
+    /* Fills the block that was left halfway */
+    if (used > 0) {
+        size_t n = min(size, 64 - used);
+        memcpy(sha.block + used, bytes, n);
+        bytes += n;
+        size -= n;
+        if (used + n < 64) return;
+        SHA256_BLOCKS(sha.state, sha.block, 1);
+    }
+
+    /* Whole blocks are hashed where they are */
+    SHA256_BLOCKS(sha.state, bytes, size / 64);
+    memcpy(sha.block, bytes + size / 64 * 64, size % 64);
+
+}
+
+
+/*
+ * Ends a SHA-256.
+ *
+ * @param sha state of the hash, which can not be updated anymore
+ *
+ * @return hash in lowercase hexadecimal
+ */
+string sha256_hex(Sha256& sha) {
+
+    /* Pads with a 1 bit, zeros and the length in bits, so the last block is full */
+    uint64_t bits = sha.length * 8;
+    unsigned char padding[72] = {0x80};
+    size_t n = (sha.length % 64 < 56 ? 56 : 120) - sha.length % 64;
+    for (int i = 0; i < 8; i++) padding[n + i] = (unsigned char) (bits >> (56 - 8 * i));
+    sha256_update(sha, (const char*) padding, n + 8);
+
+    static const char digits[] = "0123456789abcdef";
+    string hex;
+    hex.reserve(64);
+    for (uint32_t word: sha.state) {
+        for (int shift = 28; shift >= 0; shift -= 4) hex.push_back(digits[(word >> shift) & 0xF]);
+    }
+
+    return hex;
+
+}
+
+
+/* Matches are at least this long, and the last ones have to leave these many bytes as literals */
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+
+
+/*
+ * Reads 4 or 8 bytes that may not be aligned.
+ */
+static inline uint32_t read32(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t read64(const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+
+/*
+ * Writes a length that did not fit in its 4 bits of the token, 255 at a time.
+ */
+static inline unsigned char* write_length(unsigned char* out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (unsigned char) length;
+    return out;
+}
+
+
+/*
+ * Compresses some bytes in the LZ4 block format.
+ *
+ * @param data bytes to be compressed
+ * @param size number of bytes
+ * @param out where the compressed bytes are written
+ * @param capacity number of bytes that fit in out
+ *
+ * @return number of compressed bytes, 0 if they do not fit in out
+ */
+size_t lz4_compress(const char* data, size_t size, char* out, size_t capacity) {
+
+    auto* in = (const unsigned char*) data;
+    const unsigned char* end = in + size;
+    auto* op = (unsigned char*) out;
+    const unsigned char* op_end = op + capacity;
+    const unsigned char* anchor = in;
+
+    /* Last position where each hash of 4 bytes was seen */
+    uint32_t table[1 << LZ4_HASH_BITS] = {};
+    auto hash = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS); };
+
+    if (size > LZ4_MATCH_LIMIT) {
+
+        const unsigned char* limit = end - LZ4_MATCH_LIMIT;
+        const unsigned char* match_end = end - LZ4_LAST_LITERALS;
+        const unsigned char* ip = in + 1;
+
+        while (ip < limit) {
+
+            /* Looks for a match, stepping further the longer nothing is found, so data that does not
+             * compress goes by quickly */
+            const unsigned char* ref;
+            unsigned misses = 1 << 6;
+            for (;;) {
+                uint32_t sequence = read32(ip);
+                uint32_t h = hash(sequence);
+                ref = in + table[h];
+                table[h] = (uint32_t) (ip - in);
+                if (ip - ref <= LZ4_MAX_OFFSET && ref < ip && read32(ref) == sequence) break;
+                ip += misses++ >> 6;
+                if (ip >= limit) goto last_literals;
+            }
+
+            /* Match may start before where it was found */
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) { ip--; ref--; }
+
+            /* And goes on as long as the bytes are the same */
+            const unsigned char* p = ip + LZ4_MIN_MATCH;
+            const unsigned char* q = ref + LZ4_MIN_MATCH;
+            while (p + 8 <= match_end) {
+                uint64_t diff = read64(p) ^ read64(q);
+                if (diff != 0) { p += __builtin_ctzll(diff) >> 3; goto matched; }
+                p += 8;
+                q += 8;
+            }
+            while (p < match_end && *p == *q) { p++; q++; }
+            matched:
+
+            size_t literals = ip - anchor;
+            size_t match = p - ip - LZ4_MIN_MATCH;
+            if ((size_t) (op_end - op) < literals + literals / 255 + match / 255 + 6) return 0;
+
+            /* Token holds both lengths, which go on in the bytes after it when they do not fit */
+            unsigned char* token = op++;
+            *token = (unsigned char) ((min(literals, (size_t) 15) << 4) | min(match, (size_t) 15));
+            if (literals >= 15) op = write_length(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op += literals;
+            size_t offset = ip - ref;
+            *op++ = (unsigned char) offset;
+            *op++ = (unsigned char) (offset >> 8);
+            if (match >= 15) op = write_length(op, match - 15);
+
+            ip = anchor = p;
+            if (ip < limit) table[hash(read32(ip - 2))] = (uint32_t) (ip - 2 - in);
+
+        }
+
+    }
+
+    /* Whatever is left goes as literals */
+    last_literals:
+    size_t literals = end - anchor;
+    if ((size_t) (op_end - op) < literals + literals / 255 + 2) return 0;
+    *op++ = (unsigned char) (min(literals, (size_t) 15) << 4);
+    if (literals >= 15) op = write_length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - (unsigned char*) out;
+
+}
+
+
+/*
+ * Decompresses bytes in the LZ4 block format.
+ *
+ * @param data compressed bytes
+ * @param size number of compressed bytes
+ * @param out where the bytes are decompressed to
+ * @param capacity number of bytes they are expected to decompress to
+ *
+ * @return false if they are corrupted or do not decompress to exactly capacity bytes
+ */
+bool lz4_decompress(const char* data, size_t size, char* out, size_t capacity) {
+
+    auto* ip = (const unsigned char*) data;
+    const unsigned char* ip_end = ip + size;
+    auto* op = (unsigned char*) out;
+    unsigned char* op_end = op + capacity;
+
+    /* Reads the rest of a length that did not fit in its 4 bits of the token */
+    auto read_length = [&](size_t& length) {
+        unsigned char byte;
+        do {
+            if (ip == ip_end) return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < ip_end) {
+
+        unsigned char token = *ip++;
+
+        /* Literals are copied 8 bytes at a time while there is room to spare on both sides */
+        size_t literals = token >> 4;
+        if (literals == 15 && !read_length(literals)) return false;
+        if (literals > (size_t) (ip_end - ip) || literals > (size_t) (op_end - op)) return false;
+        if (ip_end - ip >= (ptrdiff_t) literals + 8 && op_end - op >= (ptrdiff_t) literals + 8) {
+            for (size_t i = 0; i < literals; i += 8) memcpy(op + i, ip + i, 8);
+        } else {
+            memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+
+        /* Last sequence only has literals */
+        if (ip == ip_end) break;
+
+        if (ip_end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && !read_length(match)) return false;
+        match += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t) (op - (unsigned char*) out) || match > (size_t) (op_end - op)) return false;
+
+        /* Matches may overlap what they are copying. Chunks of 8 bytes only read what was already written
+         * when the match is at least that far back */
+        const unsigned char* ref = op - offset;
+        if (offset >= 8 && op_end - op >= (ptrdiff_t) match + 8) {
+            for (size_t i = 0; i < match; i += 8) memcpy(op + i, ref + i, 8);
+        } else {
+            for (size_t i = 0; i < match; i++) op[i] = ref[i];
+        }
+        op += match;
+
+    }
+
+    return op == op_end;
+
+}
+
+
+/*
+ * Appends some bytes as a block, compressed if that makes them smaller.
+ *
+ * @param out string where the block is appended
+ * @param data bytes to be appended
+ * @param size number of bytes
+ */
+void compress_block(string& out, const char* data, size_t size) {
+
+    size_t start = out.size();
+    out.resize(start + sizeof(CompressedBlock) + size);
+
+    CompressedBlock block{0, (uint32_t) size};
+    block.stored = (uint32_t) lz4_compress(data, size, &out[start + sizeof block], size - 1 < size ? size - 1 : 0);
+    if (block.stored == 0) {
+        block.stored = (uint32_t) size;
+        memcpy(&out[start + sizeof block], data, size);
+    }
+
+    memcpy(&out[start], &block, sizeof block);
+    out.resize(start + sizeof block + block.stored);
+
+}
+
+
+/*
+ * Appends the bytes of a block written by compress_block.
+ *
+ * @param data block
+ * @param size number of bytes available, which may go beyond the block
+ * @param out string where the bytes are appended
+ *
+ * @return size of the block, 0 if it is corrupted or cut short
+ */
+size_t decompress_block(const char* data, size_t size, string& out) {
+
+    CompressedBlock block{};
+    if (size < sizeof block) return 0;
+    memcpy(&block, data, sizeof block);
+    if (block.stored > size - sizeof block || block.stored > block.size) return 0;
+
+    size_t start = out.size();
+    out.resize(start + block.size);
+    const char* bytes = data + sizeof block;
+
+    /* Bytes that did not get smaller were stored as they are */
+    if (block.stored == block.size) {
+        memcpy(&out[start], bytes, block.size);
+    } else if (!lz4_decompress(bytes, block.stored, &out[start], block.size)) {
+        out.resize(start);
+        return 0;
+    }
+
+    return sizeof block + block.stored;
+
+}
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <cstdint>
+#include <cstddef>
 
 /* If condition is false displays msg and interrupts execution */
 #define assert_(cond, msg) if(! (cond)) { fprintf(stderr, msg); exit(EXIT_FAILURE); }
@@ -60,5 +62,120 @@ bool isAlphaNumericPlus(const string& line);
  */
 string get_command(const string& str);
 
+/**
+ * Appends a number with a fixed number of digits, padded with zeros.
+ *
+ * @param out string where the number is appended
+ * @param value number to be appended
+ * @param width number of digits
+ */
+void append_number(string &out, uint32_t value, int width);
+
+/**
+ * Computes the CRC-32 (IEEE) of some bytes. Can be carried over several calls.
+ *
+ * @param data bytes to be checked
+ * @param size number of bytes
+ * @param crc CRC of the bytes that came before, 0 if none
+ *
+ * @return CRC of everything so far
+ */
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0);
+
+/**
+ * Syncs a directory, so that the entries created, renamed or removed in it are on disk.
+ *
+ * @param directory directory's path
+ */
+void sync_directory(const string& directory);
+
+/**
+ * State of a SHA-256 that is computed over several calls.
+ */
+struct Sha256 {
+    uint32_t state[8];        /* Hash of the blocks so far */
+    uint64_t length;          /* Number of bytes so far */
+    unsigned char block[64];  /* Bytes that do not fill a block yet */
+};
+
+/**
+ * Starts a SHA-256.
+ *
+ * @param sha state to be started
+ */
+void sha256_init(Sha256& sha);
+
+/**
+ * Adds some bytes to a SHA-256.
+ *
+ * @param sha state of the hash
+ * @param data bytes to be hashed
+ * @param size number of bytes
+ */
+void sha256_update(Sha256& sha, const char* data, size_t size);
+
+/**
+ * Ends a SHA-256.
+ *
+ * @param sha state of the hash, which can not be updated anymore
+ *
+ * @return hash in lowercase hexadecimal
+ */
+string sha256_hex(Sha256& sha);
+
+
+/**
+ * Start of a block written by compress_block. It is followed by the block's bytes, which are stored as they are
+ * when compressing did not make them smaller.
+ */
+struct CompressedBlock {
+    uint32_t stored;  /* Number of bytes that follow */
+    uint32_t size;    /* Number of bytes once decompressed */
+};
+
+/**
+ * Compresses some bytes in the LZ4 block format.
+ *
+ * @param data bytes to be compressed
+ * @param size number of bytes
+ * @param out where the compressed bytes are written
+ * @param capacity number of bytes that fit in out
+ *
+ * @return number of compressed bytes, 0 if they do not fit in out
+ */
+size_t lz4_compress(const char* data, size_t size, char* out, size_t capacity);
+
+/**
+ * Decompresses bytes in the LZ4 block format.
+ *
+ * @param data compressed bytes
+ * @param size number of compressed bytes
+ * @param out where the bytes are decompressed to
+ * @param capacity number of bytes they are expected to decompress to
+ *
+ * @return false if they are corrupted or do not decompress to exactly capacity bytes
+ */
+bool lz4_decompress(const char* data, size_t size, char* out, size_t capacity);
+
+/**
+ * Appends some bytes as a block, compressed if that makes them smaller.
+ *
+ * @param out string where the block is appended
+ * @param data bytes to be appended
+ * @param size number of bytes
+ */
+void compress_block(string& out, const char* data, size_t size);
+
+/**
+ * Appends the bytes of a block written by compress_block.
+ *
+ * @param data block
+ * @param size number of bytes available, which may go beyond the block
+ * @param out string where the bytes are appended
+ *
+ * @return size of the block, 0 if it is corrupted or cut short
+ */
+size_t decompress_block(const char* data, size_t size, string& out);
+
 
 #endif
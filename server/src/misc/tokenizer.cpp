@@ -0,0 +1,189 @@
+#include "tokenizer.h"
+
+#include <cctype>
+
+
+/**
+ * @brief Tokenizer class constructor.
+ *
+ * @param input request that is going to be split
+ */
+Tokenizer::Tokenizer(string_view input) {
+    this->_input = input;
+    this->_position = 0;
+    this->_valid = true;
+}
+
+
+/**
+ * @brief Marks the request as invalid.
+ *
+ * @return empty field
+ */
+string_view Tokenizer::fail() {
+    this->_valid = false;
+    this->_position = this->_input.size();
+    return {};
+}
+
+
+/**
+ * @brief Moves past a field and the space that separates it from the next one.
+ *
+ * @param end position right after the field
+ *
+ * @return false if the field is not followed by a space or by the end of the request
+ */
+bool Tokenizer::skip(size_t end) {
+
+    if (end == this->_input.size()) {
+        this->_position = end;
+        return true;
+    }
+
+    /* Fields are separated by a single space, so a trailing one is not allowed */
+    if (this->_input[end] != ' ' || end + 1 == this->_input.size()) return false;
+
+    this->_position = end + 1;
+    return true;
+
+}
+
+
+/**
+ * @brief Gets next field, up to the next space.
+ *
+ * @return field or empty if there are no more fields
+ */
+string_view Tokenizer::next() {
+
+    if (!this->hasNext()) return this->fail();
+
+    size_t end = this->_input.find(' ', this->_position);
+    if (end == string_view::npos) end = this->_input.size();
+
+    string_view field = this->_input.substr(this->_position, end - this->_position);
+    if (field.empty() || !this->skip(end)) return this->fail();
+
+    return field;
+
+}
+
+
+/**
+ * @brief Gets next field, which must be a number with a certain width.
+ *
+ * @param min minimum number of digits
+ * @param max maximum number of digits
+ *
+ * @return field or empty if it is not valid
+ */
+string_view Tokenizer::digits(size_t min, size_t max) {
+
+    string_view field = this->next();
+    if (field.size() < min || field.size() > max) return this->fail();
+
+    for (char c: field) if (!isdigit((unsigned char) c)) return this->fail();
+
+    return field;
+
+}
+
+
+/**
+ * @brief Gets next field, which must be a number with a certain width that does not go over a limit.
+ *
+ * @param min minimum number of digits
+ * @param max maximum number of digits
+ * @param limit highest value allowed
+ *
+ * @return field or empty if it is not valid
+ */
+string_view Tokenizer::number(size_t min, size_t max, long limit) {
+
+    string_view field = this->digits(min, max);
+    if (this->_valid && toNumber(field) > limit) return this->fail();
+
+    return field;
+
+}
+
+
+/**
+ * @brief Gets next field, which must be made of alphanumerical characters and, optionally, a few others.
+ *
+ * @param min minimum number of characters
+ * @param max maximum number of characters
+ * @param extra other characters that are allowed
+ *
+ * @return field or empty if it is not valid
+ */
+string_view Tokenizer::alphanumeric(size_t min, size_t max, string_view extra) {
+
+    string_view field = this->next();
+    if (field.size() < min || field.size() > max) return this->fail();
+
+    for (char c: field) {
+        if (!isalnum((unsigned char) c) && extra.find(c) == string_view::npos) return this->fail();
+    }
+
+    return field;
+
+}
+
+
+/**
+ * @brief Gets next field, which must be a text between double quotes.
+ *
+ * @param max maximum number of characters of the text
+ *
+ * @return text without its quotes or empty if it is not valid
+ */
+string_view Tokenizer::text(size_t max) {
+
+    if (!this->hasNext() || this->_input[this->_position] != '"') return this->fail();
+
+    /* Text may have spaces, so it goes up to the closing quote */
+    size_t end = this->_input.find('"', this->_position + 1);
+    if (end == string_view::npos) return this->fail();
+
+    string_view field = this->_input.substr(this->_position + 1, end - this->_position - 1);
+    if (field.size() > max || !this->skip(end + 1)) return this->fail();
+
+    return field;
+
+}
+
+
+/**
+ * @brief Checks if there are fields left.
+ *
+ * @return true if the request has more fields
+ */
+bool Tokenizer::hasNext() const {
+    return this->_position < this->_input.size();
+}
+
+
+/**
+ * @brief Checks if the whole request was read and every field was valid.
+ *
+ * @return true if the request is valid
+ */
+bool Tokenizer::done() const {
+    return this->_valid && !this->hasNext();
+}
+
+
+/**
+ * @brief Converts a field made of digits into a number.
+ *
+ * @param field field that was returned by digits
+ *
+ * @return number
+ */
+long Tokenizer::toNumber(string_view field) {
+    long number = 0;
+    for (char c: field) number = number * 10 + (c - '0');
+    return number;
+}
@@ -0,0 +1,135 @@
+#ifndef PROJETO_RC_39_V2_TOKENIZER_H
+#define PROJETO_RC_39_V2_TOKENIZER_H
+
+#include <string_view>
+
+
+using namespace std;
+
+
+/**
+ * Splits a request into its fields in a single pass, validating each one as it goes. Fields are views
+ * into the request, so nothing is copied or allocated. Once a field fails, every following field is
+ * empty and the request is marked as invalid.
+ */
+class Tokenizer {
+
+    private:
+
+        /**
+         * @brief Request that is being split.
+         */
+        string_view _input;
+
+        /**
+         * @brief Position where the next field starts.
+         */
+        size_t _position;
+
+        /**
+         * @brief Is false once some field was missing or malformed.
+         */
+        bool _valid;
+
+    private:
+
+        /**
+         * @brief Marks the request as invalid.
+         *
+         * @return empty field
+         */
+        string_view fail();
+
+        /**
+         * @brief Moves past a field and the space that separates it from the next one.
+         *
+         * @param end position right after the field
+         *
+         * @return false if the field is not followed by a space or by the end of the request
+         */
+        bool skip(size_t end);
+
+    public:
+
+        /**
+         * @brief Tokenizer class constructor.
+         *
+         * @param input request that is going to be split
+         */
+        explicit Tokenizer(string_view input);
+
+        /**
+         * @brief Gets next field, up to the next space.
+         *
+         * @return field or empty if there are no more fields
+         */
+        string_view next();
+
+        /**
+         * @brief Gets next field, which must be a number with a certain width.
+         *
+         * @param min minimum number of digits
+         * @param max maximum number of digits
+         *
+         * @return field or empty if it is not valid
+         */
+        string_view digits(size_t min, size_t max);
+
+        /**
+         * @brief Gets next field, which must be a number with a certain width that does not go over a limit.
+         *
+         * @param min minimum number of digits
+         * @param max maximum number of digits
+         * @param limit highest value allowed
+         *
+         * @return field or empty if it is not valid
+         */
+        string_view number(size_t min, size_t max, long limit);
+
+        /**
+         * @brief Gets next field, which must be made of alphanumerical characters and, optionally, a few others.
+         *
+         * @param min minimum number of characters
+         * @param max maximum number of characters
+         * @param extra other characters that are allowed
+         *
+         * @return field or empty if it is not valid
+         */
+        string_view alphanumeric(size_t min, size_t max, string_view extra = "");
+
+        /**
+         * @brief Gets next field, which must be a text between double quotes.
+         *
+         * @param max maximum number of characters of the text
+         *
+         * @return text without its quotes or empty if it is not valid
+         */
+        string_view text(size_t max);
+
+        /**
+         * @brief Checks if there are fields left.
+         *
+         * @return true if the request has more fields
+         */
+        bool hasNext() const;
+
+        /**
+         * @brief Checks if the whole request was read and every field was valid.
+         *
+         * @return true if the request is valid
+         */
+        bool done() const;
+
+        /**
+         * @brief Converts a field made of digits into a number.
+         *
+         * @param field field that was returned by digits
+         *
+         * @return number
+         */
+        static long toNumber(string_view field);
+
+};
+
+
+#endif //PROJETO_RC_39_V2_TOKENIZER_H
@@ -0,0 +1,253 @@
+#include "attachment.h"
+#include "../misc/helpers.h"
+
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+
+
+using namespace std;
+
+
+/**
+ * @brief AttachmentStore class constructor. Creates the directories of objects and links if they do not
+ * exist.
+ *
+ * @param directory directory where files are kept
+ * @param compress is true if new objects are compressed when that makes them smaller
+ */
+AttachmentStore::AttachmentStore(const string& directory, bool compress) {
+
+    this->_directory = directory;
+    this->_compress = compress;
+
+    for (const char* name: {ATTACHMENT_OBJECTS_DIRECTORY, ATTACHMENT_MESSAGES_DIRECTORY}) {
+        string path = directory + "/" + name;
+        assert_(mkdir(path.c_str(), 0755) == 0 || errno == EEXIST, "Could not create the files directory\n")
+    }
+
+}
+
+
+/**
+ * @brief Gets the path of the file posted with a message.
+ *
+ * @param gid group's id
+ * @param mid message's id
+ *
+ * @return path of the message's link
+ */
+string AttachmentStore::getPath(uint32_t gid, uint32_t mid) const {
+    return this->_directory + "/" + ATTACHMENT_MESSAGES_DIRECTORY + "/" + to_string(gid) + "-" + to_string(mid);
+}
+
+
+/**
+ * @brief Creates the file of a message, which is going to be received as it is. Anything left at that path
+ * by a message that was not kept is replaced.
+ *
+ * @param path path of the message's link
+ *
+ * @return file's descriptor, opened for reading and writing, or -1 if it could not be created
+ */
+int AttachmentStore::create(const string& path) const {
+
+    /* An old link may share its object with other messages, so it is removed rather than truncated */
+    unlink(path.c_str());
+    return open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+}
+
+
+/**
+ * @brief Keeps a file that was completely received, sharing its contents with every other message that
+ * has the same file. If they can't be shared, the file is kept as it was received.
+ *
+ * @param fd file's descriptor, which is closed
+ * @param path path of the message's link
+ *
+ * @return false if the file could not be kept, in which case it is removed
+ */
+bool AttachmentStore::keep(int fd, const string& path) const {
+
+    /* Received file stays as it is, unless it would be mistaken for a compressed one */
+    auto leave = [fd, &path](bool drop) {
+        close(fd);
+        if (drop) unlink(path.c_str());
+        return !drop;
+    };
+
+    /* File was just written, so it is hashed from the page cache */
+    Sha256 sha;
+    sha256_init(sha);
+    unique_ptr<char[]> buffer(new char[ATTACHMENT_READ_SIZE]);
+    bool mistaken = false;
+    off_t offset = 0;
+    ssize_t n;
+    for (; (n = pread(fd, buffer.get(), ATTACHMENT_READ_SIZE, offset)) > 0; offset += n) {
+        if (offset == 0) {
+            mistaken = n >= ATTACHMENT_MAGIC_SIZE && memcmp(buffer.get(), ATTACHMENT_MAGIC, ATTACHMENT_MAGIC_SIZE) == 0;
+        }
+        sha256_update(sha, buffer.get(), n);
+    }
+    if (n != 0) return leave(mistaken || offset == 0);
+    buffer.reset();
+
+    string object = this->_directory + "/" + ATTACHMENT_OBJECTS_DIRECTORY + "/" + sha256_hex(sha);
+    string swap = path + ".tmp";
+
+    /* Contents are new. Unless they are worth compressing, the received file becomes their object */
+    bool exists = access(object.c_str(), F_OK) == 0;
+    bool compressed = !exists && (this->_compress || mistaken) && this->compress(fd, swap, object, mistaken);
+    if (!exists && !compressed) {
+        if (mistaken) return leave(true);
+        /* Object that can't be made, such as when the disk is full, leaves the file unshared */
+        if (link(path.c_str(), object.c_str()) == 0 || errno != EEXIST) return leave(false);
+    }
+
+    /* Someone posted these contents before, or they were just compressed. Message's link is replaced by one to
+     * their object in one step, so anyone retrieving it sees either file, and what was received is dropped once
+     * it is closed */
+    unlink(swap.c_str());
+    if (link(object.c_str(), swap.c_str()) != 0 || rename(swap.c_str(), path.c_str()) != 0) {
+        unlink(swap.c_str());
+        return leave(mistaken);
+    }
+    return leave(false);
+
+}
+
+
+/**
+ * @brief Writes a compressed copy of a file as a new object.
+ *
+ * @param fd file's descriptor
+ * @param temporary path where the copy is written before it becomes the object
+ * @param object path of the object
+ * @param force is true if the copy is kept even if it is not smaller
+ *
+ * @return true if the object has the file's contents, false if they were not worth compressing or could
+ * not be written
+ */
+bool AttachmentStore::compress(int fd, const string& temporary, const string& object, bool force) const {
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) return false;
+    auto size = (uint64_t) st.st_size;
+    uint64_t limit = force ? UINT64_MAX : size - size / ATTACHMENT_MIN_SAVING;
+
+    int out = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out == -1) return false;
+
+    CompressedFile header{};
+    memcpy(header.magic, ATTACHMENT_MAGIC, ATTACHMENT_MAGIC_SIZE);
+    header.size = size;
+    string compressed((const char*) &header, sizeof header);
+    unique_ptr<char[]> block(new char[ATTACHMENT_BLOCK_SIZE]);
+    uint64_t written = 0;
+
+    /* Blocks are written a few at a time. Compressing stops as soon as it is clear it is not worth it */
+    bool failed = false;
+    for (uint64_t offset = 0; offset < size && written + compressed.size() <= limit; offset += ATTACHMENT_BLOCK_SIZE) {
+        auto length = (size_t) min((uint64_t) ATTACHMENT_BLOCK_SIZE, size - offset);
+        if ((failed = pread(fd, block.get(), length, (off_t) offset) != (ssize_t) length)) break;
+        compress_block(compressed, block.get(), length);
+        if (compressed.size() < ATTACHMENT_READ_SIZE && offset + length < size) continue;
+        if ((failed = write(out, compressed.data(), compressed.size()) != (ssize_t) compressed.size())) break;
+        written += compressed.size();
+        compressed.clear();
+    }
+    close(out);
+
+    /* Someone else may have stored the same contents in the meantime, which is just as good */
+    bool stored = !failed && written + compressed.size() <= limit &&
+                  (link(temporary.c_str(), object.c_str()) == 0 || errno == EEXIST);
+    unlink(temporary.c_str());
+    return stored;
+
+}
+
+
+/**
+ * @brief Checks if a stored file is kept compressed.
+ *
+ * @param fd file's descriptor
+ *
+ * @return true if it is compressed, in which case its blocks start right after a CompressedFile
+ */
+bool AttachmentStore::isCompressed(int fd) {
+    CompressedFile header{};
+    return pread(fd, &header, sizeof header, 0) == sizeof header &&
+           memcmp(header.magic, ATTACHMENT_MAGIC, ATTACHMENT_MAGIC_SIZE) == 0;
+}
+
+
+/**
+ * @brief Reads and decompresses a block of a compressed file.
+ *
+ * @param fd file's descriptor
+ * @param offset where the block starts, which is moved to where the next one does
+ * @param out string where the decompressed bytes are appended
+ *
+ * @return false if the block could not be read or is corrupted
+ */
+bool AttachmentStore::readBlock(int fd, off_t& offset, string& out) {
+
+    /* Block is never bigger than what it holds, so it is read with its header in one go */
+    string block(sizeof(CompressedBlock) + ATTACHMENT_BLOCK_SIZE, '\0');
+    ssize_t n = pread(fd, &block[0], block.size(), offset);
+    if (n <= 0) return false;
+
+    size_t used = decompress_block(block.data(), n, out);
+    offset += (off_t) used;
+    return used != 0;
+
+}
+
+
+/**
+ * @brief Removes the objects that no message refers to anymore.
+ *
+ * @return number of objects removed
+ */
+size_t AttachmentStore::collect() const {
+
+    string objects = this->_directory + "/" + ATTACHMENT_OBJECTS_DIRECTORY;
+    DIR* dp = opendir(objects.c_str());
+    assert_(dp, "Failed to open the files directory\n")
+
+    /* Object's own name is its only link left */
+    size_t removed = 0;
+    struct dirent* entry;
+    struct stat st{};
+    while ((entry = readdir(dp))) {
+        if (entry->d_name[0] == '.') continue;
+        if (fstatat(dirfd(dp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_nlink == 1 &&
+            unlinkat(dirfd(dp), entry->d_name, 0) == 0) removed++;
+    }
+
+    closedir(dp);
+    return removed;
+
+}
+
+
+/**
+ * @brief Removes every file, objects and links included.
+ */
+void AttachmentStore::clear() const {
+
+    /* Children come before their directory, and the files directory itself is kept */
+    auto remove_entry = [](const char* path, const struct stat*, int, struct FTW* ftw) -> int {
+        if (ftw->level == 0) return 0;
+        assert_(remove(path) == 0, "Failed to delete file\n")
+        return 0;
+    };
+    nftw(this->_directory.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+}
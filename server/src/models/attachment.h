@@ -0,0 +1,150 @@
+#ifndef PROJETO_RC_39_V2_ATTACHMENT_H
+#define PROJETO_RC_39_V2_ATTACHMENT_H
+
+#include <string>
+#include <cstdint>
+#include <sys/types.h>
+
+#define ATTACHMENT_OBJECTS_DIRECTORY "objects"
+#define ATTACHMENT_MESSAGES_DIRECTORY "messages"
+#define ATTACHMENT_READ_SIZE (1 << 20)
+#define ATTACHMENT_MAGIC "RC39LZ4\n"
+#define ATTACHMENT_MAGIC_SIZE 8
+#define ATTACHMENT_BLOCK_SIZE (1 << 16)
+#define ATTACHMENT_MIN_SAVING 8
+
+
+using namespace std;
+
+
+/**
+ * @brief Start of a file that is kept compressed. It is followed by blocks written by compress_block, each of them
+ * holding ATTACHMENT_BLOCK_SIZE bytes of the file but the last one.
+ */
+struct CompressedFile {
+    char magic[ATTACHMENT_MAGIC_SIZE];  /* Is ATTACHMENT_MAGIC */
+    uint64_t size;                      /* Size of the file once decompressed */
+};
+
+
+/**
+ * @brief Files posted with messages, kept once per distinct contents. Every distinct file is an object named
+ * after the SHA-256 of its bytes, and every message with a file is a hard link to its object, named after the
+ * group and the message. So an object's link count is the number of messages that refer to it plus one, and
+ * files posted with the same name to different groups no longer collide. The name the file was posted with
+ * is part of the message.
+ *
+ * A file is received straight into its message's link. Once it is complete, it becomes the object if its
+ * contents are new, or its link is replaced by one to the object that already has them, which drops the copy
+ * that was just received before it is ever written back to disk.
+ *
+ * Store may compress new objects, which are only kept compressed if that saves at least 1/ATTACHMENT_MIN_SAVING
+ * of their size, so images and videos go on being sent straight from the page cache. Compressed files start with
+ * ATTACHMENT_MAGIC and are decompressed a block at a time as they are sent. Files that were received starting
+ * with it are always compressed, so they are never mistaken for one.
+ */
+class AttachmentStore {
+
+    private:
+
+        /**
+         * @brief Directory where files are kept.
+         */
+        string _directory;
+
+        /**
+         * @brief Is true if new objects are compressed when that makes them smaller.
+         */
+        bool _compress;
+
+        /**
+         * @brief Writes a compressed copy of a file as a new object.
+         *
+         * @param fd file's descriptor
+         * @param temporary path where the copy is written before it becomes the object
+         * @param object path of the object
+         * @param force is true if the copy is kept even if it is not smaller
+         *
+         * @return true if the object has the file's contents, false if they were not worth compressing or could
+         * not be written
+         */
+        bool compress(int fd, const string& temporary, const string& object, bool force) const;
+
+    public:
+
+        /**
+         * @brief AttachmentStore class constructor. Creates the directories of objects and links if they do not
+         * exist.
+         *
+         * @param directory directory where files are kept
+         * @param compress is true if new objects are compressed when that makes them smaller
+         */
+        explicit AttachmentStore(const string& directory, bool compress);
+
+        /**
+         * @brief Gets the path of the file posted with a message.
+         *
+         * @param gid group's id
+         * @param mid message's id
+         *
+         * @return path of the message's link
+         */
+        string getPath(uint32_t gid, uint32_t mid) const;
+
+        /**
+         * @brief Creates the file of a message, which is going to be received as it is. Anything left at that path
+         * by a message that was not kept is replaced.
+         *
+         * @param path path of the message's link
+         *
+         * @return file's descriptor, opened for reading and writing, or -1 if it could not be created
+         */
+        int create(const string& path) const;
+
+        /**
+         * @brief Keeps a file that was completely received, sharing its contents with every other message that
+         * has the same file. If they can't be shared, the file is kept as it was received.
+         *
+         * @param fd file's descriptor, which is closed
+         * @param path path of the message's link
+         *
+         * @return false if the file could not be kept, in which case it is removed
+         */
+        bool keep(int fd, const string& path) const;
+
+        /**
+         * @brief Checks if a stored file is kept compressed.
+         *
+         * @param fd file's descriptor
+         *
+         * @return true if it is compressed, in which case its blocks start right after a CompressedFile
+         */
+        static bool isCompressed(int fd);
+
+        /**
+         * @brief Reads and decompresses a block of a compressed file.
+         *
+         * @param fd file's descriptor
+         * @param offset where the block starts, which is moved to where the next one does
+         * @param out string where the decompressed bytes are appended
+         *
+         * @return false if the block could not be read or is corrupted
+         */
+        static bool readBlock(int fd, off_t& offset, string& out);
+
+        /**
+         * @brief Removes the objects that no message refers to anymore.
+         *
+         * @return number of objects removed
+         */
+        size_t collect() const;
+
+        /**
+         * @brief Removes every file, objects and links included.
+         */
+        void clear() const;
+
+};
+
+
+#endif //PROJETO_RC_39_V2_ATTACHMENT_H
@@ -1,5 +1,8 @@
 #include "connect.h"
 
+#include <fcntl.h>
+#include <cerrno>
+
 
 /**
  * Setups our udp socket.
@@ -10,9 +13,13 @@ void Connect::init_socket_udp() {
     int errcode;  /* Holds current error */
 
     /* Creates udp subgroup for internet */
-    this->_fd_udp = socket(AF_INET, SOCK_DGRAM, 0);
+    this->_fd_udp = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
     assert_(this->getSocketUDP() != -1, "Could not create udp socket")
 
+    /* Lets the kernel spread clients among every socket bound to this port */
+    int enable = 1;
+    if (this->_reuse_port) setsockopt(this->getSocketUDP(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof enable);
+
     /* Inits UDP server's struct to access the DNS */
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_INET;
@@ -26,6 +33,10 @@ void Connect::init_socket_udp() {
     /* Binds sockets to our specified port and tells our SO that this channel if for this program */
     int err = bind(this->getSocketUDP(), this->_res->ai_addr, this->_res->ai_addrlen);
     assert_(err == 0, "Failed to bind udp socket")
+    freeaddrinfo(this->_res);
+
+    /* Event loop must never block on a socket */
+    Connect::setNonBlocking(this->getSocketUDP());
 
 }
 
@@ -39,9 +50,16 @@ void Connect::init_socket_tcp() {
     struct addrinfo hints{};  /* Used to request info from DNS to get our "endpoint" */
 
     /* Creates tcp subgroup for internet */
-    this->_fd_tcp = socket(AF_INET, SOCK_STREAM, 0);
+    this->_fd_tcp = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     assert_(this->getSocketTCP() != -1, "Could not create tcp socket")
 
+    /* Allows restarting the server right away, while old connections are still in TIME_WAIT */
+    int enable = 1;
+    setsockopt(this->getSocketTCP(), SOL_SOCKET, SO_REUSEADDR, &enable, sizeof enable);
+
+    /* Lets the kernel spread clients among every socket bound to this port */
+    if (this->_reuse_port) setsockopt(this->getSocketTCP(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof enable);
+
     /* Inits TCP server's struct to access the DNS */
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_INET;
@@ -58,6 +76,41 @@ void Connect::init_socket_tcp() {
 
     /* Prepares socket to receive connections */
     assert_(listen(this->getSocketTCP(),TCP_N_CONNECTIONS) != -1, "Could not prepare tcp socket")
+    freeaddrinfo(this->_res);
+
+    /* Event loop must never block on a socket */
+    Connect::setNonBlocking(this->getSocketTCP());
+
+}
+
+
+/**
+ * @brief Setups epoll instance and starts watching our udp and tcp sockets.
+ */
+void Connect::init_epoll() {
+
+    this->_fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    assert_(this->_fd_epoll != -1, "Could not create epoll instance")
+
+    this->watch(this->getSocketUDP(), EPOLLIN | EPOLLET);
+    this->watch(this->getSocketTCP(), EPOLLIN | EPOLLET);
+
+}
+
+
+/**
+ * @brief Starts watching a socket for incoming data in edge-triggered mode.
+ *
+ * @param fd socket to be watched
+ * @param events epoll events we are interested in
+ */
+void Connect::watch(int fd, uint32_t events) {
+
+    struct epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+
+    assert_(epoll_ctl(this->_fd_epoll, EPOLL_CTL_ADD, fd, &event) != -1, "Could not watch socket")
 
 }
 
@@ -66,11 +119,16 @@ void Connect::init_socket_tcp() {
  * @brief Connect class constructor.
  *
  * @param port port of the server
+ * @param reuse_port allows several Connects to listen on the same port, each one getting a share of
+ * the clients
  */
-Connect::Connect(const string& port) {
+Connect::Connect(const string& port, bool reuse_port) {
     this->_port = port;
+    this->_reuse_port = reuse_port;
+    this->_request_limit = MAX_REQUEST_SIZE;
     this->init_socket_udp();
     this->init_socket_tcp();
+    this->init_epoll();
 }
 
 
@@ -105,22 +163,132 @@ int Connect::getSocketTCP() const {
 
 
 /**
- * @brief Gets a temporary socket used to communicate with the connected client.
+ * @brief Puts a socket in non-blocking mode.
+ *
+ * @param fd socket
+ */
+void Connect::setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    assert_(flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1, "Could not set socket as non-blocking")
+}
+
+
+/**
+ * @brief Blocks until some of the watched sockets are ready.
  *
- * @return temporary tcp socket
+ * @param events array that will hold the ready sockets
+ * @param max_events size of events
+ *
+ * @return number of ready sockets
+ */
+int Connect::waitEvents(struct epoll_event* events, int max_events) {
+
+    int n = epoll_wait(this->_fd_epoll, events, max_events, -1);
+    if (n == -1 && errno == EINTR) return 0;  /* Interrupted by a signal, caller just waits again */
+    assert_(n != -1, "Epoll threw an error")
+
+    return n;
+
+}
+
+
+/**
+ * @brief Starts watching the event that tells the server to stop, which stays ready once it is set.
+ *
+ * @param fd event's descriptor
  */
-int Connect::getSocketTmpTCP() {
-    return this->_tmp_fd_tcp;
+void Connect::watchStop(int fd) {
+    this->watch(fd, EPOLLIN);
 }
 
 
 /**
- * @brief Gets set of file descriptors that are being watched.
+ * @brief Accepts a pending tcp connection and starts watching it.
  *
- * @return set of file descriptors
+ * @return new connection or nullptr if there are no more pending connections
  */
-fd_set* Connect::getFDS() {
-    return &this->_fds;
+Session* Connect::acceptByTCP() {
+
+    this->cleanAddr();
+
+    /* Creates a new socket to talk with the client. Keeps main channel active */
+    int fd = accept4(this->getSocketTCP(), (struct sockaddr*) this->getAddr(), this->getAddrLen(),
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) return nullptr;
+
+    Session* session = this->addSession(fd, *this->getAddr());
+    this->watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+
+    return session;
+
+}
+
+
+/**
+ * @brief Starts tracking a tcp connection that was already accepted.
+ *
+ * @param fd connection's socket
+ * @param addr client's address
+ *
+ * @return new connection
+ */
+Session* Connect::addSession(int fd, const struct sockaddr_in& addr) {
+
+    Session session(fd, inet_ntoa(addr.sin_addr), to_string(ntohs(addr.sin_port)), this->_request_limit);
+    auto itr = this->_sessions.insert(make_pair(fd, session)).first;
+
+    return &itr->second;
+
+}
+
+
+/**
+ * @brief Gets an open tcp connection.
+ *
+ * @param fd connection's socket
+ *
+ * @return connection or nullptr if it does not exist
+ */
+Session* Connect::getSession(int fd) {
+    auto itr = this->_sessions.find(fd);
+    return itr == this->_sessions.end() ? nullptr : &itr->second;
+}
+
+
+/**
+ * @brief Gets tcp connection whose request is currently being processed.
+ *
+ * @return current connection
+ */
+Session* Connect::getCurrentSession() {
+    return this->_session;
+}
+
+
+/**
+ * @brief Sets tcp connection whose request is currently being processed.
+ *
+ * @param session current connection
+ */
+void Connect::setCurrentSession(Session* session) {
+    this->_session = session;
+}
+
+
+/**
+ * @brief Closes a tcp connection and stops watching it.
+ *
+ * @param session connection to be closed
+ */
+void Connect::closeSession(Session* session) {
+
+    int fd = session->getSocket();
+    if (this->_session == session) this->_session = nullptr;
+
+    /* Closing the socket also removes it from epoll */
+    session->clean();
+    this->_sessions.erase(fd);
+
 }
 
 
@@ -164,6 +332,16 @@ void Connect::setClientPort(const string& port) {
 }
 
 
+/**
+ * @brief Sets the longest line a tcp client may send without its \n before it is turned away.
+ *
+ * @param limit length of the longest request
+ */
+void Connect::setRequestLimit(size_t limit) {
+    this->_request_limit = limit;
+}
+
+
 /**
  * @brief Gets client's address length.
  *
@@ -204,74 +382,85 @@ void Connect::cleanAddr() {
 
 
 /**
- * @brief Receives a valid command by a client in UDP socket.
+ * @brief Receives a batch of commands sent by clients to the UDP socket, with a single system call.
  *
- * @return client's request
+ * @param requests will hold clients' requests, which point into the batch buffers until the next call
+ *
+ * @return number of requests received, 0 if there are no more requests waiting
  */
-string Connect::receiveByUDP() {
-
-    char buffer[MAX_REQUEST_SIZE]{'\0'};
+int Connect::receiveByUDP(vector<string_view>& requests) {
+
+    /* Points each header to its own buffer and sender */
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        this->_udp_iovs[i] = {this->_udp_buffers[i], MAX_REQUEST_SIZE};
+        memset(&this->_udp_msgs[i], 0, sizeof this->_udp_msgs[i]);
+        this->_udp_msgs[i].msg_hdr.msg_name = &this->_udp_addrs[i];
+        this->_udp_msgs[i].msg_hdr.msg_namelen = sizeof this->_udp_addrs[i];
+        this->_udp_msgs[i].msg_hdr.msg_iov = &this->_udp_iovs[i];
+        this->_udp_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    /* Receives message from client */
-    ssize_t n = recvfrom(this->getSocketUDP(), buffer, MAX_REQUEST_SIZE, 0,
-                         (struct sockaddr *) this->getAddr(), this->getAddrLen());
+    /* Receives every message waiting, up to a whole batch. An error a past response left on the socket is only
+     * reported once, so the messages behind it are received right after */
+    int n;
+    do {
+        n = recvmmsg(this->getSocketUDP(), this->_udp_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    } while (n == -1 && (errno == EINTR || errno == ECONNREFUSED));
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
     assert_(n != -1, "Failed to receive message")
 
-    /* Saves currently connected client */
-    setClientIP(inet_ntoa((*this->getAddr()).sin_addr));
-    setClientPort(to_string(ntohs((*this->getAddr()).sin_port)));
+    requests.resize(n);
+    for (int i = 0; i < n; i++) {
+
+        /* Removes \n at the end of the buffer. Makes things easier down the line */
+        char* buffer = this->_udp_buffers[i];
+        buffer[this->_udp_msgs[i].msg_len] = '\0';
+        size_t length = strlen(buffer);
+        if (length > 0 && buffer[length - 1] == '\n') length--;
 
-    /* Removes \n at the end of the buffer. Makes things easier down the line */
-    buffer[strlen(buffer) - 1] = '\0';
+        requests[i] = string_view(buffer, length);
+
+    }
 
-    return buffer;
+    return n;
 
 }
 
 
 /**
- * @brief Send a response to a client in UDP socket.
+ * @brief Sets current client to the sender of a request of the last UDP batch.
  *
- * @param response response that is going to be sent back to the client.
+ * @param index position of the request in the batch
  */
-void Connect::replyByUDP(const string& response) {
-
-    /* Sends response back to client */
-    ssize_t n = sendto(this->getSocketUDP(), response.c_str(), response.size(), 0,
-                       (struct sockaddr*) this->getAddr(), *this->getAddrLen());
-    assert_(n != -1, "Failed to send message")
-
+void Connect::setClientUDP(int index) {
+    this->setClientIP(inet_ntoa(this->_udp_addrs[index].sin_addr));
+    this->setClientPort(to_string(ntohs(this->_udp_addrs[index].sin_port)));
 }
 
 
 /**
- * @brief Receives a valid command by a client in TCP socket.
+ * @brief Sends responses to every request of the last UDP batch, with a single system call.
  *
- * @return client's request
+ * @param responses responses in the same order as the requests
  */
-string Connect::receiveByTCP() {
-
-    char buffer[MAX_REQUEST_SIZE];  // Temporary buffer to receive all the information
-    string request;
-    memset(buffer, 0, MAX_REQUEST_SIZE);
+void Connect::replyByUDP(const vector<string>& responses) {
 
-    /* Creates temporary socket to connect to client. Keeps main channel active */
-    this->_tmp_fd_tcp = accept(this->getSocketTCP(),(struct sockaddr*) this->getAddr(), this->getAddrLen());
-    assert_(this->_tmp_fd_tcp != -1, "Could not create temporary tcp socket")
+    int n = (int) responses.size();
 
-    /* Keeps on reading until everything has been read from the client */
-    char* ptr=&buffer[0];
-    do {
-        ssize_t nr = read(this->_tmp_fd_tcp, ptr, MAX_REQUEST_SIZE);
-        assert_(nr != -1, "Failed to read from temporary socket")
-        if (nr == 0) return "CONNECTION CLOSED";  /* If a client closes a socket, we need to ignore */
-        request.append(buffer, strlen(buffer));
-        ptr += nr;
-    } while (buffer[strlen(buffer) - 1] != '\n');
+    /* Reuses the headers of the batch, so each response goes back to its sender */
+    for (int i = 0; i < n; i++) {
+        this->_udp_iovs[i] = {(void*) responses[i].data(), responses[i].size()};
+        this->_udp_msgs[i].msg_hdr.msg_namelen = sizeof this->_udp_addrs[i];
+    }
 
-    /* Removes \n at the end of the buffer. Makes things easier down the line */
-    request[request.length() - 1] = '\0';
-    return request;
+    /* Kernel may not take the whole batch at once. If its buffer is full, the rest is dropped like any
+     * other lost datagram and clients ask again. A response that cannot reach its client is dropped alone */
+    for (int sent = 0; sent < n; ) {
+        int m = sendmmsg(this->getSocketUDP(), this->_udp_msgs + sent, n - sent, 0);
+        if (m == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (m == -1 && errno == EINTR) continue;
+        sent += m == -1 ? 1 : m;
+    }
 
 }
 
@@ -283,85 +472,36 @@ string Connect::receiveByTCP() {
  */
 void Connect::replyByTCP(const string& response) {
 
-    /* We are going to send until we send everything */
-    int remaining = (int) response.length();
-    int sent;
-
-    /* We use a buffer to avoid a non-null terminated string */
-    char buffer[MAX_REQUEST_SIZE];
-    memset(buffer, 0, MAX_REQUEST_SIZE);
-    memcpy(buffer, response.c_str(), response.length());
-
-    /* Keeps sending messages to client until everything is sent */
-    char* ptr = &buffer[0];
-    while (remaining > 0) {
-        assert_((sent = write(this->getSocketTmpTCP(), ptr, MAX_REQUEST_SIZE)) > 0, "Could not send message to client")
-        remaining -= sent; ptr += sent;
-    }
+    /* Response is sent as is, as soon as the client's socket is able to take it */
+    this->getCurrentSession()->queue(response);
 
 }
 
 
 /**
- * @brief Send a response with a file to a client in TCP socket.
+ * @brief Send a response with a file to a client in TCP socket. File data follows the response as is.
  *
- * @param file file that is being sent
+ * @param file_path path of the file that is being sent
  * @param file_length size of the file
+ *
+ * @return false if the file could not be opened, which leaves the response unfinished
  */
-void Connect::replyByTCPWithFile(ifstream& file, int file_length) {
-
-    char file_data[MAX_REQUEST_SIZE];  /* Temporary buffer to hold file information */
-    int bytes_sent;  /* Tells us how many bytes have been read from each iteration */
-
-    /* Sends file data to server bit by but */
-    while (file_length > 0) {
-        file.read(file_data, MAX_REQUEST_SIZE);
-        assert_((bytes_sent = write(this->getSocketTCP(), file_data, MAX_REQUEST_SIZE)) > 0, "Could not send data message to server")
-        file_length -= bytes_sent;
-        memset(file_data, 0, MAX_REQUEST_SIZE);
-    }
-
+bool Connect::replyByTCPWithFile(const string& file_path, long file_length) {
+    return this->getCurrentSession()->queueFile(file_path, file_length);
 }
 
 
 /**
  * @brief Receives a valid command by a client in TCP socket with a file.
  *
- * @param file_name name of the file
+ * @param store where the file is kept, nullptr if its data is read and dropped
+ * @param file_path path where the file is going to be stored
  * @param file_size size of the file
  */
-void Connect::receiveByTCPWithFile(const string& file_name, int file_size) {
-
-    char buffer[MAX_REQUEST_SIZE];  /* Auxiliary buffer */
-    memset(buffer, 0, MAX_REQUEST_SIZE);
-    ssize_t received;
-    long remaining = 0;
-
-    /* Gets the file path */
-    string new_file_path = string(get_current_dir_name()) + "/server/files/" + file_name ;
-
-    /* Creates a new file */
-    ofstream file(string(new_file_path), ofstream::out | ofstream::binary);
-
-    /* Keeps reading the file data*/
-    while (remaining < file_size) {  /* Does this until we got the whole file */
+void Connect::receiveByTCPWithFile(AttachmentStore* store, const string& file_path, long file_size) {
 
-        /* Reads from socket and puts in buffer */
-        received = read(this->getSocketTmpTCP(), buffer, MAX_REQUEST_SIZE);
-        assert_(received != -1, "Failed to read from temporary socket")
-
-        /* Writes from buffer to file */
-        file.write(buffer, strlen(buffer));
-
-        /* Cleans buffer for next iteration */
-        memset(buffer, 0, MAX_REQUEST_SIZE);
-
-        if (received == 0) break;  /* If a client closes a socket, we need to ignore */
-        remaining += received;
-
-    }
-
-    file.close();
+    /* File is going to be written as its data arrives */
+    this->getCurrentSession()->expectFile(store, file_path, file_size);
 
 }
 
@@ -370,7 +510,9 @@ void Connect::receiveByTCPWithFile(const string& file_name, int file_size) {
  * @brief Cleans and frees everything related to the Connection.
  */
 void Connect::clean() {
-    freeaddrinfo(this->_res);
+    for (auto& itr: this->_sessions) itr.second.clean();
+    this->_sessions.clear();
+    close(this->_fd_epoll);
     close(this->getSocketTCP());
     close(this->getSocketUDP());
 }
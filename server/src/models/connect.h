@@ -2,6 +2,7 @@
 #define PROJETO_RC_39_V2_CONNECT_H
 
 #include "../misc/helpers.h"
+#include "session.h"
 
 #include <iostream>
 #include <cstdio>
@@ -13,11 +14,23 @@
 #include <cstring>
 #include <unistd.h>
 #include <fstream>
+#include <unordered_map>
+#include <vector>
+#include <string_view>
+#include <sys/epoll.h>
 
 #define MAX_REQUEST_SIZE 300
-#define TEXT_MAX_SIZE 240
 #define FILENAME_MAX_SIZE 24
-#define TCP_N_CONNECTIONS 5
+#define UID_SIZE 5
+#define GID_SIZE 2
+#define MID_SIZE 4
+#define TEXT_SIZE_SIZE 3
+#define EXT_ID_SIZE 10
+#define EXT_TEXT_SIZE_SIZE 5
+#define FILE_SIZE_MAX_DIGITS 10
+#define TCP_N_CONNECTIONS 128
+#define EPOLL_MAX_EVENTS 64
+#define UDP_BATCH_SIZE 32
 
 
 using namespace std;
@@ -35,11 +48,6 @@ class Connect {
          */
         int _fd_tcp{};
 
-        /**
-         * @brief Holds temporary tcp file descriptor that is going to be used by a client.
-         */
-        int _tmp_fd_tcp{};
-
         /**
          * @brief File descriptor for a udp connection.
          */
@@ -50,6 +58,11 @@ class Connect {
          */
         string _port;
 
+        /**
+         * @brief Is true if other Connects in this process are going to bind the same port.
+         */
+        bool _reuse_port;
+
         /**
          * @brief Stores result from getaddrinfo and uses it to set up our socket.
          */
@@ -66,9 +79,28 @@ class Connect {
         struct sockaddr_in _addr;
 
         /**
-         * @brief Holds file descriptors in select.
+         * @brief Datagrams of the last udp batch. Each one has its sender, its data and the headers given
+         * to recvmmsg and sendmmsg.
+         */
+        char _udp_buffers[UDP_BATCH_SIZE][MAX_REQUEST_SIZE + 1];
+        struct sockaddr_in _udp_addrs[UDP_BATCH_SIZE];
+        struct iovec _udp_iovs[UDP_BATCH_SIZE];
+        struct mmsghdr _udp_msgs[UDP_BATCH_SIZE];
+
+        /**
+         * @brief Epoll instance that watches every socket of the server.
+         */
+        int _fd_epoll{};
+
+        /**
+         * @brief Currently open tcp connections. Key is the connection's socket.
          */
-        fd_set _fds;
+        unordered_map<int, Session> _sessions;
+
+        /**
+         * @brief Tcp connection whose request is currently being processed.
+         */
+        Session* _session{};
 
         /**
          * @brief Saves currently connect client's ip.
@@ -80,6 +112,11 @@ class Connect {
          */
         string _client_port;
 
+        /**
+         * @brief Longest line a tcp client may send without its \n before it is turned away.
+         */
+        size_t _request_limit;
+
     private:
 
         /**
@@ -92,6 +129,19 @@ class Connect {
          */
         void init_socket_tcp();
 
+        /**
+         * @brief Setups epoll instance and starts watching our udp and tcp sockets.
+         */
+        void init_epoll();
+
+        /**
+         * @brief Starts watching a socket for incoming data in edge-triggered mode.
+         *
+         * @param fd socket to be watched
+         * @param events epoll events we are interested in
+         */
+        void watch(int fd, uint32_t events);
+
         /**
          * @brief Gets client's address length.
          *
@@ -119,8 +169,10 @@ class Connect {
          * @brief Connect class constructor.
          *
          * @param port port of the server
+         * @param reuse_port allows several Connects to listen on the same port, each one getting a share of
+         * the clients
          */
-        explicit Connect(const string& port);
+        explicit Connect(const string& port, bool reuse_port = false);
 
         /**
          * @brief Gets server's port.
@@ -144,18 +196,75 @@ class Connect {
         int getSocketTCP() const;
 
         /**
-         * @brief Gets a temporary socket used to communicate with the connected client.
+         * @brief Puts a socket in non-blocking mode.
+         *
+         * @param fd socket
+         */
+        static void setNonBlocking(int fd);
+
+        /**
+         * @brief Blocks until some of the watched sockets are ready.
+         *
+         * @param events array that will hold the ready sockets
+         * @param max_events size of events
          *
-         * @return temporary tcp socket
+         * @return number of ready sockets
          */
-        int getSocketTmpTCP();
+        int waitEvents(struct epoll_event* events, int max_events);
 
         /**
-         * @brief Gets set of file descriptors that are being watched.
+         * @brief Starts watching the event that tells the server to stop, which stays ready once it is set.
          *
-         * @return set of file descriptors
+         * @param fd event's descriptor
          */
-        fd_set* getFDS();
+        void watchStop(int fd);
+
+        /**
+         * @brief Accepts a pending tcp connection and starts watching it.
+         *
+         * @return new connection or nullptr if there are no more pending connections
+         */
+        Session* acceptByTCP();
+
+        /**
+         * @brief Starts tracking a tcp connection that was already accepted.
+         *
+         * @param fd connection's socket
+         * @param addr client's address
+         *
+         * @return new connection
+         */
+        Session* addSession(int fd, const struct sockaddr_in& addr);
+
+        /**
+         * @brief Gets an open tcp connection.
+         *
+         * @param fd connection's socket
+         *
+         * @return connection or nullptr if it does not exist
+         */
+        Session* getSession(int fd);
+
+        /**
+         * @brief Gets tcp connection whose request is currently being processed.
+         *
+         * @return current connection
+         */
+        Session* getCurrentSession();
+
+        /**
+         * @brief Sets tcp connection whose request is currently being processed.
+         *
+         * @param session current connection
+         */
+        void setCurrentSession(Session* session);
+
+        /**
+         * @brief Closes a tcp connection and stops watching it.
+         *
+         * @param session connection to be closed
+         */
+        void closeSession(Session* session);
 
         /**
          * @brief Gets currently connected client's ip.
@@ -185,31 +294,40 @@ class Connect {
          */
         void setClientPort(const string& port);
 
+        /**
+         * @brief Sets the longest line a tcp client may send without its \n before it is turned away.
+         *
+         * @param limit length of the longest request
+         */
+        void setRequestLimit(size_t limit);
+
         /**
          * @brief Cleans previous information in addr and addrlen.
          */
         void cleanAddr();
 
         /**
-         * @brief Receives a valid command by a client in UDP socket.
+         * @brief Receives a batch of commands sent by clients to the UDP socket, with a single system call.
          *
-         * @return client's request
+         * @param requests will hold clients' requests, which point into the batch buffers until the next call
+         *
+         * @return number of requests received, 0 if there are no more requests waiting
          */
-        string receiveByUDP();
+        int receiveByUDP(vector<string_view>& requests);
 
         /**
-         * @brief Send a response to a client in UDP socket.
+         * @brief Sets current client to the sender of a request of the last UDP batch.
          *
-         * @param response response that is going to be sent back to the client.
+         * @param index position of the request in the batch
          */
-        void replyByUDP(const string& response);
+        void setClientUDP(int index);
 
         /**
-         * @brief Receives a valid command by a client in TCP socket.
+         * @brief Sends responses to every request of the last UDP batch, with a single system call.
          *
-         * @return client's request
+         * @param responses responses in the same order as the requests
          */
-        string receiveByTCP();
+        void replyByUDP(const vector<string>& responses);
 
         /**
          * @brief Send a response to a client in TCP socket.
@@ -219,20 +337,23 @@ class Connect {
         void replyByTCP(const string& response);
 
         /**
-         * @brief Send a response with a file to a client in TCP socket.
+         * @brief Send a response with a file to a client in TCP socket. File data follows the response as is.
          *
-         * @param file file that is being sent
+         * @param file_path path of the file that is being sent
          * @param file_length size of the file
+         *
+         * @return false if the file could not be opened, which leaves the response unfinished
          */
-        void replyByTCPWithFile(ifstream& file, int file_length);
+        bool replyByTCPWithFile(const string& file_path, long file_length);
 
         /**
          * @brief Receives a valid command by a client in TCP socket with a file.
          *
-         * @param file_name name of the file
+         * @param store where the file is kept, nullptr if its data is read and dropped
+         * @param file_path path where the file is going to be stored
          * @param file_size size of the file
          */
-        void receiveByTCPWithFile(const string& file_name, int file_size);
+        void receiveByTCPWithFile(AttachmentStore* store, const string& file_path, long file_size);
 
         /**
          * @brief Cleans and frees everything related to the Connection.
@@ -1,26 +1,52 @@
 #include "group.h"
+#include "../misc/helpers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+#include <cerrno>
 
 using namespace std;
 
 
 /**
- * @brief Group constructor.
+ * @brief Group constructor. Creates an empty slot
+ */
+Group::Group() {
+    _id = 0;
+}
+
+
+/**
+ * @brief Fills this slot with a newly created group
  *
- * @param name
- * @param user
+ * @param id group's identifier
+ * @param name group's name
  */
-Group::Group(const string& id, const string& name) {
+void Group::createGroup(uint32_t id, string_view name) {
     _id = id;
     _name = name;
 }
 
 
+/**
+ * @brief Keeps the group's messages in a log from now on
+ *
+ * @param directory directory of the log's segments
+ * @param position where the log ends, all zeros if it has no messages
+ * @param compress is true if sealed segments of the log are compressed
+ */
+void Group::openLog(const string& directory, const LogPosition& position, bool compress) {
+    _log = make_unique<MessageLog>(directory, position, compress);
+}
+
+
 /**
  * @brief get group's name.
  *
  * @return group's name
  */
-string Group::getName() {
+const string& Group::getName() const {
     return _name;
 }
 
@@ -28,19 +54,21 @@ string Group::getName() {
 /**
  * @brief Gets group's id.
  *
- * @return group's id
+ * @return group's id with at least 2 digits
  */
-string Group::getGroupId() {
-    return _id;
+string Group::getGroupId() const {
+    char id[11];
+    snprintf(id, sizeof id, "%02u", _id);
+    return id;
 }
 
 
 /**
  * @brief Get group's users
  *
- * @return users as an unordered map
+ * @return ids of the subscribed users, in ascending order
  */
-unordered_map<string, User*> Group::getUsers() {
+const vector<uint32_t>& Group::getUsers() const {
     return _users;
 }
 
@@ -50,38 +78,91 @@ unordered_map<string, User*> Group::getUsers() {
  *
  * @return message identifier counter
  */
-uint32_t Group::getMid() {
-    return this->_messages.size();
+uint32_t Group::getMid() const {
+    return this->_log ? this->_log->getCount() : (uint32_t) this->_messages.size();
 }
 
 
 /**
  * @brief add user to this group.
  *
- * @param user user that wants to subscribe to this group
+ * @param uid id of the user that wants to subscribe to this group
  */
-void Group::subscribeUser(User *user) {
-    _users.insert({user->getUserId(), user});
+void Group::subscribeUser(uint32_t uid) {
+    auto itr = lower_bound(_users.begin(), _users.end(), uid);
+    if (itr == _users.end() || *itr != uid) _users.insert(itr, uid);
 }
 
 
 /**
  * @brief removes user from this group.
  *
- * @param user_id
+ * @param uid user's id
  */
-void Group::unsubscribeUser(const string& user_id) {
-    _users.erase(user_id);
+void Group::unsubscribeUser(uint32_t uid) {
+    auto itr = lower_bound(_users.begin(), _users.end(), uid);
+    if (itr != _users.end() && *itr == uid) _users.erase(itr);
 }
 
 
 /**
  * @brief post new message to this group
  *
- * @param message new message
+ * @param uid author's id
+ * @param text message's text
+ * @param filename file's name or empty if there is no file
+ * @param filesize file's size
+ *
+ * @return new message's id
  */
-void Group::postMessage(const Message& message) {
-    _messages.push_back(message);
+uint32_t Group::postMessage(uint32_t uid, string_view text, string_view filename, long filesize) {
+
+    uint32_t mid = this->getMid() + 1;
+
+    /* Messages never change, so they are serialized once, as RTV sends them. Those that classic clients can
+     * read also get the narrower classic header, right before the extended one */
+    string record;
+    bool classic = mid <= MID_LIMIT && uid <= USER_LIMIT && text.size() <= TEXT_MAX_SIZE;
+    if (classic) {
+        append_number(record, mid, 4);
+        record.append(" ");
+        append_number(record, uid, 5);
+        record.append(" ");
+    }
+
+    size_t header = record.size();
+    append_number(record, mid, RECORD_ID_SIZE);
+    record.append(" ");
+    append_number(record, uid, RECORD_ID_SIZE);
+    record.append(" ").append(to_string(text.size())).append(" \"");
+    size_t text_offset = record.size() - header;
+    record.append(text).append("\"");
+    if (!filename.empty()) record.append(" / ").append(filename).append(" ").append(to_string(filesize)).append(" ");
+    record.append("\n");
+
+    /* Logged messages are read back from disk whenever they are retrieved */
+    if (_log) {
+        _log->append(uid, record, header, text_offset, text.size(), filename, filesize);
+        return mid;
+    }
+
+    /* File names are interned, as the same file is usually posted more than once */
+    const char* name = nullptr;
+    if (!filename.empty()) {
+        auto itr = _filenames.find(filename);
+        if (itr != _filenames.end()) {
+            name = itr->second;
+        } else {
+            name = _arena.store(filename, true);
+            _filenames.insert({string_view(name, filename.size()), name});
+        }
+    }
+
+    const char* stored = _arena.store(record, false);
+    _messages.emplace_back(mid, uid, string_view(stored + header, record.size() - header), text_offset,
+                           text.size(), classic, name, filesize);
+
+    return mid;
 }
 
 
@@ -89,18 +170,210 @@ void Group::postMessage(const Message& message) {
  * Retrieve up to 20 messages, starting from the message with identifier mid.
  *
  * @param mid message's identifier
+ * @param out messages, which are not copied, or an empty range if there are none
+ *
+ * @return false if the messages could not be read
+ */
+bool Group::retrieveMessages(uint32_t mid, MessageRange& out) {
+
+    /* Message ids start at 1 */
+    mid = max(mid, (uint32_t) 1);
+
+    /* Logged messages are read from disk, a page at a time */
+    if (_log) {
+        const deque<Message>* page = _log->read(mid, PAGE_SIZE);
+        if (page == nullptr) return false;
+        out = {page->begin(), page->end()};
+        return true;
+    }
+
+    /* Message ids are one position ahead of the message in memory */
+    size_t first = min((size_t) mid - 1, _messages.size());
+    size_t last = min(first + PAGE_SIZE, _messages.size());
+
+    out = {_messages.begin() + first, _messages.begin() + last};
+    return true;
+}
+
+
+/**
+ * @brief Gets where the group's log ends
+ *
+ * @return log's position, all zeros if messages are kept in memory
+ */
+LogPosition Group::getLogPosition() const {
+    return _log ? _log->getPosition() : LogPosition();
+}
+
+
+/**
+ * @brief GroupListing constructor. Starts without groups
+ *
+ * @param reply opcode of the response
+ * @param gid_size number of digits of each group id
+ * @param mid_size number of digits of each message id
+ * @param group_limit highest group id that is listed
+ * @param mid_limit highest message id that is listed
+ */
+GroupListing::GroupListing(string_view reply, int gid_size, int mid_size, uint32_t group_limit,
+                           uint32_t mid_limit) : _reply(reply) {
+    _listing = _reply + " 0\n";
+    _header_size = _listing.size() - 1;
+    _gid_size = gid_size;
+    _mid_size = mid_size;
+    _group_limit = group_limit;
+    _mid_limit = mid_limit;
+}
+
+
+/**
+ * @brief Lists a newly created group at the end
+ *
+ * @param gid group's id
+ * @param group created group
+ */
+void GroupListing::add(uint32_t gid, const Group& group) {
+
+    /* Groups that the dialect can't name are left out */
+    if (gid > _group_limit) return;
+
+    /* Number of groups in the header changed, and it may have gained a digit */
+    string header = _reply + " " + to_string(gid);
+    _listing.replace(0, _header_size, header);
+    _header_size = header.size();
+
+    /* Lists the new group at the end, right before the \n */
+    string entry = " ";
+    append_number(entry, gid, _gid_size);
+    entry.append(" ").append(group.getName()).append(" ");
+    _mid_offsets.push_back(_listing.size() - 1 - _header_size + entry.size());
+    append_number(entry, min(group.getMid(), _mid_limit), _mid_size);
+    _listing.insert(_listing.size() - 1, entry);
+
+}
+
+
+/**
+ * @brief Updates a group's last message id
+ *
+ * @param gid group's id
+ * @param group group where a message was posted
+ */
+void GroupListing::update(uint32_t gid, const Group& group) {
+
+    if (gid > _group_limit) return;
+
+    /* Only the digits of the group's last message id change, so they are rewritten where they are */
+    char* digits = &_listing[_header_size + _mid_offsets[gid - 1]];
+    uint32_t mid = min(group.getMid(), _mid_limit);
+    for (int i = _mid_size - 1; i >= 0; i--, mid /= 10) digits[i] = (char) ('0' + mid % 10);
+
+}
+
+
+/**
+ * @brief Gets the response
+ *
+ * @return listing
+ */
+const string& GroupListing::get() const {
+    return _listing;
+}
+
+
+/**
+ * @brief GroupTable constructor. Every slot starts empty
+ */
+GroupTable::GroupTable() : _groups(1), _listings{
+        GroupListing("RGL", 2, 4, GROUP_LIMIT, MID_LIMIT),
+        GroupListing("XRGL", RECORD_ID_SIZE, RECORD_ID_SIZE, UINT32_MAX, UINT32_MAX)} {
+    _compress = false;
+}
+
+
+/**
+ * @brief Keeps the messages of the groups created from now on in logs, one directory per group
  *
- * @return vector with message
+ * @param directory directory of the logs, which is created if it does not exist
+ * @param compress is true if sealed segments of the logs are compressed
  */
-vector<Message> Group::retrieveMessages(const uint32_t& mid) {
+void GroupTable::setDirectory(const string& directory, bool compress) {
+    assert_(mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST, "Could not create the logs' directory\n")
+    _directory = directory;
+    _compress = compress;
+}
 
-    /* Number of messages from the selected message to the last one*/
-    uint32_t interval = this->getMid() - mid + 1;
 
-    /* If the number is less than 20, display all message. If not, we select the last message to
-     * be retrieved as mid plus 20 */
-    uint32_t end = interval < 20 ? 0 : (this->getMid() - (mid + 19));
-    vector<Message> result(_messages.begin() + mid - 1, _messages.end() - end);
+/**
+ * @brief Finds a group
+ *
+ * @param gid group's id
+ *
+ * @return group or nullptr if there is no such group
+ */
+Group* GroupTable::find(uint32_t gid) {
+    if (gid == 0 || gid >= _groups.size()) return nullptr;
+    return &_groups[gid];
+}
+
 
-    return result;
+/**
+ * @brief Creates a group in the next free id
+ *
+ * @param name group's name
+ * @param position where the group's log ends, when it is restored from a snapshot
+ *
+ * @return created group
+ */
+Group* GroupTable::add(string_view name, const LogPosition& position) {
+    uint32_t gid = (uint32_t) _groups.size();
+    _groups.emplace_back();
+    _groups.back().createGroup(gid, name);
+    if (!_directory.empty()) _groups.back().openLog(_directory + "/" + to_string(gid), position, _compress);
+
+    for (GroupListing& listing: _listings) listing.add(gid, _groups.back());
+
+    return &_groups.back();
+}
+
+
+/**
+ * @brief Updates the listing after a message was posted to a group
+ *
+ * @param gid group's id
+ */
+void GroupTable::messagePosted(uint32_t gid) {
+    for (GroupListing& listing: _listings) listing.update(gid, _groups[gid]);
+}
+
+
+/**
+ * @brief Gets the RGL response, which lists every group that a dialect can name
+ *
+ * @param dialect dialect of the request
+ *
+ * @return listing
+ */
+const string& GroupTable::getListing(Dialect dialect) const {
+    return _listings[dialect].get();
+}
+
+
+/**
+ * @brief Gets number of groups
+ *
+ * @return number of groups
+ */
+size_t GroupTable::size() const {
+    return _groups.size() - 1;
+}
+
+
+/**
+ * @brief Checks if there are no groups
+ *
+ * @return true if empty
+ */
+bool GroupTable::empty() const {
+    return _groups.size() == 1;
 }
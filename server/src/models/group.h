@@ -3,20 +3,62 @@
 
 #include "message.h"
 #include "user.h"
+#include "log.h"
 #include <vector>
+#include <deque>
+#include <memory>
+
+#define GROUP_LIMIT 99
+#define MID_LIMIT 9999
+#define GROUP_NAME_MAX_SIZE 24
+#define PAGE_SIZE 20
+#define DIALECT_COUNT 2
+
+
+/**
+ * @brief Versions of the protocol the server speaks. Both share the same users, groups and messages.
+ */
+enum Dialect {
+    DIALECT_CLASSIC,   /* 5 digit user ids, 2 digit group ids and 4 digit message ids */
+    DIALECT_EXTENDED,  /* 32 bit ids, which are zero padded to 10 digits in responses */
+};
+
+
+/**
+ * @brief Run of consecutive messages of a group. Refers to the messages where they are stored, so it
+ * copies nothing and is only valid until the next message is posted or the next page of the group is read.
+ */
+struct MessageRange {
+
+    /**
+     * @brief First message of the run.
+     */
+    deque<Message>::const_iterator first;
+
+    /**
+     * @brief Position right after the last message of the run.
+     */
+    deque<Message>::const_iterator last;
+
+    deque<Message>::const_iterator begin() const { return first; }
+    deque<Message>::const_iterator end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+};
 
 
 /**
- * @brief Represents a Group.
+ * @brief Represents a Group. Lives in the position of the GroupTable given by its id.
  */
 class Group {
 
     private:
 
         /**
-         * @brief group's id
+         * @brief group's id (0 if this slot is empty)
          */
-        string _id;
+        uint32_t _id;
 
         /**
          * @brief group's name
@@ -24,78 +66,306 @@ class Group {
         string _name;
 
         /**
-         * @brief hashmap of users subscribed to this group
+         * @brief ids of the users subscribed to this group, in ascending order
+         */
+        vector<uint32_t> _users;
+
+        /**
+         * @brief Group's message, unless they are kept in a log. Growing it never moves the messages already posted
          */
-        unordered_map<string, User*> _users;
+        deque<Message> _messages;
 
         /**
-         * @brief Group's message
+         * @brief Holds the records and file names of the group's messages
          */
-        vector<Message> _messages;
+        Arena _arena;
+
+        /**
+         * @brief File names already stored in the arena, so each one is only stored once
+         */
+        unordered_map<string_view, const char*> _filenames;
+
+        /**
+         * @brief Keeps the group's messages on disk (nullptr if they are kept in memory)
+         */
+        unique_ptr<MessageLog> _log;
 
     public:
 
         /**
-         * @brief Group Constructor
+         * @brief Group Constructor. Creates an empty slot
+         */
+        Group();
+
+        /**
+         * @brief Fills this slot with a newly created group
          *
          * @param id group's identifier
          * @param name group's name
          */
-        explicit Group(const string& id, const string& name);
+        void createGroup(uint32_t id, string_view name);
+
+        /**
+         * @brief Keeps the group's messages in a log from now on
+         *
+         * @param directory directory of the log's segments
+         * @param position where the log ends, all zeros if it has no messages
+         * @param compress is true if sealed segments of the log are compressed
+         */
+        void openLog(const string& directory, const LogPosition& position, bool compress);
 
         /**
         * @brief Get group's name
         *
         * @return group's name
         */
-        string getName();
+        const string& getName() const;
 
         /**
          * @brief Get group's id
          *
-         * @return group's id
+         * @return group's id with at least 2 digits
          */
-        string getGroupId();
+        string getGroupId() const;
 
         /**
         * @brief Get group's users
         *
-        * @return users as an unordered map
+        * @return ids of the subscribed users, in ascending order
         */
-        unordered_map<string, User*> getUsers();
+        const vector<uint32_t>& getUsers() const;
 
         /**
         * @brief Get group's message identifier counter
         *
         * @return message identifier counter
         */
-        uint32_t getMid();
+        uint32_t getMid() const;
 
         /**
         * @brief add user to this group
-        * @param user's pointer
+        * @param uid user's id
         */
-        void subscribeUser(User *user);
+        void subscribeUser(uint32_t uid);
 
         /**
          * @brief removes user from this group
 
-         * @param user_id
+         * @param uid user's id
          */
-        void unsubscribeUser(const string& user_id);
+        void unsubscribeUser(uint32_t uid);
 
         /**
          * @brief post new message
-         * @param m message to be posted
+         *
+         * @param uid author's id
+         * @param text message's text
+         * @param filename file's name or empty if there is no file
+         * @param filesize file's size
+         *
+         * @return new message's id
          */
-        void postMessage(const Message& m);
+        uint32_t postMessage(uint32_t uid, string_view text, string_view filename, long filesize);
 
         /**
         * Retrieve up to 20 messages, starting from the message with identifier mid
         * @param mid message's identifier
-        * @return vector with message
+        * @param out messages, which are not copied, or an empty range if there are none
+        * @return false if the messages could not be read
         */
-        vector<Message> retrieveMessages(const uint32_t& mid);
+        bool retrieveMessages(uint32_t mid, MessageRange& out);
+
+        /**
+         * @brief Gets where the group's log ends
+         *
+         * @return log's position, all zeros if messages are kept in memory
+         */
+        LogPosition getLogPosition() const;
+
+};
+
+
+/**
+ * @brief Response listing groups, ready to be sent. Ids are zero padded to a fixed width, so the listing is
+ * patched where it is whenever a message is posted.
+ */
+class GroupListing {
+
+    private:
+
+        /**
+         * @brief Response, "RGL N[ GID Name MID]*\n"
+         */
+        string _listing;
+
+        /**
+         * @brief Opcode of the response
+         */
+        string _reply;
+
+        /**
+         * @brief Length of the "RGL N" header at the start of the listing
+         */
+        size_t _header_size;
+
+        /**
+         * @brief Position of each listed group's last message id, counted from the end of the header. Group
+         * gid is in position gid - 1
+         */
+        vector<size_t> _mid_offsets;
+
+        /**
+         * @brief Number of digits of each group id
+         */
+        int _gid_size;
+
+        /**
+         * @brief Number of digits of each message id
+         */
+        int _mid_size;
+
+        /**
+         * @brief Groups with a higher id are left out of the listing
+         */
+        uint32_t _group_limit;
+
+        /**
+         * @brief Message ids are listed up to this one
+         */
+        uint32_t _mid_limit;
+
+    public:
+
+        /**
+         * @brief GroupListing constructor. Starts without groups
+         *
+         * @param reply opcode of the response
+         * @param gid_size number of digits of each group id
+         * @param mid_size number of digits of each message id
+         * @param group_limit highest group id that is listed
+         * @param mid_limit highest message id that is listed
+         */
+        explicit GroupListing(string_view reply, int gid_size, int mid_size, uint32_t group_limit,
+                              uint32_t mid_limit);
+
+        /**
+         * @brief Lists a newly created group at the end
+         *
+         * @param gid group's id
+         * @param group created group
+         */
+        void add(uint32_t gid, const Group& group);
+
+        /**
+         * @brief Updates a group's last message id
+         *
+         * @param gid group's id
+         * @param group group where a message was posted
+         */
+        void update(uint32_t gid, const Group& group);
+
+        /**
+         * @brief Gets the response
+         *
+         * @return listing
+         */
+        const string& get() const;
+
+};
+
+
+/**
+ * @brief Holds every group in the server, indexed by the group's id. Groups are never deleted, so ids 1 up
+ * to size() are always taken.
+ */
+class GroupTable {
+
+    private:
+
+        /**
+         * @brief Created groups, in the position given by their ids. Position 0 is never used. Growing it
+         * never moves the groups already created
+         */
+        deque<Group> _groups;
+
+        /**
+         * @brief Listing of the groups as each dialect sends it
+         */
+        GroupListing _listings[DIALECT_COUNT];
+
+        /**
+         * @brief Directory where each group keeps its log (empty if messages are kept in memory)
+         */
+        string _directory;
+
+        /**
+         * @brief Is true if sealed segments of the logs are compressed
+         */
+        bool _compress;
+
+    public:
+
+        /**
+         * @brief GroupTable constructor. Starts without groups
+         */
+        GroupTable();
+
+        /**
+         * @brief Keeps the messages of the groups created from now on in logs, one directory per group
+         *
+         * @param directory directory of the logs, which is created if it does not exist
+         * @param compress is true if sealed segments of the logs are compressed
+         */
+        void setDirectory(const string& directory, bool compress);
+
+        /**
+         * @brief Finds a group
+         *
+         * @param gid group's id
+         *
+         * @return group or nullptr if there is no such group
+         */
+        Group* find(uint32_t gid);
+
+        /**
+         * @brief Creates a group in the next free id
+         *
+         * @param name group's name
+         * @param position where the group's log ends, when it is restored from a snapshot
+         *
+         * @return created group
+         */
+        Group* add(string_view name, const LogPosition& position = LogPosition());
+
+        /**
+         * @brief Updates the listing after a message was posted to a group
+         *
+         * @param gid group's id
+         */
+        void messagePosted(uint32_t gid);
+
+        /**
+         * @brief Gets the RGL response, which lists every group that a dialect can name
+         *
+         * @param dialect dialect of the request
+         *
+         * @return listing
+         */
+        const string& getListing(Dialect dialect) const;
+
+        /**
+         * @brief Gets number of groups
+         *
+         * @return number of groups
+         */
+        size_t size() const;
+
+        /**
+         * @brief Checks if there are no groups
+         *
+         * @return true if empty
+         */
+        bool empty() const;
 
 };
 
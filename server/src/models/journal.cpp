@@ -0,0 +1,583 @@
+#include "journal.h"
+#include "../misc/helpers.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cerrno>
+
+
+using namespace std;
+
+
+/**
+ * @brief Appends a number to a record.
+ *
+ * @param out record
+ * @param value number
+ */
+template <typename T>
+static void put_number(string& out, T value) {
+    out.append((const char*) &value, sizeof value);
+}
+
+
+/**
+ * @brief Appends a text to a record, right after its size.
+ *
+ * @param out record
+ * @param text text
+ */
+static void put_text(string& out, string_view text) {
+    put_number(out, (uint16_t) text.size());
+    out.append(text);
+}
+
+
+/**
+ * @brief Reads a number from a record.
+ *
+ * @param in what is left of the record, which moves past the number
+ * @param value number that was read
+ *
+ * @return false if the record ended before it
+ */
+template <typename T>
+static bool get_number(string_view& in, T& value) {
+    if (in.size() < sizeof value) return false;
+    memcpy(&value, in.data(), sizeof value);
+    in.remove_prefix(sizeof value);
+    return true;
+}
+
+
+/**
+ * @brief Reads a text from a record.
+ *
+ * @param in what is left of the record, which moves past the text
+ * @param text text that was read, pointing into the record
+ *
+ * @return false if the record ended before it
+ */
+static bool get_text(string_view& in, string_view& text) {
+    uint16_t size;
+    if (!get_number(in, size) || in.size() < size) return false;
+    text = in.substr(0, size);
+    in.remove_prefix(size);
+    return true;
+}
+
+
+/**
+ * @brief Writes records at the end of the journal and waits until they are on disk.
+ *
+ * @param fd journal's file
+ * @param records records to be written
+ */
+static void write_records(int fd, const string& records) {
+
+    size_t written = 0;
+    while (written < records.size()) {
+        ssize_t n = write(fd, records.data() + written, records.size() - written);
+        assert_(n != -1 || errno == EINTR, "Could not write to the journal\n")
+        if (n > 0) written += n;
+    }
+
+    assert_(fdatasync(fd) == 0, "Could not sync the journal\n")
+
+}
+
+
+/**
+ * @brief Applies a record to the tables.
+ *
+ * @param users table of users
+ * @param groups table of groups
+ * @param type kind of change
+ * @param in record's fields
+ *
+ * @return false if the fields don't match the kind of change
+ */
+static bool apply_record(UserTable* users, GroupTable* groups, uint8_t type, string_view in) {
+
+    uint32_t uid, gid;
+    uint64_t filesize;
+    string_view password, name, text, filename;
+
+    switch (type) {
+
+        case JOURNAL_REGISTER: {
+            if (!get_number(in, uid) || !get_text(in, password)) return false;
+            if (users->find(uid) == nullptr) users->add(uid, password);
+            break;
+        }
+
+        case JOURNAL_UNREGISTER: {
+            if (!get_number(in, uid)) return false;
+            User* user = users->find(uid);
+            if (user == nullptr) break;
+            for (uint32_t subscribed = user->nextGroup(0); subscribed != 0; subscribed = user->nextGroup(subscribed)) {
+                groups->find(subscribed)->unsubscribeUser(uid);
+            }
+            users->remove(uid);
+            break;
+        }
+
+        case JOURNAL_CREATE_GROUP: {
+            if (!get_number(in, gid) || !get_text(in, name)) return false;
+            if (gid != groups->size() + 1) return false;
+            groups->add(name);
+            break;
+        }
+
+        case JOURNAL_SUBSCRIBE:
+        case JOURNAL_UNSUBSCRIBE: {
+            if (!get_number(in, uid) || !get_number(in, gid)) return false;
+            User* user = users->find(uid);
+            Group* group = groups->find(gid);
+            if (user == nullptr || group == nullptr) break;
+            if (type == JOURNAL_SUBSCRIBE) {
+                group->subscribeUser(uid);
+                user->addGroup(gid);
+            } else {
+                group->unsubscribeUser(uid);
+                user->removeGroup(gid);
+            }
+            break;
+        }
+
+        case JOURNAL_POST: {
+            if (!get_number(in, uid) || !get_number(in, gid) || !get_text(in, text) || !get_text(in, filename) ||
+                !get_number(in, filesize)) return false;
+            Group* group = groups->find(gid);
+            if (group == nullptr) break;
+            group->postMessage(uid, text, filename, (long) filesize);
+            groups->messagePosted(gid);
+            break;
+        }
+
+        /* Only valid as the first record, which is read before any other */
+        default:
+            return false;
+
+    }
+
+    return in.empty();
+
+}
+
+
+/**
+ * @brief Maps a journal, so its records are read where they are, as the tables copy what they keep.
+ *
+ * @param fd journal's file
+ * @param size journal's size
+ *
+ * @return journal's contents, nullptr if it is empty
+ */
+static const char* map_journal(int fd, size_t& size) {
+
+    struct stat info{};
+    assert_(fstat(fd, &info) == 0, "Could not read the journal\n")
+    size = info.st_size;
+    if (size == 0) return nullptr;
+
+    const char* data = (const char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert_(data != MAP_FAILED, "Could not map the journal\n")
+    return data;
+
+}
+
+
+/**
+ * @brief Applies the records of a journal to the tables, unless it follows an older snapshot, which means
+ * that the tables already have them.
+ *
+ * @param data journal's contents
+ * @param size journal's size
+ * @param users table of users
+ * @param groups table of groups
+ * @param generation generation of the snapshot the journal has to follow
+ * @param count incremented for every record applied
+ *
+ * @return position right after the last good record, 0 if the journal was not applied
+ */
+static size_t apply_journal(const char* data, size_t size, UserTable* users, GroupTable* groups,
+                            uint64_t generation, size_t& count) {
+
+    size_t position = 0;
+    uint64_t epoch = 0;
+
+    while (size - position >= JOURNAL_HEADER_SIZE) {
+
+        uint32_t length, crc;
+        memcpy(&length, data + position, sizeof length);
+        memcpy(&crc, data + position + sizeof length, sizeof crc);
+
+        const char* record = data + position + JOURNAL_HEADER_SIZE;
+        if (length == 0 || length > size - position - JOURNAL_HEADER_SIZE || crc32(record, length) != crc) break;
+        string_view fields(record + 1, length - 1);
+
+        /* Journal says which snapshot it follows. Without it, it comes from before snapshots were taken */
+        if (position == 0 && record[0] == JOURNAL_EPOCH) {
+            if (!get_number(fields, epoch)) break;
+            assert_(epoch <= generation, "Journal is newer than the snapshot\n")
+            if (epoch < generation) return 0;
+        } else {
+            if (epoch < generation) return 0;
+            if (!apply_record(users, groups, (uint8_t) record[0], fields)) break;
+            count++;
+        }
+
+        position += JOURNAL_HEADER_SIZE + length;
+
+    }
+
+    return position;
+
+}
+
+
+/**
+ * @brief Journal class constructor. Opens the journal, creating it if it does not exist.
+ *
+ * @param directory directory where the server keeps its data
+ */
+Journal::Journal(const string& directory) {
+
+    string path = directory + "/" + JOURNAL_FILE;
+    bool created = access(path.c_str(), F_OK) != 0;
+
+    this->_directory = directory;
+    this->_fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    assert_(this->_fd != -1, "Could not open the journal\n")
+
+    /* A new journal is only there for good once its directory entry is on disk as well */
+    if (created) sync_directory(directory);
+
+    this->_appended = 0;
+    this->_durable = 0;
+    this->_start = 0;
+    this->_flushing = false;
+    this->_sealed = false;
+
+}
+
+
+/**
+ * @brief Applies every record in the journal to the tables, in the order they were written. A record
+ * that was cut short or does not match its crc was being written when the server stopped, so the
+ * journal is cut right before it. A journal from before the snapshot is already part of it, so it
+ * is dropped.
+ *
+ * @param users table of users
+ * @param groups table of groups
+ * @param generation generation of the snapshot the tables were loaded from, 0 if there was none
+ *
+ * @return number of records applied
+ */
+size_t Journal::replay(UserTable* users, GroupTable* groups, uint64_t generation) {
+
+    size_t size, count = 0;
+    const char* data;
+
+    /* Journal sealed by a snapshot that did not complete goes first. The current one follows from it */
+    string sealed = this->_directory + "/" + JOURNAL_SEALED_FILE;
+    int fd = open(sealed.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        data = map_journal(fd, size);
+        this->_sealed = data != nullptr && apply_journal(data, size, users, groups, generation, count) > 0;
+        if (data != nullptr) munmap((void*) data, size);
+        close(fd);
+        if (this->_sealed) generation++;
+        else unlink(sealed.c_str());
+    }
+
+    data = map_journal(this->_fd, size);
+    size_t position = data != nullptr ? apply_journal(data, size, users, groups, generation, count) : 0;
+    if (data != nullptr) munmap((void*) data, size);
+
+    /* Whatever comes after the last good record is dropped, so new records follow it */
+    this->_appended = position;
+    this->_durable = position;
+    if (position < size) {
+        assert_(ftruncate(this->_fd, (off_t) position) == 0 && fdatasync(this->_fd) == 0,
+                "Could not cut the journal\n")
+    }
+
+    /* An empty journal is given the snapshot it follows */
+    if (position == 0) this->rotate(generation);
+
+    return count;
+
+}
+
+
+/**
+ * @brief Starts the journal over after a snapshot was taken. Records that were not written yet are
+ * part of the snapshot, so they are dropped.
+ *
+ * @param generation generation of the snapshot
+ */
+void Journal::rotate(uint64_t generation) {
+
+    unique_lock<mutex> guard(this->_mutex);
+    while (this->_flushing) this->_flushed.wait(guard);
+
+    this->_buffer.clear();
+    size_t start = this->begin(JOURNAL_EPOCH);
+    put_number(this->_buffer, generation);
+    this->end(start);
+
+    /* Nothing else is written meanwhile, as the journal is only flushed by whoever sets _flushing */
+    assert_(ftruncate(this->_fd, 0) == 0, "Could not cut the journal\n")
+    write_records(this->_fd, this->_buffer);
+
+    this->_start = this->_appended - this->_buffer.size();
+    this->_durable = this->_appended;
+    this->_buffer.clear();
+    this->_flushed.notify_all();
+
+}
+
+
+/**
+ * @brief Moves the journal aside and starts a new one, which follows the snapshot that is about to be
+ * taken. Sealed journal is kept until that snapshot is complete.
+ *
+ * @param generation generation of the snapshot that is about to be taken
+ */
+void Journal::seal(uint64_t generation) {
+
+    unique_lock<mutex> guard(this->_mutex);
+    while (this->_flushing) this->_flushed.wait(guard);
+
+    /* Records still in memory belong to the sealed journal */
+    write_records(this->_fd, this->_buffer);
+    this->_buffer.clear();
+
+    string path = this->_directory + "/" + JOURNAL_FILE;
+    string sealed = this->_directory + "/" + JOURNAL_SEALED_FILE;
+    assert_(rename(path.c_str(), sealed.c_str()) == 0, "Could not seal the journal\n")
+    close(this->_fd);
+    this->_fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    assert_(this->_fd != -1, "Could not open the journal\n")
+
+    size_t start = this->begin(JOURNAL_EPOCH);
+    put_number(this->_buffer, generation);
+    this->end(start);
+    write_records(this->_fd, this->_buffer);
+    sync_directory(this->_directory);
+
+    this->_start = this->_appended - this->_buffer.size();
+    this->_durable = this->_appended;
+    this->_buffer.clear();
+    this->_sealed = true;
+    this->_flushed.notify_all();
+
+}
+
+
+/**
+ * @brief Removes the sealed journal, once the snapshot that follows it is complete.
+ */
+void Journal::dropSealed() {
+    string sealed = this->_directory + "/" + JOURNAL_SEALED_FILE;
+    unlink(sealed.c_str());
+    this->_sealed = false;
+}
+
+
+/**
+ * @brief Checks if there is a sealed journal, which the last snapshot does not include.
+ *
+ * @return true if there is one
+ */
+bool Journal::hasSealed() const {
+    return this->_sealed;
+}
+
+
+/**
+ * @brief Gets the size of the journal since it last started over.
+ *
+ * @return size, counting the records that are still in memory
+ */
+uint64_t Journal::size() {
+    lock_guard<mutex> guard(this->_mutex);
+    return this->_appended - this->_start;
+}
+
+
+/**
+ * @brief Starts a record at the end of the buffer. Journal's mutex must be held until it ends.
+ *
+ * @param type kind of change
+ *
+ * @return position of the record in the buffer
+ */
+size_t Journal::begin(JournalRecordType type) {
+    size_t start = this->_buffer.size();
+    this->_buffer.append(JOURNAL_HEADER_SIZE, '\0');
+    this->_buffer.push_back((char) type);
+    return start;
+}
+
+
+/**
+ * @brief Fills in the size and crc of the record that was being appended.
+ *
+ * @param start position of the record in the buffer
+ */
+void Journal::end(size_t start) {
+
+    const char* record = this->_buffer.data() + start + JOURNAL_HEADER_SIZE;
+    uint32_t length = (uint32_t) (this->_buffer.size() - start - JOURNAL_HEADER_SIZE);
+    uint32_t crc = crc32(record, length);
+
+    memcpy(&this->_buffer[start], &length, sizeof length);
+    memcpy(&this->_buffer[start + sizeof length], &crc, sizeof crc);
+    this->_appended += JOURNAL_HEADER_SIZE + length;
+
+}
+
+
+/**
+ * @brief Appends the registration of a user.
+ *
+ * @param uid user's id
+ * @param password user's password
+ */
+void Journal::registered(uint32_t uid, string_view password) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_REGISTER);
+    put_number(this->_buffer, uid);
+    put_text(this->_buffer, password);
+    this->end(start);
+}
+
+
+/**
+ * @brief Appends the unregistration of a user.
+ *
+ * @param uid user's id
+ */
+void Journal::unregistered(uint32_t uid) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_UNREGISTER);
+    put_number(this->_buffer, uid);
+    this->end(start);
+}
+
+
+/**
+ * @brief Appends the creation of a group.
+ *
+ * @param gid group's id
+ * @param name group's name
+ */
+void Journal::groupCreated(uint32_t gid, string_view name) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_CREATE_GROUP);
+    put_number(this->_buffer, gid);
+    put_text(this->_buffer, name);
+    this->end(start);
+}
+
+
+/**
+ * @brief Appends the subscription of a user to a group.
+ *
+ * @param uid user's id
+ * @param gid group's id
+ */
+void Journal::subscribed(uint32_t uid, uint32_t gid) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_SUBSCRIBE);
+    put_number(this->_buffer, uid);
+    put_number(this->_buffer, gid);
+    this->end(start);
+}
+
+
+/**
+ * @brief Appends the unsubscription of a user from a group.
+ *
+ * @param uid user's id
+ * @param gid group's id
+ */
+void Journal::unsubscribed(uint32_t uid, uint32_t gid) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_UNSUBSCRIBE);
+    put_number(this->_buffer, uid);
+    put_number(this->_buffer, gid);
+    this->end(start);
+}
+
+
+/**
+ * @brief Appends a message posted to a group.
+ *
+ * @param uid author's id
+ * @param gid group's id
+ * @param text message's text
+ * @param filename file's name or empty if there is no file
+ * @param filesize file's size
+ */
+void Journal::posted(uint32_t uid, uint32_t gid, string_view text, string_view filename, long filesize) {
+    lock_guard<mutex> guard(this->_mutex);
+    size_t start = this->begin(JOURNAL_POST);
+    put_number(this->_buffer, uid);
+    put_number(this->_buffer, gid);
+    put_text(this->_buffer, text);
+    put_text(this->_buffer, filename);
+    put_number(this->_buffer, (uint64_t) filesize);
+    this->end(start);
+}
+
+
+/**
+ * @brief Makes sure that every record appended so far is on disk, waiting for it if needed.
+ */
+void Journal::commit() {
+
+    unique_lock<mutex> guard(this->_mutex);
+    uint64_t target = this->_appended;
+
+    while (this->_durable < target) {
+
+        /* Someone else is writing. What they took may already cover our records */
+        if (this->_flushing) {
+            this->_flushed.wait(guard);
+            continue;
+        }
+
+        /* Takes every record appended so far, ours and everyone else's, and writes them without holding
+         * the mutex, so others go on appending in the meantime */
+        this->_flushing = true;
+        this->_writing.swap(this->_buffer);
+        uint64_t end = this->_appended;
+        guard.unlock();
+
+        write_records(this->_fd, this->_writing);
+        this->_writing.clear();
+
+        guard.lock();
+        this->_durable = end;
+        this->_flushing = false;
+        this->_flushed.notify_all();
+
+    }
+
+}
+
+
+/**
+ * @brief Closes the journal. Records that were not committed belong to responses that were never sent, so they
+ * are left behind.
+ */
+void Journal::clean() {
+    close(this->_fd);
+}
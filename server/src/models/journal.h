@@ -0,0 +1,242 @@
+#ifndef PROJETO_RC_39_V2_JOURNAL_H
+#define PROJETO_RC_39_V2_JOURNAL_H
+
+#include "user.h"
+#include "group.h"
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#define JOURNAL_FILE "journal"
+#define JOURNAL_SEALED_FILE "journal.sealed"
+#define JOURNAL_HEADER_SIZE 8
+
+
+using namespace std;
+
+
+/**
+ * @brief Kinds of changes that are written to the journal.
+ */
+enum JournalRecordType {
+    JOURNAL_REGISTER = 1,  /* User registered: uid, password */
+    JOURNAL_UNREGISTER,    /* User unregistered: uid */
+    JOURNAL_CREATE_GROUP,  /* Group created: gid, name */
+    JOURNAL_SUBSCRIBE,     /* User subscribed to a group: uid, gid */
+    JOURNAL_UNSUBSCRIBE,   /* User unsubscribed from a group: uid, gid */
+    JOURNAL_POST,          /* Message posted: uid, gid, text, file's name, file's size */
+    JOURNAL_EPOCH,         /* Generation of the snapshot the journal applies to, always the first record */
+};
+
+
+/**
+ * @brief Append only log of every change made to users and groups, so they can be rebuilt when the server
+ * starts. Each record is "size crc type fields", where size and crc refer to what follows them. Every time a
+ * snapshot is taken the journal starts over, and its first record tells which snapshot it applies to. While a
+ * snapshot is being written in the background, the journal it will replace is kept sealed next to the new one.
+ *
+ * Records are kept in memory until a response that may depend on them is about to be sent. Whoever needs
+ * them on disk first writes everything appended so far with a single fdatasync, while others that need them
+ * too wait for it, so concurrent changes share the cost of reaching the disk.
+ */
+class Journal {
+
+    private:
+
+        /**
+         * @brief Directory where the server keeps its data.
+         */
+        string _directory;
+
+        /**
+         * @brief Journal's file, opened for appending.
+         */
+        int _fd;
+
+        /**
+         * @brief Records appended that were not written yet.
+         */
+        string _buffer;
+
+        /**
+         * @brief Records being written by the thread that is flushing.
+         */
+        string _writing;
+
+        /**
+         * @brief Bytes appended since the server started, counting the records that are still in memory.
+         */
+        uint64_t _appended;
+
+        /**
+         * @brief Bytes appended since the server started that are known to be on disk.
+         */
+        uint64_t _durable;
+
+        /**
+         * @brief Value of _appended when the journal last started over.
+         */
+        uint64_t _start;
+
+        /**
+         * @brief Is true while some thread is writing records.
+         */
+        bool _flushing;
+
+        /**
+         * @brief Is true while there is a sealed journal, which the last snapshot does not include.
+         */
+        bool _sealed;
+
+        /**
+         * @brief Guards everything above, as every Manager appends to and flushes the same journal.
+         */
+        mutex _mutex;
+
+        /**
+         * @brief Signaled every time a flush ends.
+         */
+        condition_variable _flushed;
+
+        /**
+         * @brief Starts a record at the end of the buffer. Journal's mutex must be held until it ends.
+         *
+         * @param type kind of change
+         *
+         * @return position of the record in the buffer
+         */
+        size_t begin(JournalRecordType type);
+
+        /**
+         * @brief Fills in the size and crc of the record that was being appended.
+         *
+         * @param start position of the record in the buffer
+         */
+        void end(size_t start);
+
+    public:
+
+        /**
+         * @brief Journal class constructor. Opens the journal, creating it if it does not exist.
+         *
+         * @param directory directory where the server keeps its data
+         */
+        explicit Journal(const string& directory);
+
+        /**
+         * @brief Applies every record in the journal to the tables, in the order they were written. A record
+         * that was cut short or does not match its crc was being written when the server stopped, so the
+         * journal is cut right before it. A journal from before the snapshot is already part of it, so it
+         * is dropped.
+         *
+         * @param users table of users
+         * @param groups table of groups
+         * @param generation generation of the snapshot the tables were loaded from, 0 if there was none
+         *
+         * @return number of records applied
+         */
+        size_t replay(UserTable* users, GroupTable* groups, uint64_t generation);
+
+        /**
+         * @brief Starts the journal over after a snapshot was taken. Records that were not written yet are
+         * part of the snapshot, so they are dropped.
+         *
+         * @param generation generation of the snapshot
+         */
+        void rotate(uint64_t generation);
+
+        /**
+         * @brief Moves the journal aside and starts a new one, which follows the snapshot that is about to be
+         * taken. Sealed journal is kept until that snapshot is complete.
+         *
+         * @param generation generation of the snapshot that is about to be taken
+         */
+        void seal(uint64_t generation);
+
+        /**
+         * @brief Removes the sealed journal, once the snapshot that follows it is complete.
+         */
+        void dropSealed();
+
+        /**
+         * @brief Checks if there is a sealed journal, which the last snapshot does not include.
+         *
+         * @return true if there is one
+         */
+        bool hasSealed() const;
+
+        /**
+         * @brief Gets the size of the journal since it last started over.
+         *
+         * @return size, counting the records that are still in memory
+         */
+        uint64_t size();
+
+        /**
+         * @brief Appends the registration of a user.
+         *
+         * @param uid user's id
+         * @param password user's password
+         */
+        void registered(uint32_t uid, string_view password);
+
+        /**
+         * @brief Appends the unregistration of a user.
+         *
+         * @param uid user's id
+         */
+        void unregistered(uint32_t uid);
+
+        /**
+         * @brief Appends the creation of a group.
+         *
+         * @param gid group's id
+         * @param name group's name
+         */
+        void groupCreated(uint32_t gid, string_view name);
+
+        /**
+         * @brief Appends the subscription of a user to a group.
+         *
+         * @param uid user's id
+         * @param gid group's id
+         */
+        void subscribed(uint32_t uid, uint32_t gid);
+
+        /**
+         * @brief Appends the unsubscription of a user from a group.
+         *
+         * @param uid user's id
+         * @param gid group's id
+         */
+        void unsubscribed(uint32_t uid, uint32_t gid);
+
+        /**
+         * @brief Appends a message posted to a group.
+         *
+         * @param uid author's id
+         * @param gid group's id
+         * @param text message's text
+         * @param filename file's name or empty if there is no file
+         * @param filesize file's size
+         */
+        void posted(uint32_t uid, uint32_t gid, string_view text, string_view filename, long filesize);
+
+        /**
+         * @brief Makes sure that every record appended so far is on disk, waiting for it if needed.
+         */
+        void commit();
+
+        /**
+         * @brief Closes the journal. Records that were not committed belong to responses that were never sent, so they
+         * are left behind.
+         */
+        void clean();
+
+};
+
+
+#endif //PROJETO_RC_39_V2_JOURNAL_H
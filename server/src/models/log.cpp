@@ -0,0 +1,588 @@
+#include "log.h"
+#include "../misc/helpers.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+
+using namespace std;
+
+
+/**
+ * @brief MessageLog class constructor. Keeps the messages that the log had up to a position and drops
+ * whatever came after it.
+ *
+ * @param directory directory of the log's segments, which is created if it does not exist
+ * @param position where the log ends, all zeros to start it over
+ * @param compress is true if segments are compressed once they are sealed
+ */
+MessageLog::MessageLog(const string& directory, const LogPosition& position, bool compress) {
+
+    this->_directory = directory;
+    this->_count = position.count;
+    this->_fd = -1;
+    this->_index_fd = -1;
+    this->_read_fd = -1;
+    this->_read_first = 0;
+    this->_compress = compress;
+    this->_block_fd = -1;
+    this->_block_index_fd = -1;
+    this->_seal_failures = make_shared<SealFailures>();
+
+    assert_(mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST, "Could not create the log's directory\n")
+
+    /* Segments that were started after the position only have messages that the journal brings back. Each
+     * segment that is kept may have a plain copy, compressed blocks or both */
+    map<uint32_t, bool> found;
+    DIR* dp = opendir(directory.c_str());
+    assert_(dp, "Could not open the log's directory\n")
+    struct dirent* entry;
+    while ((entry = readdir(dp))) {
+        uint32_t first;
+        char extension[4];
+        if (sscanf(entry->d_name, "%10u.%3s", &first, extension) != 2) continue;
+        if (position.count == 0 || first > position.segment || strcmp(extension, "tmp") == 0) {
+            unlinkat(dirfd(dp), entry->d_name, 0);
+        } else if (strcmp(extension, "log") == 0) {
+            found[first] = true;
+        } else if (strcmp(extension, "lz4") == 0) {
+            found.insert({first, false});
+        }
+    }
+    closedir(dp);
+
+    if (position.count == 0) return;
+    assert_(!found.empty() && found.rbegin()->first == position.segment, "Log is missing segments\n")
+
+    /* Last segment was sealed after the position, so it is brought back to be written again */
+    if (!found.rbegin()->second) {
+        this->decompressSegment(position.segment);
+        found.rbegin()->second = true;
+    }
+    for (auto& segment: found) this->_segments.push_back({segment.first, 0, {}, !segment.second});
+
+    /* Segments before the last one are complete. Plain copies are compressed again, as their blocks may not
+     * have reached the disk */
+    struct stat info{};
+    for (size_t i = 0; i + 1 < this->_segments.size(); i++) {
+
+        LogSegment& segment = this->_segments[i];
+        if (segment.compressed) continue;
+
+        int fd = open(this->getPath(segment.first, "log").c_str(), O_RDONLY | O_CLOEXEC);
+        assert_(fd != -1 && fstat(fd, &info) == 0, "Could not open the log\n")
+        segment.size = info.st_size;
+
+        if (compress) {
+            assert_(this->readIndex(segment), "Log is corrupted\n")
+            this->openBlocks(segment.first, 0);
+            this->seal(segment, fd, this->_segments[i + 1].first - segment.first);
+        } else {
+            unlink(this->getPath(segment.first, "lz4").c_str());
+            unlink(this->getPath(segment.first, "lzi").c_str());
+        }
+        close(fd);
+
+    }
+
+    /* Last one is cut back to the position, along with its index */
+    LogSegment& last = this->_segments.back();
+    this->_fd = open(this->getPath(last.first, "log").c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    this->_index_fd = open(this->getPath(last.first, "idx").c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    assert_(this->_fd != -1 && this->_index_fd != -1, "Could not open the log\n")
+    assert_(fstat(this->_fd, &info) == 0 && (uint64_t) info.st_size >= position.size, "Log is missing messages\n")
+
+    last.size = position.size;
+    last.index.resize((position.count - last.first) / LOG_INDEX_STRIDE + 1);
+    size_t index_size = last.index.size() * sizeof(uint64_t);
+    assert_(ftruncate(this->_fd, (off_t) last.size) == 0 && ftruncate(this->_index_fd, (off_t) index_size) == 0 &&
+            pread(this->_index_fd, last.index.data(), index_size, 0) == (ssize_t) index_size, "Log is corrupted\n")
+
+    /* So are its compressed blocks, and those that are missing are compressed again */
+    uint32_t messages = position.count - last.first + 1;
+    if (compress) {
+        this->openBlocks(last.first, messages / LOG_BLOCK_MESSAGES);
+        this->compressBlocks(last, this->_fd, messages, false);
+    } else {
+        unlink(this->getPath(last.first, "lz4").c_str());
+        unlink(this->getPath(last.first, "lzi").c_str());
+    }
+
+}
+
+
+/**
+ * @brief Gets the path of a segment or of its index.
+ *
+ * @param first id of the segment's first message
+ * @param extension "log" or "idx"
+ *
+ * @return path
+ */
+string MessageLog::getPath(uint32_t first, const char* extension) const {
+    char name[16];
+    snprintf(name, sizeof name, "%010u.%s", first, extension);
+    return this->_directory + "/" + name;
+}
+
+
+/**
+ * @brief Reads the index of a segment that is no longer written to.
+ *
+ * @param segment segment whose index is read
+ *
+ * @return false if the index could not be read
+ */
+bool MessageLog::readIndex(LogSegment& segment) {
+
+    int fd = open(this->getPath(segment.first, segment.compressed ? "lzi" : "idx").c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd == -1) return false;
+    if (fstat(fd, &info) == 0) segment.index.resize(info.st_size / sizeof(uint64_t));
+    size_t index_size = segment.index.size() * sizeof(uint64_t);
+    bool complete = !segment.index.empty() && pread(fd, segment.index.data(), index_size, 0) == (ssize_t) index_size;
+    close(fd);
+
+    /* Index that can't be trusted is read again the next time */
+    if (!complete) {
+        segment.index.clear();
+        return false;
+    }
+
+    /* Compressed segment ends where its last block does */
+    if (segment.compressed) segment.size = segment.index.back();
+    return true;
+
+}
+
+
+/**
+ * @brief Opens the compressed blocks of a segment for appending.
+ *
+ * @param first id of the segment's first message
+ * @param blocks number of blocks to be kept, all of them if there are fewer
+ */
+void MessageLog::openBlocks(uint32_t first, size_t blocks) {
+
+    this->_block_fd = open(this->getPath(first, "lz4").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    this->_block_index_fd = open(this->getPath(first, "lzi").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat info{};
+    assert_(this->_block_fd != -1 && this->_block_index_fd != -1 && fstat(this->_block_index_fd, &info) == 0,
+            "Could not open the log\n")
+
+    /* Index is only written once its block is, so every block it has is complete */
+    this->_blocks.resize(min((size_t) info.st_size / sizeof(uint64_t), blocks));
+    size_t index_size = this->_blocks.size() * sizeof(uint64_t);
+    assert_(pread(this->_block_index_fd, this->_blocks.data(), index_size, 0) == (ssize_t) index_size &&
+            fstat(this->_block_fd, &info) == 0, "Log is corrupted\n")
+
+    uint64_t size = this->_blocks.empty() ? 0 : this->_blocks.back();
+    assert_((uint64_t) info.st_size >= size && ftruncate(this->_block_fd, (off_t) size) == 0 &&
+            ftruncate(this->_block_index_fd, (off_t) index_size) == 0, "Log is corrupted\n")
+
+}
+
+
+/**
+ * @brief Compresses the blocks of a plain segment that were not compressed yet.
+ *
+ * @param segment plain segment
+ * @param fd segment's file
+ * @param messages number of messages in the segment
+ * @param all is true if the last block is compressed even if it is not complete
+ */
+void MessageLog::compressBlocks(const LogSegment& segment, int fd, uint32_t messages, bool all) {
+
+    size_t blocks = (messages + (all ? LOG_BLOCK_MESSAGES - 1 : 0)) / LOG_BLOCK_MESSAGES;
+    string plain, block;
+
+    while (this->_blocks.size() < blocks) {
+
+        /* Block goes from one indexed message up to the first message of the next block */
+        size_t from = this->_blocks.size() * (LOG_BLOCK_MESSAGES / LOG_INDEX_STRIDE);
+        size_t to = from + LOG_BLOCK_MESSAGES / LOG_INDEX_STRIDE;
+        uint64_t start = segment.index[from];
+        uint64_t stop = to < segment.index.size() ? segment.index[to] : segment.size;
+
+        plain.resize(stop - start);
+        assert_(pread(fd, &plain[0], plain.size(), (off_t) start) == (ssize_t) plain.size(), "Could not read the log\n")
+        block.clear();
+        compress_block(block, plain.data(), plain.size());
+
+        uint64_t end = (this->_blocks.empty() ? 0 : this->_blocks.back()) + block.size();
+        assert_(write(this->_block_fd, block.data(), block.size()) == (ssize_t) block.size() &&
+                write(this->_block_index_fd, &end, sizeof end) == sizeof end, "Could not write the log\n")
+        this->_blocks.push_back(end);
+
+    }
+
+}
+
+
+/**
+ * @brief Seals a segment that is no longer written to, compressing it if the log does so.
+ *
+ * @param segment segment to be sealed
+ * @param fd segment's file
+ * @param messages number of messages in the segment
+ */
+void MessageLog::seal(LogSegment& segment, int fd, uint32_t messages) {
+
+    if (!this->_compress) return;
+
+    this->compressBlocks(segment, fd, messages, true);
+    segment.compressed = true;
+    segment.index = move(this->_blocks);
+    segment.size = segment.index.back();
+    this->_blocks.clear();
+
+    /* Plain copy is only removed once the blocks are on disk. That is left to another thread, so posting does
+     * not wait for it, and the plain copy is compressed again if the server stops before. If they can't be
+     * synced, the log is told to read the plain copy instead */
+    int block_fd = this->_block_fd;
+    int block_index_fd = this->_block_index_fd;
+    string directory = this->_directory;
+    string log = this->getPath(segment.first, "log");
+    string index = this->getPath(segment.first, "idx");
+    uint32_t first = segment.first;
+    shared_ptr<SealFailures> failures = this->_seal_failures;
+    thread([=] {
+        int dir = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        bool synced = fdatasync(block_fd) == 0 && fdatasync(block_index_fd) == 0 && dir != -1 && fsync(dir) == 0;
+        if (dir != -1) close(dir);
+        close(block_fd);
+        close(block_index_fd);
+        if (synced) {
+            unlink(log.c_str());
+            unlink(index.c_str());
+        } else {
+            lock_guard<mutex> guard(failures->lock);
+            failures->segments.push_back(first);
+        }
+    }).detach();
+
+    this->_block_fd = -1;
+    this->_block_index_fd = -1;
+
+}
+
+
+/**
+ * @brief Writes a plain copy of a compressed segment.
+ *
+ * @param first id of the segment's first message
+ */
+void MessageLog::decompressSegment(uint32_t first) {
+
+    LogSegment segment{first, 0, {}, true};
+    assert_(this->readIndex(segment), "Log is corrupted\n")
+
+    int fd = open(this->getPath(first, "lz4").c_str(), O_RDONLY | O_CLOEXEC);
+    this->_compressed.resize(segment.size);
+    assert_(fd != -1 && pread(fd, &this->_compressed[0], segment.size, 0) == (ssize_t) segment.size,
+            "Could not read the log\n")
+    close(fd);
+
+    string plain;
+    for (size_t position = 0; position < this->_compressed.size(); ) {
+        size_t n = decompress_block(&this->_compressed[position], this->_compressed.size() - position, plain);
+        assert_(n != 0, "Log is corrupted\n")
+        position += n;
+    }
+
+    /* Index points at every LOG_INDEX_STRIDE-th message again */
+    vector<uint64_t> index;
+    uint32_t count = 0;
+    for (size_t position = 0; position < plain.size(); count++) {
+        LoggedMessage entry{};
+        assert_(position + sizeof entry <= plain.size(), "Log is corrupted\n")
+        memcpy(&entry, &plain[position], sizeof entry);
+        assert_(entry.size >= sizeof entry, "Log is corrupted\n")
+        if (count % LOG_INDEX_STRIDE == 0) index.push_back(position);
+        position += entry.size;
+    }
+
+    /* Plain copy only takes its name once it is complete */
+    string temporary = this->getPath(first, "tmp");
+    int log = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int index_fd = open(this->getPath(first, "idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    size_t index_size = index.size() * sizeof(uint64_t);
+    assert_(log != -1 && index_fd != -1 && write(log, plain.data(), plain.size()) == (ssize_t) plain.size() &&
+            write(index_fd, index.data(), index_size) == (ssize_t) index_size &&
+            rename(temporary.c_str(), this->getPath(first, "log").c_str()) == 0, "Could not write the log\n")
+    close(log);
+    close(index_fd);
+
+}
+
+
+/**
+ * @brief Goes back to the plain copies of the segments whose compressed blocks could not be synced.
+ */
+void MessageLog::recoverSeals() {
+
+    vector<uint32_t> failed;
+    {
+        lock_guard<mutex> guard(this->_seal_failures->lock);
+        if (this->_seal_failures->segments.empty()) return;
+        failed.swap(this->_seal_failures->segments);
+    }
+
+    for (uint32_t first: failed) {
+
+        auto itr = lower_bound(this->_segments.begin(), this->_segments.end(), first,
+                               [](const LogSegment& segment, uint32_t id) { return segment.first < id; });
+        struct stat info{};
+        if (itr == this->_segments.end() || itr->first != first ||
+            stat(this->getPath(first, "log").c_str(), &info) != 0) continue;
+        fprintf(stderr, "Could not sync the log, segment %u is kept uncompressed\n", first);
+
+        /* Blocks are dropped, so they are compressed again when the server starts */
+        itr->compressed = false;
+        itr->size = info.st_size;
+        itr->index.clear();
+        if (this->_read_fd != -1 && this->_read_first == first) {
+            close(this->_read_fd);
+            this->_read_fd = -1;
+        }
+        unlink(this->getPath(first, "lz4").c_str());
+        unlink(this->getPath(first, "lzi").c_str());
+
+    }
+
+}
+
+
+/**
+ * @brief Starts a new segment, which becomes the last one.
+ *
+ * @param first id of its first message
+ */
+void MessageLog::roll(uint32_t first) {
+
+    if (this->_fd != -1) {
+        LogSegment& last = this->_segments.back();
+        this->seal(last, this->_fd, first - last.first);
+        close(this->_fd);
+        close(this->_index_fd);
+    }
+
+    this->_fd = open(this->getPath(first, "log").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    this->_index_fd = open(this->getPath(first, "idx").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    assert_(this->_fd != -1 && this->_index_fd != -1, "Could not create a log segment\n")
+
+    this->_segments.push_back({first, 0, {}, false});
+    if (this->_compress) this->openBlocks(first, 0);
+
+}
+
+
+/**
+ * @brief Opens a segment for reading, unless it is the last one, which already is.
+ *
+ * @param segment segment to be read
+ *
+ * @return segment's file, -1 if it could not be opened
+ */
+int MessageLog::openSegment(LogSegment& segment) {
+
+    if (&segment == &this->_segments.back()) return this->_fd;
+
+    /* Segment that was read last stays open, as pages are usually read one after the other */
+    if (this->_read_fd == -1 || this->_read_first != segment.first) {
+        if (this->_read_fd != -1) close(this->_read_fd);
+        this->_read_fd = open(this->getPath(segment.first, segment.compressed ? "lz4" : "log").c_str(),
+                              O_RDONLY | O_CLOEXEC);
+        this->_read_first = segment.first;
+        if (this->_read_fd == -1) return -1;
+    }
+
+    /* Index of a complete segment is only read the first time the segment is */
+    if (segment.index.empty() && !this->readIndex(segment)) return -1;
+
+    return this->_read_fd;
+
+}
+
+
+/**
+ * @brief Gets the number of messages.
+ *
+ * @return number of messages
+ */
+uint32_t MessageLog::getCount() const {
+    return this->_count;
+}
+
+
+/**
+ * @brief Gets where the log ends.
+ *
+ * @return log's position
+ */
+LogPosition MessageLog::getPosition() const {
+    if (this->_segments.empty()) return {0, 0, 0};
+    return {this->_count, this->_segments.back().first, this->_segments.back().size};
+}
+
+
+/**
+ * @brief Appends a message.
+ *
+ * @param uid author's id
+ * @param record message's classic header, if it has one, followed by its extended record
+ * @param header length of the classic header, 0 if there is none
+ * @param text_offset position of the text in the extended record
+ * @param text_size length of the text
+ * @param filename file's name or empty if there is no file
+ * @param filesize file's size
+ */
+void MessageLog::append(uint32_t uid, string_view record, size_t header, size_t text_offset, size_t text_size,
+                        string_view filename, long filesize) {
+
+    this->recoverSeals();
+
+    uint32_t mid = this->_count + 1;
+    if (this->_segments.empty() || this->_segments.back().size >= LOG_SEGMENT_SIZE) this->roll(mid);
+    LogSegment& segment = this->_segments.back();
+
+    LoggedMessage entry{};
+    entry.size = (uint32_t) (sizeof entry + record.size() + (filename.empty() ? 0 : filename.size() + 1));
+    entry.uid = uid;
+    entry.filesize = filesize;
+    entry.record_size = (uint32_t) (record.size() - header);
+    entry.text_size = (uint16_t) text_size;
+    entry.text_offset = (uint8_t) text_offset;
+    entry.classic = header > 0;
+
+    /* Entry goes out in a single write */
+    struct iovec iov[] = {{&entry, sizeof entry}, {(void*) record.data(), record.size()},
+                          {(void*) filename.data(), filename.size()}, {(void*) "", filename.empty() ? 0u : 1u}};
+    assert_(writev(this->_fd, iov, 4) == (ssize_t) entry.size, "Could not write the log\n")
+
+    if ((mid - segment.first) % LOG_INDEX_STRIDE == 0) {
+        segment.index.push_back(segment.size);
+        assert_(write(this->_index_fd, &segment.size, sizeof(uint64_t)) == sizeof(uint64_t),
+                "Could not write the log\n")
+    }
+
+    segment.size += entry.size;
+    this->_count++;
+
+    /* Block that was just completed is compressed while it is still in the page cache */
+    uint32_t messages = mid - segment.first + 1;
+    if (this->_compress && messages % LOG_BLOCK_MESSAGES == 0) this->compressBlocks(segment, this->_fd, messages, false);
+
+}
+
+
+/**
+ * @brief Reads a page of consecutive messages.
+ *
+ * @param mid id of the first message
+ * @param count number of messages
+ *
+ * @return messages, which stay valid until the next page is read, or nullptr if the page could not be read
+ */
+const deque<Message>* MessageLog::read(uint32_t mid, uint32_t count) {
+
+    this->recoverSeals();
+
+    this->_messages.clear();
+    this->_page.clear();
+    if (mid == 0 || mid > this->_count || count == 0) return &this->_messages;
+
+    uint32_t last = (uint32_t) min((uint64_t) this->_count, (uint64_t) mid + count - 1);
+    vector<size_t> entries;
+
+    /* Page may go over the end of a segment, so it is read a segment at a time */
+    for (uint32_t next = mid; next <= last; ) {
+
+        auto itr = upper_bound(this->_segments.begin(), this->_segments.end(), next,
+                               [](uint32_t id, const LogSegment& segment) { return id < segment.first; }) - 1;
+        LogSegment& segment = *itr;
+        int fd = this->openSegment(segment);
+        if (fd == -1) return nullptr;
+        uint32_t end = itr + 1 == this->_segments.end() ? last : min(last, (itr + 1)->first - 1);
+
+        size_t stride = segment.compressed ? LOG_BLOCK_MESSAGES : LOG_INDEX_STRIDE;
+        size_t from = (next - segment.first) / stride;
+        size_t base = this->_page.size();
+
+        if (segment.compressed) {
+
+            /* Reads every block the page touches at once, then decompresses them one after the other */
+            size_t to = (end - segment.first) / stride;
+            if (to >= segment.index.size()) return nullptr;
+            uint64_t start = from == 0 ? 0 : segment.index[from - 1];
+            uint64_t stop = segment.index[to];
+            if (stop < start || stop > segment.size) return nullptr;
+            this->_compressed.resize(stop - start);
+            ssize_t n = pread(fd, &this->_compressed[0], stop - start, (off_t) start);
+            if (n != (ssize_t) (stop - start)) return nullptr;
+            for (size_t position = 0; position < this->_compressed.size(); ) {
+                size_t n = decompress_block(&this->_compressed[position], this->_compressed.size() - position,
+                                            this->_page);
+                if (n == 0) return nullptr;
+                position += n;
+            }
+
+        } else {
+
+            /* Reads from the indexed message right before the page up to the one right after it */
+            size_t to = (end - segment.first) / stride + 1;
+            if (from >= segment.index.size()) return nullptr;
+            uint64_t start = segment.index[from];
+            uint64_t stop = to < segment.index.size() ? segment.index[to] : segment.size;
+            if (stop < start || stop > segment.size) return nullptr;
+            this->_page.resize(base + (stop - start));
+            ssize_t n = pread(fd, &this->_page[base], stop - start, (off_t) start);
+            if (n != (ssize_t) (stop - start)) return nullptr;
+
+        }
+
+        /* Walks the entries that come before the page */
+        size_t position = base;
+        for (uint32_t id = segment.first + from * stride; id <= end; id++) {
+            LoggedMessage entry{};
+            if (position + sizeof entry > this->_page.size()) return nullptr;
+            memcpy(&entry, &this->_page[position], sizeof entry);
+            if (entry.size < sizeof entry || position + entry.size > this->_page.size() ||
+                sizeof entry + (entry.classic ? CLASSIC_HEADER_SIZE : 0) + entry.record_size > entry.size ||
+                (size_t) entry.text_offset + entry.text_size > entry.record_size) return nullptr;
+            if (id >= next) entries.push_back(position);
+            position += entry.size;
+        }
+
+        next = end + 1;
+
+    }
+
+    /* Page will not move anymore, so messages can refer to it */
+    uint32_t id = mid;
+    for (size_t position: entries) {
+
+        LoggedMessage entry{};
+        memcpy(&entry, &this->_page[position], sizeof entry);
+
+        const char* record = &this->_page[position] + sizeof entry + (entry.classic ? CLASSIC_HEADER_SIZE : 0);
+        const char* filename = record + entry.record_size;
+        if (filename == &this->_page[position] + entry.size) filename = nullptr;
+
+        this->_messages.emplace_back(id++, entry.uid, string_view(record, entry.record_size), entry.text_offset,
+                                     entry.text_size, entry.classic != 0, filename, (long) entry.filesize);
+
+    }
+
+    return &this->_messages;
+
+}
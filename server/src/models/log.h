@@ -0,0 +1,289 @@
+#ifndef PROJETO_RC_39_V2_LOG_H
+#define PROJETO_RC_39_V2_LOG_H
+
+#include "message.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#define LOG_SEGMENT_SIZE (4 << 20)
+#define LOG_INDEX_STRIDE 16
+#define LOG_BLOCK_MESSAGES 64
+
+
+using namespace std;
+
+
+/**
+ * @brief Start of a message in a log. It is followed by the message's classic header, if it has one, its
+ * extended record and its null terminated file's name, if it has a file.
+ */
+struct LoggedMessage {
+    uint32_t size;         /* Size of the whole entry, this header included */
+    uint32_t uid;          /* Author's id */
+    int64_t filesize;      /* File's size */
+    uint32_t record_size;  /* Length of the extended record */
+    uint16_t text_size;    /* Length of the text */
+    uint8_t text_offset;   /* Position of the text in the extended record */
+    uint8_t classic;       /* Is 1 if the record has a classic header */
+};
+
+
+/**
+ * @brief Where a log ends, which is what a snapshot keeps of it.
+ */
+struct LogPosition {
+    uint32_t count;    /* Number of messages */
+    uint32_t segment;  /* Id of the first message of the last segment, 0 if there are no messages */
+    uint64_t size;     /* Size of the last segment */
+};
+
+
+/**
+ * @brief File of a log, which holds the messages from a given id up to the next segment.
+ */
+struct LogSegment {
+    uint32_t first;          /* Id of the first message */
+    uint64_t size;           /* Size of the segment, unknown until its index is read if it is compressed */
+    vector<uint64_t> index;  /* Position of every LOG_INDEX_STRIDE-th message, or where each block ends if the
+                              * segment is compressed. Read the first time it is needed */
+    bool compressed;         /* Is true if messages are kept in compressed blocks of LOG_BLOCK_MESSAGES */
+};
+
+
+/**
+ * @brief Segments whose compressed blocks could not be synced. Filled by the threads that sync them and emptied
+ * by their log, which goes back to their plain copies.
+ */
+struct SealFailures {
+    mutex lock;                 /* Guards segments */
+    vector<uint32_t> segments;  /* Id of the first message of each segment */
+};
+
+
+/**
+ * @brief Messages of a group, kept on disk in segments named after their first message, so the group's history
+ * is not bounded by memory. Messages are appended as they are sent in RTV responses, and a sparse index next
+ * to each segment points at every LOG_INDEX_STRIDE-th of them. So a page is read with a single pread per
+ * segment it touches, whatever the size of the group.
+ *
+ * Segments are not synced as messages are posted, as the journal has them. A snapshot syncs them and keeps
+ * where the log ended, and the log is cut back there when the server starts, before the journal is replayed.
+ *
+ * Logs may compress the segments that are no longer written to. Blocks of LOG_BLOCK_MESSAGES messages are
+ * compressed as soon as they are complete, next to the last segment, so sealing it only compresses the last
+ * block. Its plain copy is removed once the blocks are on disk, and kept to be read instead if they can't
+ * get there. Pages of a compressed segment are read by decompressing the blocks they touch.
+ */
+class MessageLog {
+
+    private:
+
+        /**
+         * @brief Directory of the log's segments
+         */
+        string _directory;
+
+        /**
+         * @brief Segments, in the order of their first message
+         */
+        vector<LogSegment> _segments;
+
+        /**
+         * @brief Number of messages
+         */
+        uint32_t _count;
+
+        /**
+         * @brief Last segment, opened for appending (-1 if there is none)
+         */
+        int _fd;
+
+        /**
+         * @brief Index of the last segment, opened for appending (-1 if there is none)
+         */
+        int _index_fd;
+
+        /**
+         * @brief Segment that was last read, if it is not the last one (-1 if there is none)
+         */
+        int _read_fd;
+
+        /**
+         * @brief First message of the segment that was last read
+         */
+        uint32_t _read_first;
+
+        /**
+         * @brief Bytes of the page that was last read
+         */
+        string _page;
+
+        /**
+         * @brief Messages of the page that was last read, which refer to its bytes
+         */
+        deque<Message> _messages;
+
+        /**
+         * @brief Is true if segments are compressed once they are sealed
+         */
+        bool _compress;
+
+        /**
+         * @brief Compressed blocks of the last segment, opened for appending (-1 if segments are not compressed)
+         */
+        int _block_fd;
+
+        /**
+         * @brief Where each compressed block of the last segment ends, opened for appending
+         */
+        int _block_index_fd;
+
+        /**
+         * @brief Where each compressed block of the last segment ends
+         */
+        vector<uint64_t> _blocks;
+
+        /**
+         * @brief Compressed bytes that were last read
+         */
+        string _compressed;
+
+        /**
+         * @brief Segments whose compressed blocks could not be synced, shared with the threads that sync them
+         */
+        shared_ptr<SealFailures> _seal_failures;
+
+        /**
+         * @brief Gets the path of a segment or of its index.
+         *
+         * @param first id of the segment's first message
+         * @param extension "log" or "idx"
+         *
+         * @return path
+         */
+        string getPath(uint32_t first, const char* extension) const;
+
+        /**
+         * @brief Reads the index of a segment that is no longer written to.
+         *
+         * @param segment segment whose index is read
+         *
+         * @return false if the index could not be read
+         */
+        bool readIndex(LogSegment& segment);
+
+        /**
+         * @brief Opens the compressed blocks of a segment for appending.
+         *
+         * @param first id of the segment's first message
+         * @param blocks number of blocks to be kept, all of them if there are fewer
+         */
+        void openBlocks(uint32_t first, size_t blocks);
+
+        /**
+         * @brief Compresses the blocks of a plain segment that were not compressed yet.
+         *
+         * @param segment plain segment
+         * @param fd segment's file
+         * @param messages number of messages in the segment
+         * @param all is true if the last block is compressed even if it is not complete
+         */
+        void compressBlocks(const LogSegment& segment, int fd, uint32_t messages, bool all);
+
+        /**
+         * @brief Seals a segment that is no longer written to, compressing it if the log does so.
+         *
+         * @param segment segment to be sealed
+         * @param fd segment's file
+         * @param messages number of messages in the segment
+         */
+        void seal(LogSegment& segment, int fd, uint32_t messages);
+
+        /**
+         * @brief Writes a plain copy of a compressed segment.
+         *
+         * @param first id of the segment's first message
+         */
+        void decompressSegment(uint32_t first);
+
+        /**
+         * @brief Goes back to the plain copies of the segments whose compressed blocks could not be synced.
+         */
+        void recoverSeals();
+
+        /**
+         * @brief Starts a new segment, which becomes the last one.
+         *
+         * @param first id of its first message
+         */
+        void roll(uint32_t first);
+
+        /**
+         * @brief Opens a segment for reading, unless it is the last one, which already is.
+         *
+         * @param segment segment to be read
+         *
+         * @return segment's file, -1 if it could not be opened
+         */
+        int openSegment(LogSegment& segment);
+
+    public:
+
+        /**
+         * @brief MessageLog class constructor. Keeps the messages that the log had up to a position and drops
+         * whatever came after it.
+         *
+         * @param directory directory of the log's segments, which is created if it does not exist
+         * @param position where the log ends, all zeros to start it over
+         * @param compress is true if segments are compressed once they are sealed
+         */
+        explicit MessageLog(const string& directory, const LogPosition& position, bool compress);
+
+        /**
+         * @brief Gets the number of messages.
+         *
+         * @return number of messages
+         */
+        uint32_t getCount() const;
+
+        /**
+         * @brief Gets where the log ends.
+         *
+         * @return log's position
+         */
+        LogPosition getPosition() const;
+
+        /**
+         * @brief Appends a message.
+         *
+         * @param uid author's id
+         * @param record message's classic header, if it has one, followed by its extended record
+         * @param header length of the classic header, 0 if there is none
+         * @param text_offset position of the text in the extended record
+         * @param text_size length of the text
+         * @param filename file's name or empty if there is no file
+         * @param filesize file's size
+         */
+        void append(uint32_t uid, string_view record, size_t header, size_t text_offset, size_t text_size,
+                    string_view filename, long filesize);
+
+        /**
+         * @brief Reads a page of consecutive messages.
+         *
+         * @param mid id of the first message
+         * @param count number of messages
+         *
+         * @return messages, which stay valid until the next page is read, or nullptr if the page could not be read
+         */
+        const deque<Message>* read(uint32_t mid, uint32_t count);
+
+};
+
+
+#endif //PROJETO_RC_39_V2_LOG_H
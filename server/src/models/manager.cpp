@@ -1,75 +1,650 @@
 #include "manager.h"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <memory>
+#include <poll.h>
+
+
+/* Every request the server serves. Adding an opcode only takes a new entry. Extended listings can grow
+ * past what fits in a datagram, so they are served through tcp */
+static constexpr Route ROUTES[] = {
+    {pack_opcode("REG"), DIALECT_CLASSIC, TRANSPORT_UDP, 2, &Manager::doRegister},
+    {pack_opcode("UNR"), DIALECT_CLASSIC, TRANSPORT_UDP, 2, &Manager::doUnregister},
+    {pack_opcode("LOG"), DIALECT_CLASSIC, TRANSPORT_UDP, 2, &Manager::doLogin},
+    {pack_opcode("OUT"), DIALECT_CLASSIC, TRANSPORT_UDP, 2, &Manager::doLogout},
+    {pack_opcode("GLS"), DIALECT_CLASSIC, TRANSPORT_UDP, 0, &Manager::doListGroups},
+    {pack_opcode("GSR"), DIALECT_CLASSIC, TRANSPORT_UDP, 3, &Manager::doSubscribe},
+    {pack_opcode("GUR"), DIALECT_CLASSIC, TRANSPORT_UDP, 2, &Manager::doUnsubscribe},
+    {pack_opcode("GLM"), DIALECT_CLASSIC, TRANSPORT_UDP, 1, &Manager::doMyGroups},
+    {pack_opcode("ULS"), DIALECT_CLASSIC, TRANSPORT_TCP, 1, &Manager::doUserList},
+    {pack_opcode("PST"), DIALECT_CLASSIC, TRANSPORT_TCP, 4, &Manager::doPost},
+    {pack_opcode("RTV"), DIALECT_CLASSIC, TRANSPORT_TCP, 3, &Manager::doRetrieve},
+    {pack_opcode("XCAP"), DIALECT_EXTENDED, TRANSPORT_UDP, 0, &Manager::doCapabilities},
+    {pack_opcode("XREG"), DIALECT_EXTENDED, TRANSPORT_UDP, 2, &Manager::doRegister},
+    {pack_opcode("XUNR"), DIALECT_EXTENDED, TRANSPORT_UDP, 2, &Manager::doUnregister},
+    {pack_opcode("XLOG"), DIALECT_EXTENDED, TRANSPORT_UDP, 2, &Manager::doLogin},
+    {pack_opcode("XOUT"), DIALECT_EXTENDED, TRANSPORT_UDP, 2, &Manager::doLogout},
+    {pack_opcode("XGLS"), DIALECT_EXTENDED, TRANSPORT_TCP, 0, &Manager::doListGroups},
+    {pack_opcode("XGSR"), DIALECT_EXTENDED, TRANSPORT_UDP, 3, &Manager::doSubscribe},
+    {pack_opcode("XGUR"), DIALECT_EXTENDED, TRANSPORT_UDP, 2, &Manager::doUnsubscribe},
+    {pack_opcode("XGLM"), DIALECT_EXTENDED, TRANSPORT_TCP, 1, &Manager::doMyGroups},
+    {pack_opcode("XULS"), DIALECT_EXTENDED, TRANSPORT_TCP, 1, &Manager::doUserList},
+    {pack_opcode("XPST"), DIALECT_EXTENDED, TRANSPORT_TCP, 4, &Manager::doPost},
+    {pack_opcode("XRTV"), DIALECT_EXTENDED, TRANSPORT_TCP, 3, &Manager::doRetrieve},
+    {pack_opcode("XSNP"), DIALECT_EXTENDED, TRANSPORT_UDP, 0, &Manager::doSnapshotStatus},
+};
+
+/* Keeps lookups short, as most slots stay empty */
+static_assert(size(ROUTES) <= ROUTE_SLOTS / 2, "Dispatch table is too full");
+
+
+/**
+ * @brief Builds the dispatch table, which takes each slot to a route in ROUTES. An opcode whose slot is
+ * already taken goes to the next free one.
+ *
+ * @return index of the route in each slot, -1 if the slot is empty
+ */
+static constexpr array<int8_t, ROUTE_SLOTS> build_routes() {
+
+    array<int8_t, ROUTE_SLOTS> slots{};
+    for (size_t i = 0; i < ROUTE_SLOTS; i++) slots[i] = -1;
+
+    for (size_t i = 0; i < size(ROUTES); i++) {
+        size_t slot = route_slot(ROUTES[i].opcode);
+        while (slots[slot] != -1) slot = (slot + 1) % ROUTE_SLOTS;
+        slots[slot] = (int8_t) i;
+    }
+
+    return slots;
+
+}
+
+static constexpr array<int8_t, ROUTE_SLOTS> ROUTE_TABLE = build_routes();
+
+
+/**
+ * @brief Finds how requests with a certain opcode are served.
+ *
+ * @param opcode packed opcode
+ *
+ * @return route or nullptr if the opcode is unknown
+ */
+static const Route* find_route(uint32_t opcode) {
+
+    for (size_t slot = route_slot(opcode); ROUTE_TABLE[slot] != -1; slot = (slot + 1) % ROUTE_SLOTS) {
+        if (ROUTES[ROUTE_TABLE[slot]].opcode == opcode) return &ROUTES[ROUTE_TABLE[slot]];
+    }
+
+    return nullptr;
+
+}
+
+
+/**
+ * @brief Builds the layout of a dialect's requests. Classic requests can't go past what their fields hold,
+ * even if the server allows more.
+ *
+ * @param dialect dialect of the requests
+ * @param limits how far users, groups and messages may go
+ *
+ * @return format
+ */
+static Format make_format(Dialect dialect, const Limits& limits) {
+
+    if (dialect == DIALECT_CLASSIC) {
+        return {DIALECT_CLASSIC, "", UID_SIZE, UID_SIZE, GID_SIZE, MID_SIZE, TEXT_SIZE_SIZE,
+                min(limits.users, (uint32_t) USER_LIMIT), min(limits.groups, (uint32_t) GROUP_LIMIT),
+                min(limits.messages, (uint32_t) MID_LIMIT), min(limits.text, (uint32_t) TEXT_MAX_SIZE)};
+    }
+
+    return {DIALECT_EXTENDED, "X", 1, EXT_ID_SIZE, EXT_ID_SIZE, EXT_ID_SIZE, EXT_TEXT_SIZE_SIZE,
+            limits.users, limits.groups, limits.messages, limits.text};
+
+}
+
 
 /**
  * @brief Manager class constructor.
  *
- * @param users map of user currently in the server
- * @param groups map of groups registered in the server
+ * @param users table of users currently in the server
+ * @param groups table of groups registered in the server
  * @param connect module for connecting with clients
  * @param isVerbose checks if server is being ran in verbose mode
+ * @param lock guards users and groups
+ * @param limits how far users, groups and messages may go
+ * @param journal where changes are kept on disk, nullptr if they are only kept in memory
+ * @param snapshot where the journal is compacted to, nullptr if changes are only kept in memory
+ * @param attachments where files posted with messages are kept
  */
-Manager::Manager(unordered_map<string, User>* users, unordered_map<string, Group>* groups,
-                 Connect& connect, bool isVerbose) : _connect(connect) {
+Manager::Manager(UserTable* users, GroupTable* groups, Connect& connect, bool isVerbose, mutex* lock,
+                 const Limits& limits, Journal* journal, Snapshot* snapshot, AttachmentStore* attachments)
+                 : _connect(connect) {
     this->_users = users;
     this->_groups = groups;
     this->_isVerbose = isVerbose;
+    this->_lock = lock;
+    this->_journal = journal;
+    this->_snapshot = snapshot;
+    this->_attachments = attachments;
+    this->_formats[DIALECT_CLASSIC] = make_format(DIALECT_CLASSIC, limits);
+    this->_formats[DIALECT_EXTENDED] = make_format(DIALECT_EXTENDED, limits);
+    this->_format = &this->_formats[DIALECT_CLASSIC];
+
+    /* Longest request is a post with the longest text the extended dialect allows */
+    this->_connect.setRequestLimit(MAX_REQUEST_SIZE + limits.text);
 }
 
 
 /**
- * @brief Starts main server loop.
+ * @brief Starts main server loop, which runs until the server is told to stop.
+ *
+ * @param stop_fd descriptor that becomes readable when the server has to stop
  */
-void Manager::start_server() {
+void Manager::start_server(int stop_fd) {
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    bool running = true;
+
+    /* Stop event is never read, so every event loop sees it */
+    this->getConnection()->watchStop(stop_fd);
 
     /* Inits server connection loop */
-    while (true) {
+    while (running) {
+
+        /* Blocks until some of the watched sockets have something for us. Returns number of ready sockets */
+        int counter = this->getConnection()->waitEvents(events, EPOLL_MAX_EVENTS);
+
+        for (int i = 0; i < counter; i++) {
+
+            int fd = events[i].data.fd;
 
-        /* Adds file descriptors to watcher */
-        FD_ZERO(this->getConnection()->getFDS());
-        FD_SET(this->getConnection()->getSocketUDP(), this->getConnection()->getFDS());
-        FD_SET(this->getConnection()->getSocketTCP(), this->getConnection()->getFDS());
+            /* Server has to stop, once the events it already got are handled */
+            if (fd == stop_fd) {
+                running = false;
 
-        /* Blocks until one of the descriptors, previously set in are ready to by read. Returns number of file descriptors ready */
-        uint8_t counter = select(this->getConnection()->getSocketTCP() + 1,this->getConnection()->getFDS(),
-                                 (fd_set*) nullptr,(fd_set*) nullptr,(struct timeval *) nullptr);
-        assert_(counter > 0, "Select threw an error")
+            /* Checks if udp socket activated */
+            } else if (fd == this->getConnection()->getSocketUDP()) {
+                this->handle_udp();
 
-        /* Cleans previous iteration so that it does not bug */
-        this->getConnection()->cleanAddr();
+            /* Checks if tcp socket activated, which means that there are new connections */
+            } else if (fd == this->getConnection()->getSocketTCP()) {
+                this->handle_accept();
 
-        /* Checks if udp socket activated */
-        if (FD_ISSET(this->getConnection()->getSocketUDP(), this->getConnection()->getFDS())) {
+            /* Otherwise, one of the open connections activated */
+            } else {
+                Session* session = this->getConnection()->getSession(fd);
+                if (session != nullptr) this->handle_session(session, events[i].events);
+            }
 
-            /* Receives message from client */
-            string request = this->getConnection()->receiveByUDP();
+        }
+
+    }
 
-            /* Process client's message and decides what to do with it based on the passed code */
-            string response = this->process_request(request);
+}
+
+
+/**
+ * @brief Starts main server loop using io_uring instead of epoll, which runs until the server is told to stop.
+ *
+ * @param stop_fd descriptor that becomes readable when the server has to stop
+ */
+void Manager::start_server_uring(int stop_fd) {
+
+    Uring ring(URING_ENTRIES);
+    unordered_map<int, unique_ptr<UringConnection>> connections;
+    vector<UringDatagram> datagrams(URING_UDP_SLOTS);
+    vector<UringDatagram*> answered;
+
+    /* A single accept is kept in flight and submitted again every time it completes */
+    struct sockaddr_in accept_addr{};
+    socklen_t accept_addrlen;
+    UringOp accept_op{URING_ACCEPT, this->getConnection()->getSocketTCP(), nullptr};
+    auto submit_accept = [&]() {
+        accept_addrlen = sizeof accept_addr;
+        struct io_uring_sqe* sqe = ring.getSQE(&accept_op);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = accept_op.fd;
+        sqe->addr = (unsigned long long) &accept_addr;
+        sqe->addr2 = (unsigned long long) &accept_addrlen;
+        sqe->accept_flags = SOCK_CLOEXEC;
+    };
+
+    /* Closes a connection whose operation failed */
+    auto drop = [&](UringConnection* connection) {
+        int fd = connection->session->getSocket();
+        this->getConnection()->closeSession(connection->session);
+        connections.erase(fd);
+    };
+
+    /* Stop event is never read, so every event loop sees it */
+    UringOp stop_op{URING_STOP, stop_fd, nullptr};
+    struct io_uring_sqe* stop_sqe = ring.getSQE(&stop_op);
+    stop_sqe->opcode = IORING_OP_POLL_ADD;
+    stop_sqe->fd = stop_fd;
+    stop_sqe->poll32_events = POLLIN;
+    bool running = true;
+
+    submit_accept();
+    for (auto& datagram: datagrams) this->receive_uring(ring, &datagram);
+
+    /* Inits server connection loop. Everything prepared in an iteration is submitted with a single call */
+    while (running) {
+
+        ring.submitAndWait();
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring.peekCQE()) != nullptr) {
+
+            auto* op = (UringOp*) cqe->user_data;
+            int res = cqe->res;
+            ring.seenCQE();
+
+            switch (op->type) {
+
+                /* Server has to stop, once the completions it already got are handled */
+                case URING_STOP:
+                    running = false;
+                    break;
+
+                /* New tcp connection */
+                case URING_ACCEPT: {
+                    if (res >= 0) {
+                        unique_ptr<UringConnection> connection(new UringConnection);
+                        connection->session = this->getConnection()->addSession(res, accept_addr);
+                        connection->op = {URING_RECV, res, connection.get()};
+                        UringConnection* ptr = connection.get();
+                        connections[res] = move(connection);
+                        if (!this->advance_uring(ring, ptr)) connections.erase(res);
+                    }
+                    submit_accept();
+                    break;
+                }
+
+                /* Udp request arrived, so we answer it right away. Response is sent at the end of the iteration */
+                case URING_UDP_RECV: {
+                    auto* datagram = (UringDatagram*) op->owner;
+                    if (res <= 0) { this->receive_uring(ring, datagram); break; }
+
+                    /* Removes \n at the end of the buffer. Makes things easier down the line */
+                    datagram->buffer[res] = '\0';
+                    if (datagram->buffer[res - 1] == '\n') datagram->buffer[res - 1] = '\0';
+
+                    this->getConnection()->setClientIP(inet_ntoa(datagram->addr.sin_addr));
+                    this->getConnection()->setClientPort(to_string(ntohs(datagram->addr.sin_port)));
+                    datagram->response = this->process_request(datagram->buffer, TRANSPORT_UDP);
+                    answered.push_back(datagram);
+                    break;
+                }
+
+                /* Response was sent, so the slot can take another request */
+                case URING_UDP_SEND:
+                    this->receive_uring(ring, (UringDatagram*) op->owner);
+                    break;
+
+                /* Tcp connection operations */
+                default: {
+                    auto* connection = (UringConnection*) op->owner;
+                    Session* session = connection->session;
+
+                    /* Client closed its side of the connection, which still gets what it already asked for */
+                    if (op->type == URING_RECV && res == 0) {
+                        if (!session->endInput()) { drop(connection); break; }
+                    } else if (res < 0 || (res == 0 && op->type != URING_FILE_WRITE)) {
+                        drop(connection);
+                        break;
+                    }
+
+                    if (op->type == URING_RECV) session->append(connection->buffer, res);
+                    else if (op->type == URING_FILE_WRITE) session->fileWritten(res);
+                    else if (op->type == URING_FILE_READ) session->stageChunk(connection->buffer, res);
+                    else if (op->type == URING_SEND) session->sent(res);
+
+                    if (!this->advance_uring(ring, connection)) connections.erase(op->fd);
+                    break;
+                }
+
+            }
 
-            /* Sends response back to client */
-            this->getConnection()->replyByUDP(response);
+        }
 
-        /* Checks if tcp socket activated */
-        } else if (FD_ISSET(this->getConnection()->getSocketTCP(), this->getConnection()->getFDS())) {
+        /* Udp responses of this iteration go out together, once what they depend on is on disk */
+        if (!answered.empty()) this->commit();
+        for (UringDatagram* datagram: answered) {
+            datagram->op.type = URING_UDP_SEND;
+            datagram->iov = {(void*) datagram->response.data(), datagram->response.size()};
+            datagram->msg.msg_namelen = sizeof datagram->addr;
+            struct io_uring_sqe* sqe = ring.getSQE(&datagram->op);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = datagram->op.fd;
+            sqe->addr = (unsigned long long) &datagram->msg;
+        }
+        answered.clear();
 
-            string request = this->getConnection()->receiveByTCP();
+    }
 
-            /* Process client's message and decides what to do with it based on the passed code */
-            string response = this->process_request(request);
+    ring.clean();
 
-            /* Sends response back to client */
-            this->getConnection()->replyByTCP(response);
+}
 
-            /* Closes file descriptor to avoid errors */
-            close(this->getConnection()->getSocketTmpTCP());
 
-        } else {
-            assert_(false, "No correct file descriptor was activated in select")
+/**
+ * @brief Submits the next operation needed to move a tcp connection forward, closing it when
+ * everything was sent.
+ *
+ * @param ring io_uring instance
+ * @param connection connection that is going to be moved forward
+ *
+ * @return false if the connection was closed
+ */
+bool Manager::advance_uring(Uring& ring, UringConnection* connection) {
+
+    Session* session = connection->session;
+    struct io_uring_sqe* sqe;
+    string_view request;
+
+    /* Consumes every complete request that we already have */
+    while (session->getState() == SESSION_READING && session->nextRequest(request)) {
+        if (!this->serve_session(session, request)) {
+            this->commit();
+            this->getConnection()->closeSession(session);
+            return false;
+        }
+    }
+    this->commit();
+
+    /* Writes to disk the file data that we already have */
+    if (session->getState() == SESSION_RECEIVING_FILE) {
+
+        const char* data;
+        size_t n = session->pendingFileData(&data);
+
+        if (n > 0 && session->getFileDescriptor() != -1) {
+            connection->op.type = URING_FILE_WRITE;
+            sqe = ring.getSQE(&connection->op);
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = session->getFileDescriptor();
+            sqe->addr = (unsigned long long) data;
+            sqe->len = n;
+            sqe->off = session->getFileOffset();
+            return true;
+        }
+
+        session->fileWritten(n);
+
+    }
+
+    /* File that could not be stored drops the upload along with the connection */
+    if (session->hasFailed()) {
+        this->getConnection()->closeSession(session);
+        return false;
+    }
+
+    /* Sends the responses one segment at a time. Persistent connections send them while reading */
+    if (session->getState() == SESSION_WRITING || (session->isPersistent() && !session->isFlushed())) {
+
+        /* Compressed files are decompressed a block at a time, right before the block is sent */
+        Segment* segment;
+        while ((segment = session->frontSegment()) != nullptr && segment->fd != -1) {
+            if (segment->length <= 0) {
+                session->popSegment();
+            } else if (!segment->compressed) {
+                break;
+            } else if (!session->stageBlock()) {
+                this->getConnection()->closeSession(session);
+                return false;
+            }
+        }
+
+        /* Unless the client asked to keep the connection, it only carries one request */
+        if (segment == nullptr && (!session->isPersistent() || session->isEnded())) {
+            this->getConnection()->closeSession(session);
+            return false;
+        }
+
+        /* Files are read chunk by chunk into the connection's buffer before being sent */
+        if (segment != nullptr && segment->fd != -1) {
+            connection->op.type = URING_FILE_READ;
+            sqe = ring.getSQE(&connection->op);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = segment->fd;
+            sqe->addr = (unsigned long long) connection->buffer;
+            sqe->len = min((long) SESSION_READ_SIZE, segment->length);
+            sqe->off = segment->offset;
+            return true;
+        } else if (segment != nullptr) {
+
+            /* Every segment up to the next file goes in a single send */
+            bool more;
+            memset(&connection->msg, 0, sizeof connection->msg);
+            connection->msg.msg_iov = connection->iov;
+            connection->msg.msg_iovlen = session->gather(connection->iov, &more);
+
+            connection->op.type = URING_SEND;
+            sqe = ring.getSQE(&connection->op);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = session->getSocket();
+            sqe->addr = (unsigned long long) &connection->msg;
+            sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+            return true;
+
+        }
+
+    }
+
+    /* Waits for more data from the client */
+    connection->op.type = URING_RECV;
+    sqe = ring.getSQE(&connection->op);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = session->getSocket();
+    sqe->addr = (unsigned long long) connection->buffer;
+    sqe->len = SESSION_READ_SIZE;
+
+    return true;
+
+}
+
+
+/**
+ * @brief Submits a receive for a udp request.
+ *
+ * @param ring io_uring instance
+ * @param datagram slot where the request is going to be received
+ */
+void Manager::receive_uring(Uring& ring, UringDatagram* datagram) {
+
+    datagram->op = {URING_UDP_RECV, this->getConnection()->getSocketUDP(), datagram};
+    datagram->iov = {datagram->buffer, MAX_REQUEST_SIZE};
+    memset(&datagram->msg, 0, sizeof datagram->msg);
+    datagram->msg.msg_name = &datagram->addr;
+    datagram->msg.msg_namelen = sizeof datagram->addr;
+    datagram->msg.msg_iov = &datagram->iov;
+    datagram->msg.msg_iovlen = 1;
+
+    struct io_uring_sqe* sqe = ring.getSQE(&datagram->op);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = datagram->op.fd;
+    sqe->addr = (unsigned long long) &datagram->msg;
+
+}
+
+
+/**
+ * @brief Answers every request waiting in the udp socket.
+ */
+void Manager::handle_udp() {
+
+    vector<string_view> requests;
+    vector<string> responses;
+    int n;
+
+    /* Socket is edge-triggered, so we need to empty it before waiting again. A batch that is not full
+     * means that it is already empty */
+    do {
+
+        n = this->getConnection()->receiveByUDP(requests);
+        responses.resize(n);
+
+        /* Process clients' messages and decides what to do with them based on the passed codes */
+        for (int i = 0; i < n; i++) {
+            this->getConnection()->setClientUDP(i);
+            responses[i] = this->process_request(requests[i], TRANSPORT_UDP);
+        }
+
+        /* Sends responses back to clients, once the whole batch's changes are on disk */
+        if (n > 0) {
+            this->commit();
+            this->getConnection()->replyByUDP(responses);
+        }
+
+    } while (n == UDP_BATCH_SIZE);
+
+}
+
+
+/**
+ * @brief Accepts every pending tcp connection.
+ */
+void Manager::handle_accept() {
+    while (this->getConnection()->acceptByTCP() != nullptr);
+}
+
+
+/**
+ * @brief Moves a tcp connection forward as far as it can go without blocking.
+ *
+ * @param session connection that activated
+ * @param events epoll events that were triggered
+ */
+void Manager::handle_session(Session* session, uint32_t events) {
+
+    /* Client sent us something or closed the connection */
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !this->read_session(session)) {
+        this->getConnection()->closeSession(session);
+        return;
+    }
+
+    /* Sends responses. Persistent connections send them while reading the next requests */
+    if (session->getState() == SESSION_WRITING || session->isPersistent()) {
+
+        this->commit();
+
+        /* Unless the client asked to keep the connection, it only carries one request. Either way, it is closed
+         * once the client has nothing else to send and got every response */
+        if (!session->flush() || ((!session->isPersistent() || session->isEnded()) && session->isFlushed())) {
+            this->getConnection()->closeSession(session);
+        }
+
+    }
+
+}
+
+
+/**
+ * @brief Reads everything that is available in a tcp connection and processes it.
+ *
+ * @param session connection that is going to be read
+ *
+ * @return false if the connection failed, a file could not be stored or the client closed it in the middle
+ * of a request
+ */
+bool Manager::read_session(Session* session) {
+
+    string_view request;
+
+    while (true) {
+
+        /* Consumes everything we already have before going back to the socket */
+        if (session->getState() == SESSION_READING && session->nextRequest(request)) {
+            if (!this->serve_session(session, request)) return false;
+            continue;
+        }
+        if (session->getState() == SESSION_RECEIVING_FILE) {
+            session->consumeFile();
+            if (session->hasFailed()) return false;
+
+            /* Requests that came right after the file may already be here */
+            if (session->getState() == SESSION_READING) continue;
         }
+        if (session->getState() == SESSION_WRITING) return true;
+
+        /* Socket is edge-triggered, so we read until it is empty. Rest of an attached file goes straight from
+         * the socket to disk */
+        ssize_t n = session->getState() == SESSION_RECEIVING_FILE ? session->spliceFile() : session->receive();
+        if (n == 0) return session->endInput();
+        if (n == -1) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+    }
 
+}
+
+
+/**
+ * @brief Processes a request received in a tcp connection and queues its response.
+ *
+ * @param session connection where the request came from
+ * @param request client's request
+ *
+ * @return false if the response could not be put together, in which case the connection has to be closed
+ */
+bool Manager::serve_session(Session* session, string_view request) {
+
+    /* Everything sent from now on goes to this connection */
+    this->getConnection()->setCurrentSession(session);
+    this->getConnection()->setClientIP(session->getClientIP());
+    this->getConnection()->setClientPort(session->getClientPort());
+
+    /* Client wants to send more requests through this connection. Responses are sent in order */
+    if (request == "PIP") {
+        session->setPersistent();
+        this->getConnection()->replyByTCP("RIP OK\n");
+        return true;
+    }
+
+    /* Process client's message and decides what to do with it based on the passed code */
+    string response = this->process_request(request, TRANSPORT_TCP);
+
+    /* Response that is missing a file can't be finished, and the client would read it as something else */
+    if (session->hasFailed()) return false;
+
+    /* Queues response to be sent back to client */
+    this->getConnection()->replyByTCP(response);
+
+    /* Unless we are still waiting for an attached file, we are done with this request */
+    if (session->getState() == SESSION_READING) session->requestDone();
+    return true;
+
+}
+
+
+/**
+ * @brief Makes sure that the changes behind the responses about to be sent are on disk.
+ */
+void Manager::commit() {
+    if (this->_journal != nullptr) this->_journal->commit();
+}
+
+
+/**
+ * @brief Starts a snapshot of every user and group, which the journal starts over from. Users and groups
+ * must be locked.
+ */
+void Manager::checkpoint() {
+
+    /* Last snapshot failed, so the journal it left sealed goes into a snapshot taken right here */
+    if (this->_journal->hasSealed()) {
+        this->_journal->rotate(this->_snapshot->take(this->getUsers(), this->getGroups()));
+        this->_journal->dropSealed();
+        verbose_(this->getVerbose(), "Snapshot " + to_string(this->_snapshot->getGeneration()) + " taken")
+        return;
     }
 
+    /* Changes from now on go to a new journal, while a copy of the server writes everything up to here */
+    this->_journal->seal(this->_snapshot->getGeneration() + 1);
+    this->_snapshot->start(this->getUsers(), this->getGroups());
+    verbose_(this->getVerbose(), "Snapshot started: " + this->_snapshot->getStatus())
+
 }
 
 
@@ -82,31 +657,56 @@ void Manager::clean() {
 
 
 /**
- * @brief Receives user request, process it and creates a request to be sent back.
+ * @brief Receives user request, routes it to its handler and creates a response to be sent back.
  *
  * @param request user request
+ * @param transport how the request reached the server
  *
- * @return server's response
+ * @return server's response, ERR if the request is unknown or came through the wrong transport
  */
-string Manager::process_request(const string& request) {
+string Manager::process_request(string_view request, Transport transport) {
+
+    /* Extracts requested command. Handlers go on reading the rest of the fields from where it stopped */
+    Tokenizer tokens(request);
+    const Route* route = find_route(pack_opcode(tokens.next()));
+
+    /* Unknown opcodes, opcodes sent through the wrong transport and requests that are clearly missing fields
+     * are refused before touching anything */
+    if (route == nullptr || route->transport != transport || count(request.begin(), request.end(), ' ') < route->arity) {
+        verbose_(this->getVerbose(), "Invalid request")
+        return "ERR\n";
+    }
+
+    /* Users and groups may be shared with other Managers running at the same time */
+    lock_guard<mutex> guard(*this->_lock);
 
-    /* Extracts requested command */
-    string cmd = get_command(request);
+    /* Once a snapshot is complete, the journal it replaces is no longer needed */
+    if (this->_snapshot != nullptr && this->_snapshot->poll()) this->_journal->dropSealed();
 
-    /* Verifies if the user requested a valid command */
-    if (cmd == "REG") return this->doRegister(request);
-    else if (cmd == "UNR") return this->doUnregister(request);
-    else if (cmd == "LOG") return this->doLogin(request);
-    else if (cmd == "OUT") return this->doLogout(request);
-    else if (cmd == "GLS") return this->doListGroups(request);
-    else if (cmd == "GSR") return this->doSubscribe(request);
-    else if (cmd == "GUR") return this->doUnsubscribe(request);
-    else if (cmd == "GLM") return this->doMyGroups(request);
-    else if (cmd == "ULS") return this->doUserList(request);
-    else if (cmd == "PST") return this->doPost(request);
-    else if (cmd == "RTV") return this->doRetrieve(request);
-    else cout << "Invalid command" << endl;
+    this->_format = &this->_formats[route->dialect];
+    string response = (this->*route->handler)(tokens);
 
+    /* Journal grew too long to be replayed quickly, so it is compacted before anything else changes */
+    if (this->_snapshot != nullptr && this->_snapshot->isDue(this->_journal->size())) this->checkpoint();
+
+    return response;
+
+}
+
+
+/**
+ * @brief Builds a response in the dialect of the request being served.
+ *
+ * @param opcode response's opcode
+ * @param status response's fields
+ *
+ * @return response
+ */
+string Manager::reply(string_view opcode, string_view status) const {
+    string response;
+    response.reserve(this->_format->prefix.size() + opcode.size() + status.size() + 2);
+    response.append(this->_format->prefix).append(opcode).append(" ").append(status).append("\n");
+    return response;
 }
 
 
@@ -115,7 +715,7 @@ string Manager::process_request(const string& request) {
  *
  * @return server's users.
  */
-unordered_map<string, User>* Manager::getUsers() {
+UserTable* Manager::getUsers() {
     return this->_users;
 }
 
@@ -125,7 +725,7 @@ unordered_map<string, User>* Manager::getUsers() {
  *
  * @return server's groups.
  */
-unordered_map<string, Group>* Manager::getGroups() {
+GroupTable* Manager::getGroups() {
     return this->_groups;
 }
 
@@ -153,24 +753,25 @@ bool Manager::getVerbose() const {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
-string Manager::doRegister(const string& input) {
+string Manager::doRegister(Tokenizer& request) {
 
-
-    /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string pass(request.alphanumeric(PASSWORD_SIZE, PASSWORD_SIZE));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | IP: " + this->getConnection()->getClientIP() +
+    verbose_(this->getVerbose(), "UID: " + uid + " | IP: " + this->getConnection()->getClientIP() +
         " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = register_user(this->getUsers(), inputs[1], inputs[2]);
-    return "RRG " + status + "\n";
+    string status = register_user(this->getUsers(), Tokenizer::toNumber(uid), pass, *this->_format);
+    if (this->_journal != nullptr && status == "OK") this->_journal->registered(Tokenizer::toNumber(uid), pass);
+    return this->reply("RRG", status);
 
 }
 
@@ -178,23 +779,25 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doUnregister(const string& input) {
+string Manager::doUnregister(Tokenizer& request) {
 
-    /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string pass(request.alphanumeric(PASSWORD_SIZE, PASSWORD_SIZE));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | IP: " + this->getConnection()->getClientIP() +
+    verbose_(this->getVerbose(), "UID: " + uid + " | IP: " + this->getConnection()->getClientIP() +
                                  " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = unregister_user(this->getUsers(), this->getGroups(), inputs[1], inputs[2]);
-    return "RUN " + status + "\n";
+    string status = unregister_user(this->getUsers(), this->getGroups(), Tokenizer::toNumber(uid), pass);
+    if (this->_journal != nullptr && status == "OK") this->_journal->unregistered(Tokenizer::toNumber(uid));
+    return this->reply("RUN", status);
 
 }
 
@@ -202,23 +805,24 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doLogin(const string& input) {
+string Manager::doLogin(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string pass(request.alphanumeric(PASSWORD_SIZE, PASSWORD_SIZE));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | IP: " + this->getConnection()->getClientIP() +
+    verbose_(this->getVerbose(), "UID: " + uid + " | IP: " + this->getConnection()->getClientIP() +
                                  " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = login_user(this->getUsers(), inputs[1], inputs[2]);
-    return "RLO " + status + "\n";
+    string status = login_user(this->getUsers(), Tokenizer::toNumber(uid), pass);
+    return this->reply("RLO", status);
 
 }
 
@@ -226,23 +830,24 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doLogout(const string& input) {
+string Manager::doLogout(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string pass(request.alphanumeric(PASSWORD_SIZE, PASSWORD_SIZE));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | IP: " + this->getConnection()->getClientIP() +
+    verbose_(this->getVerbose(), "UID: " + uid + " | IP: " + this->getConnection()->getClientIP() +
                                  " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = logout_user(this->getUsers(), inputs[1] , inputs[2]);
-    return "ROU " + status + "\n";
+    string status = logout_user(this->getUsers(), Tokenizer::toNumber(uid), pass);
+    return this->reply("ROU", status);
 
 }
 
@@ -250,28 +855,21 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doListGroups(const string& input) {
+string Manager::doListGroups(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Request has no fields */
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
     verbose_(this->getVerbose(), "IP: " + this->getConnection()->getClientIP() + " | PORT: " +
         this->getConnection()->getClientPort())
 
-    /* Calls api to process command and send back a status to be then sent to the client */
-    string status = list_groups(this->getGroups());
-    if (this->getGroups()->empty()) {
-        return "RGL " + to_string(this->getGroups()->size()) + status + "\n";
-    }
-    else{
-        return "RGL " + to_string(this->getGroups()->size()) + " " + status + "\n";
-    }
+    /* Response is kept ready by the api, so it is only copied into the reply */
+    return list_groups(this->getGroups(), *this->_format);
 
 }
 
@@ -279,23 +877,34 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doSubscribe(const string& input) {
+string Manager::doSubscribe(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string gid(request.number(1, this->_format->gid_size, UINT32_MAX));
+    string group_name(request.alphanumeric(1, GROUP_NAME_MAX_SIZE, "-_"));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | GID: " + inputs[2] + " | IP: " +
+    verbose_(this->getVerbose(), "UID: " + uid + " | GID: " + gid + " | IP: " +
         this->getConnection()->getClientIP() + " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = subscribe(this->getGroups(), this->getUsers(), inputs[1], inputs[2], inputs[3]);
-    return "RGS " + status + "\n";
+    string status = subscribe(this->getGroups(), this->getUsers(), Tokenizer::toNumber(uid), Tokenizer::toNumber(gid), group_name,
+                              *this->_format);
+
+    /* A new group is kept before its first subscriber */
+    if (this->_journal != nullptr && (status == "OK" || status == "NEW")) {
+        uint32_t created = (uint32_t) this->getGroups()->size();
+        if (status == "NEW") this->_journal->groupCreated(created, group_name);
+        this->_journal->subscribed(Tokenizer::toNumber(uid), status == "NEW" ? created : Tokenizer::toNumber(gid));
+    }
+
+    return this->reply("RGS", status);
 
 }
 
@@ -303,23 +912,27 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doUnsubscribe(const string& input) {
+string Manager::doUnsubscribe(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string gid(request.number(1, this->_format->gid_size, UINT32_MAX));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | GID: " + inputs[2] + " | IP: " +
+    verbose_(this->getVerbose(), "UID: " + uid + " | GID: " + gid + " | IP: " +
         this->getConnection()->getClientIP() + " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = unsubscribe(this->getGroups(), this->getUsers(), inputs[1], inputs[2]);
-    return "RGU " + status + "\n";
+    string status = unsubscribe(this->getGroups(), this->getUsers(), Tokenizer::toNumber(uid), Tokenizer::toNumber(gid));
+    if (this->_journal != nullptr && status == "OK") {
+        this->_journal->unsubscribed(Tokenizer::toNumber(uid), Tokenizer::toNumber(gid));
+    }
+    return this->reply("RGU", status);
 
 }
 
@@ -327,23 +940,23 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doMyGroups(const string& input) {
+string Manager::doMyGroups(Tokenizer& request) {
 
-     /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | IP: " + this->getConnection()->getClientIP() +
+    verbose_(this->getVerbose(), "UID: " + uid + " | IP: " + this->getConnection()->getClientIP() +
         " | PORT: " + this->getConnection()->getClientPort())
 
     /* Calls api to process command and send back a status to be then sent to the client */
-    string status = groups_subscribed(this->getGroups(), this->getUsers(), inputs[1]);
-    return "RGM " + status + "\n";
+    string status = groups_subscribed(this->getGroups(), this->getUsers(), Tokenizer::toNumber(uid), *this->_format);
+    return this->reply("RGM", status);
 
 }
 
@@ -351,22 +964,22 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doUserList(const string& input) {
+string Manager::doUserList(Tokenizer& request) {
 
-    /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Gets and validates every field of the request */
+    string gid(request.number(1, this->_format->gid_size, UINT32_MAX));
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | GID: " + inputs[2] + " | IP: " +
-        this->getConnection()->getClientIP() + " | PORT: " + this->getConnection()->getClientPort())
+    verbose_(this->getVerbose(), "GID: " + gid + " | IP: " + this->getConnection()->getClientIP() +
+        " | PORT: " + this->getConnection()->getClientPort())
 
-    string status = users_subscribed(this->getGroups(), inputs[1].c_str());
-    return "RUL " + status + "\n";
+    string status = users_subscribed(this->getGroups(), Tokenizer::toNumber(gid), *this->_format);
+    return this->reply("RUL", status);
 
 }
 
@@ -374,43 +987,67 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doPost(const string& input) {
+string Manager::doPost(Tokenizer& request) {
+
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string gid(request.number(1, this->_format->gid_size, UINT32_MAX));
+    string_view text_size = request.digits(1, this->_format->text_size_size);
+    string_view text = request.text(this->_format->text_limit);
+    bool ends_with_text = request.done();
+
+    /* File is optional */
+    string_view file_name, file_size;
+    if (request.hasNext()) {
+        file_name = request.alphanumeric(1, FILENAME_MAX_SIZE, "-_.");
+        file_size = request.digits(1, FILE_SIZE_MAX_DIGITS);
+    }
 
-    /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+    /* Declared size has to match the text that was sent. A file the request announced follows it anyway, so it is
+     * skipped, or the connection is closed after the response if its size is unknown, instead of being read as
+     * more requests */
+    if (!request.done() || Tokenizer::toNumber(text_size) != (long) text.size()) {
+        if (!file_size.empty()) {
+            this->getConnection()->receiveByTCPWithFile(nullptr, "", Tokenizer::toNumber(file_size));
+        } else if (!ends_with_text) {
+            this->getConnection()->getCurrentSession()->endInput();
+        }
+        return "ERR\n";
+    }
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | GID: " + inputs[2] + " | IP: " +
+    verbose_(this->getVerbose(), "UID: " + uid + " | GID: " + gid + " | IP: " +
         this->getConnection()->getClientIP() + " | PORT: " + this->getConnection()->getClientPort())
 
-    char text[TEXT_MAX_SIZE];  /* Will hold user input text */
-    char file_name[FILENAME_MAX_SIZE]; /* Will hold the input file */
-    string file;  /* Will hold the input file */
-    memset(text, 0, TEXT_MAX_SIZE);
-    memset(file_name, 0, FILENAME_MAX_SIZE);
-    int checker = 0;  /* Used to check if the user did not input a file */
-    int file_size;
     string status;
 
-    /* Gets text and checks if  */
-    sscanf(input.c_str(), R"(%*s %*s %*s %*s "%240[^"]" %n)", text, &checker);
-
-    /* Checks if user input any files and acts accordingly */
-    if (checker == 0 || input[checker] != '\0') {
-        sscanf(input.c_str(), R"(%*s %*s %*s %*s "%240[^"]" %s %d)", text, file_name, &file_size);
-        status = post_message(this->getGroups(), this->getUsers(), inputs[1], inputs[2], inputs[3], text,
-                              file_name, to_string(file_size));
-        this->getConnection()->receiveByTCPWithFile(file_name, file_size);
+    /* Checks if user input any files and acts accordingly. File is kept under the message it was posted with,
+     * so it is only kept if the message was posted */
+    if (!file_name.empty()) {
+        status = post_message(this->getGroups(), this->getUsers(), Tokenizer::toNumber(uid), Tokenizer::toNumber(gid), text,
+                              *this->_format, file_name, Tokenizer::toNumber(file_size));
+        if (status != "NOK") {
+            string path = this->_attachments->getPath(Tokenizer::toNumber(gid), Tokenizer::toNumber(status));
+            this->getConnection()->receiveByTCPWithFile(this->_attachments, path, Tokenizer::toNumber(file_size));
+        } else {
+            this->getConnection()->receiveByTCPWithFile(nullptr, "", Tokenizer::toNumber(file_size));
+        }
     } else {
-        status = post_message(this->getGroups(), this->getUsers(), inputs[1], inputs[2], inputs[3], text);
+        status = post_message(this->getGroups(), this->getUsers(), Tokenizer::toNumber(uid), Tokenizer::toNumber(gid), text,
+                              *this->_format);
     }
 
-    return "RPT " + status + "\n";
+    /* Anything but NOK is the id of the posted message */
+    if (this->_journal != nullptr && status != "NOK") {
+        this->_journal->posted(Tokenizer::toNumber(uid), Tokenizer::toNumber(gid), text, file_name,
+                               file_name.empty() ? 0 : Tokenizer::toNumber(file_size));
+    }
+
+    return this->reply("RPT", status);
 
 }
 
@@ -418,81 +1055,116 @@ string Manager::doRegister(const string& input) {
 /**
  * @brief Receives request from client, processes it and returns a response.
  *
- * @param input user input command
+ * @param request client's request, whose opcode was already read
  *
  * @return response to be sent back to the client
  */
- string Manager::doRetrieve(const string& input) {
-
-    /* Splits input by the spaces and returns an array with everything */
-    vector<string> inputs;
-    split(input, inputs);
+string Manager::doRetrieve(Tokenizer& request) {
 
-    /* Auxiliary buffer */
-    char buffer[MAX_REQUEST_SIZE];
-    memset(buffer, 0, MAX_REQUEST_SIZE);
+    /* Gets and validates every field of the request */
+    string uid(request.number(this->_format->uid_min_size, this->_format->uid_size, UINT32_MAX));
+    string gid(request.number(1, this->_format->gid_size, UINT32_MAX));
+    string_view mid = request.number(1, this->_format->mid_size, UINT32_MAX);
+    if (!request.done()) return "ERR\n";
 
     /* If server is in verbose mode, we log the client's information */
-    verbose_(this->getVerbose(), "UID: " + inputs[1] + " | GID: " + inputs[2] + " | IP: " +
+    verbose_(this->getVerbose(), "UID: " + uid + " | GID: " + gid + " | IP: " +
         this->getConnection()->getClientIP() + " | PORT: " + this->getConnection()->getClientPort())
 
-    /* Gets status and vector of messages upon success to be worked on this function */
-    vector<Message> result;
-    string status = retrieve_message(this->getGroups(), inputs[2], inputs[3], result);
+    /* Gets status and the group's messages upon success, which are read where they are stored */
+    MessageRange result;
+    string status = retrieve_message(this->getGroups(), Tokenizer::toNumber(gid), Tokenizer::toNumber(mid), result);
 
     /* If we had some kind of error, ignores loop */
-    if (status != "OK") return "RRT " + status + "\n";
+    if (status != "OK") return this->reply("RRT", status);
+
+    /* Only messages with a header in the dialect are sent, which leaves out of classic pages the ones past
+     * 4 digit ids, from users past 5 digit ids or with longer texts */
+    bool classic = this->_format->dialect == DIALECT_CLASSIC;
+    size_t count = 0, size = 0;
+    for (const Message& itr: result) {
+        size_t header = itr.getMessageHeader(classic).size();
+        if (header == 0) continue;
+        count++;
+        size += header + itr.getMessageBody().size();
+    }
+    if (count == 0) return this->reply("RRT", "EOF");
 
-    /* Inits output string */
-    string res = "RRT " + status + " " + to_string(result.size()) + "\n";
+    /* Inits output string. Records are gathered in it until a file has to be sent, so the whole page goes
+     * out in a handful of segments */
+    string res = this->reply("RRT", status + " " + to_string(count));
+    res.reserve(res.size() + size);
 
-    this->getConnection()->replyByTCP(res);  // Sends current request
-    res = "";  // Clears response to not conflict with the rest of the commands
+    /* Every message is kept as it is sent, so the page is a copy of their headers and bodies */
+    uint32_t group_id = Tokenizer::toNumber(gid);
+    for (const Message& itr: result) {
 
-    /* Mounts string to be sent to the user by reading every message and transforming it into
-     * a valid response */
-    for (auto itr: result) {
+        string_view header = itr.getMessageHeader(classic);
+        if (header.empty()) continue;
 
-        string res2;  // Response 2
+        res.append(header).append(itr.getMessageBody());
 
-        /* Creates second request */
-        res2.append(itr.getMessageId());
-        res2.append(" ");
-        res2.append(itr.getMessageUid());
-        res2.append(" ");
-        res2.append(to_string(itr.getMessageText().length()));
-        res2.append(" \"");
-        res2.append(itr.getMessageText());
-        res2.append("\"");
+        /* Without a file, the record is done */
+        if (!itr.hasFile()) continue;
 
-        /* We do this to have a way of alerting the client an attached file */
-        if (! itr.getMessageFileName().empty()) res2 += " ";
-        else res2 += "\n";
+        /* Record ends with the file's header, so everything gathered so far is queued before the file */
+        this->getConnection()->replyByTCP(res);
+        res.clear();
 
-        this->getConnection()->replyByTCP(res2);  // Sends current request
+        /* Sends file to client, straight from where it is stored for the message */
+        if (!this->getConnection()->replyByTCPWithFile(this->_attachments->getPath(group_id, itr.getMessageId()),
+                                                       itr.getMessageFileSize())) return "";
 
-        if (! itr.getMessageFileName().empty()) {  /* Checks if file is associated */
+    }
 
-            /* Appends information related to the input file */
-            res2 = "/ " + itr.getMessageFileName() + " " + itr.getMessageFileSize() + " " + "\n";
+    /* Rest of the page is sent as the response */
+    return res;
 
-            this->getConnection()->replyByTCP(res2);  // Sends current request
+}
 
-            /* Opens file to be read */
-            string file_path = string(get_current_dir_name()) + "/server/files/" + itr.getMessageFileName();
-            ifstream file(file_path, ifstream::in | ifstream::binary);
 
-            /* Sends file to client */
-            this->getConnection()->replyByTCPWithFile(file, stoi(itr.getMessageFileSize()));
+/**
+ * @brief Receives request from client, processes it and returns a response.
+ *
+ * @param request client's request, whose opcode was already read
+ *
+ * @return response to be sent back to the client
+ */
+string Manager::doCapabilities(Tokenizer& request) {
 
-            file.close();
+    /* Request has no fields */
+    if (!request.done()) return "ERR\n";
 
-        }
+    /* If server is in verbose mode, we log the client's information */
+    verbose_(this->getVerbose(), "IP: " + this->getConnection()->getClientIP() + " | PORT: " +
+        this->getConnection()->getClientPort())
 
-        res2 = "";  // Resets response
+    /* Tells the client how far the extended dialect goes in this server */
+    const Format& format = *this->_format;
+    return this->reply("RCP", to_string(format.user_limit) + " " + to_string(format.group_limit) + " " +
+                              to_string(format.mid_limit) + " " + to_string(format.text_limit));
 
-    }
+}
+
+
+/**
+ * @brief Receives request from client, processes it and returns a response.
+ *
+ * @param request client's request, whose opcode was already read
+ *
+ * @return response to be sent back to the client
+ */
+string Manager::doSnapshotStatus(Tokenizer& request) {
+
+    /* Request has no fields */
+    if (!request.done()) return "ERR\n";
+
+    /* If server is in verbose mode, we log the client's information */
+    verbose_(this->getVerbose(), "IP: " + this->getConnection()->getClientIP() + " | PORT: " +
+        this->getConnection()->getClientPort())
 
-    res += "\n";
+    /* Server that keeps nothing on disk takes no snapshots */
+    if (this->_snapshot == nullptr) return this->reply("RSN", "OFF");
+    return this->reply("RSN", this->_snapshot->getStatus());
 
 }
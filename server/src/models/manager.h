@@ -3,16 +3,36 @@
 
 #include "user.h"
 #include "../misc/helpers.h"
+#include "../misc/tokenizer.h"
 #include "group.h"
 #include "connect.h"
+#include "uring.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "attachment.h"
 #include "../api.h"
 
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <mutex>
+
+#define ROUTE_SLOT_BITS 6
+#define ROUTE_SLOTS (1 << ROUTE_SLOT_BITS)
 
 
 using namespace std;
 
 
+/**
+ * @brief Ways in which a request can reach the server.
+ */
+enum Transport {
+    TRANSPORT_UDP,  /* Request came in a datagram */
+    TRANSPORT_TCP,  /* Request came through a tcp connection */
+};
+
+
 /**
  * Manages main server routines.
  */
@@ -21,14 +41,14 @@ class Manager {
     private:
 
         /**
-         * @brief Holds all users in our server. Key is user's id.
+         * @brief Holds all users in our server. Indexed by user's id.
          */
-        unordered_map<string, User> *_users;
+        UserTable *_users;
 
         /**
-         * @brief Holds all groups in our server. Key is group's id.
+         * @brief Holds all groups in our server. Indexed by group's id.
          */
-        unordered_map<string, Group> *_groups;
+        GroupTable *_groups;
 
         /**
          * @brief Allows connecting with a client.
@@ -40,32 +60,77 @@ class Manager {
          */
         bool _isVerbose;
 
+        /**
+         * @brief Guards users and groups, which are shared by every Manager running in the server.
+         */
+        mutex* _lock;
+
+        /**
+         * @brief Keeps every change to users and groups on disk (nullptr if the server runs in memory only).
+         */
+        Journal* _journal;
+
+        /**
+         * @brief Takes snapshots once the journal grows too long (nullptr if the server runs in memory only).
+         */
+        Snapshot* _snapshot;
+
+        /**
+         * @brief Keeps the files posted with messages.
+         */
+        AttachmentStore* _attachments;
+
+        /**
+         * @brief Layout and limits of each dialect's requests.
+         */
+        Format _formats[DIALECT_COUNT];
+
+        /**
+         * @brief Format of the request being served.
+         */
+        const Format* _format;
+
+        /**
+         * @brief Builds a response in the dialect of the request being served.
+         *
+         * @param opcode response's opcode
+         * @param status response's fields
+         *
+         * @return response
+         */
+        string reply(string_view opcode, string_view status) const;
+
     public:
 
         /**
          * @brief Manager class constructor.
          *
-         * @param users map of user currently in the server
-         * @param groups map of groups registered in the server
+         * @param users table of users currently in the server
+         * @param groups table of groups registered in the server
          * @param connect module for connecting with clients
          * @param isVerbose checks if server is being ran in verbose mode
+         * @param lock guards users and groups
+         * @param limits how far users, groups and messages may go
+         * @param journal where changes are kept on disk, nullptr if they are only kept in memory
+         * @param snapshot where the journal is compacted to, nullptr if changes are only kept in memory
+         * @param attachments where files posted with messages are kept
          */
-        explicit Manager(unordered_map<string, User>* users, unordered_map<string, Group>* groups,
-                         Connect& connect, bool isVerbose);
+        explicit Manager(UserTable* users, GroupTable* groups, Connect& connect, bool isVerbose, mutex* lock,
+                         const Limits& limits, Journal* journal, Snapshot* snapshot, AttachmentStore* attachments);
 
         /**
          * @brief Gets server's users.
          *
          * @return server's users.
          */
-        unordered_map<string, User>* getUsers();
+        UserTable* getUsers();
 
         /**
          * @brief Gets server's groups.
          *
          * @return server's groups.
          */
-        unordered_map<string, Group>* getGroups();
+        GroupTable* getGroups();
 
         /**
          * @brief Gets server connection module.
@@ -82,9 +147,87 @@ class Manager {
         bool getVerbose() const;
 
         /**
-         * @brief Starts main server loop.
+         * @brief Starts main server loop, which runs until the server is told to stop.
+         *
+         * @param stop_fd descriptor that becomes readable when the server has to stop
+         */
+        void start_server(int stop_fd);
+
+        /**
+         * @brief Starts main server loop using io_uring instead of epoll, which runs until the server is told to
+         * stop.
+         *
+         * @param stop_fd descriptor that becomes readable when the server has to stop
+         */
+        void start_server_uring(int stop_fd);
+
+        /**
+         * @brief Answers every request waiting in the udp socket.
+         */
+        void handle_udp();
+
+        /**
+         * @brief Accepts every pending tcp connection.
          */
-        void start_server();
+        void handle_accept();
+
+        /**
+         * @brief Moves a tcp connection forward as far as it can go without blocking.
+         *
+         * @param session connection that activated
+         * @param events epoll events that were triggered
+         */
+        void handle_session(Session* session, uint32_t events);
+
+        /**
+         * @brief Reads everything that is available in a tcp connection and processes it.
+         *
+         * @param session connection that is going to be read
+         *
+         * @return false if the connection failed, a file could not be stored or the client closed it in the middle
+         * of a request
+         */
+        bool read_session(Session* session);
+
+        /**
+         * @brief Submits the next operation needed to move a tcp connection forward, closing it when
+         * everything was sent.
+         *
+         * @param ring io_uring instance
+         * @param connection connection that is going to be moved forward
+         *
+         * @return false if the connection was closed
+         */
+        bool advance_uring(Uring& ring, UringConnection* connection);
+
+        /**
+         * @brief Submits a receive for a udp request.
+         *
+         * @param ring io_uring instance
+         * @param datagram slot where the request is going to be received
+         */
+        void receive_uring(Uring& ring, UringDatagram* datagram);
+
+        /**
+         * @brief Processes a request received in a tcp connection and queues its response.
+         *
+         * @param session connection where the request came from
+         * @param request client's request
+         *
+         * @return false if the response could not be put together, in which case the connection has to be closed
+         */
+        bool serve_session(Session* session, string_view request);
+
+        /**
+         * @brief Makes sure that the changes behind the responses about to be sent are on disk.
+         */
+        void commit();
+
+        /**
+         * @brief Starts a snapshot of every user and group, which the journal starts over from. Users and groups
+         * must be locked.
+         */
+        void checkpoint();
 
         /**
          * @brief Cleans and frees everything related to the Manager.
@@ -92,113 +235,193 @@ class Manager {
         void clean();
 
         /**
-         * @brief Receives user request, process it and creates a request to be sent back.
+         * @brief Receives user request, routes it to its handler and creates a response to be sent back.
          *
          * @param request user request
+         * @param transport how the request reached the server
          *
-         * @return server's response
+         * @return server's response, ERR if the request is unknown or came through the wrong transport
          */
-        string process_request(const string& request);
+        string process_request(string_view request, Transport transport);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doRegister(const string& input);
+        string doRegister(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doUnregister(const string& input);
+        string doUnregister(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doLogin(const string& input);
+        string doLogin(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doLogout(const string& input);
+        string doLogout(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doListGroups(const string& input);
+        string doListGroups(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doSubscribe(const string& input);
+        string doSubscribe(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doUnsubscribe(const string& input);
+        string doUnsubscribe(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doMyGroups(const string& input);
+        string doMyGroups(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doUserList(const string& input);
+        string doUserList(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doPost(const string& input);
+        string doPost(Tokenizer& request);
 
         /**
          * @brief Receives request from client, processes it and returns a response.
          *
-         * @param input user input command
+         * @param request client's request, whose opcode was already read
          *
          * @return response to be sent back to the client
          */
-         string doRetrieve(const string& input);
+        string doRetrieve(Tokenizer& request);
+
+        /**
+         * @brief Receives request from client, processes it and returns a response.
+         *
+         * @param request client's request, whose opcode was already read
+         *
+         * @return response to be sent back to the client
+         */
+        string doCapabilities(Tokenizer& request);
+
+        /**
+         * @brief Receives request from client, processes it and returns a response.
+         *
+         * @param request client's request, whose opcode was already read
+         *
+         * @return response to be sent back to the client
+         */
+        string doSnapshotStatus(Tokenizer& request);
 
 };
 
+/**
+ * @brief Entry of the dispatch table. Tells how requests with a certain opcode are served.
+ */
+struct Route {
+
+    /**
+     * @brief Opcode packed by pack_opcode.
+     */
+    uint32_t opcode;
+
+    /**
+     * @brief Dialect in which the request is read and answered.
+     */
+    Dialect dialect;
+
+    /**
+     * @brief Transport through which the request has to arrive.
+     */
+    Transport transport;
+
+    /**
+     * @brief Minimum number of fields that follow the opcode.
+     */
+    int arity;
+
+    /**
+     * @brief Manager's method that serves the request.
+     */
+    string (Manager::*handler)(Tokenizer& request);
+
+};
+
+
+/**
+ * @brief Packs a 3 or 4 character opcode into an integer, so it can be compared and hashed at once.
+ *
+ * @param opcode opcode as sent by the client
+ *
+ * @return packed opcode or 0 if it does not have 3 or 4 characters
+ */
+constexpr uint32_t pack_opcode(string_view opcode) {
+    if (opcode.size() != 3 && opcode.size() != 4) return 0;
+
+    uint32_t packed = 0;
+    for (char c: opcode) packed = packed << 8 | (uint32_t) (unsigned char) c;
+    return packed;
+}
+
+
+/**
+ * @brief Gets the slot of the dispatch table where a packed opcode starts being looked for.
+ *
+ * @param opcode packed opcode
+ *
+ * @return slot
+ */
+constexpr size_t route_slot(uint32_t opcode) {
+    return (uint32_t) (opcode * 2654435761u) >> (32 - ROUTE_SLOT_BITS);
+}
+
+
 #endif
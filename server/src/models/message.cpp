@@ -1,5 +1,7 @@
 #include "message.h"
 
+#include <cstring>
+
 
 using namespace std;
 
@@ -9,11 +11,21 @@ using namespace std;
  *
  * @param id message's id
  * @param uid message's author
- * @param text message's text
+ * @param record message's wire format, which must outlive the message
+ * @param text_offset position of message's text in the record
+ * @param text_size length of message's text
+ * @param classic true if the record comes right after a classic header
+ * @param filename file's name, null terminated and outliving the message, or nullptr if none
+ * @param filesize file's size
  */
-Message::Message(const string& id, const string& uid,  const string& text, string& filename, string& filesize) {
+Message::Message(uint32_t id, uint32_t uid, string_view record, size_t text_offset, size_t text_size,
+                 bool classic, const char* filename, long filesize) {
     _id = id;
-    _text = text;
+    _record = record.data();
+    _record_size = (uint32_t) record.size();
+    _text_size = (uint16_t) text_size;
+    _text_offset = (uint8_t) text_offset;
+    _classic = classic;
     _uid = uid;
     _filename = filename;
     _filesize = filesize;
@@ -23,9 +35,9 @@ Message::Message(const string& id, const string& uid,  const string& text, strin
 /**
  * @brief Returns message's id.
  *
- * @return string with 4 chars containing the id
+ * @return message's id
  */
-string& Message::getMessageId() {
+uint32_t Message::getMessageId() const {
     return this->_id;
 }
 
@@ -35,8 +47,31 @@ string& Message::getMessageId() {
  *
  * @return message's text
  */
-string& Message::getMessageText() {
-    return this->_text;
+string_view Message::getMessageText() const {
+    return string_view(this->_record + this->_text_offset, this->_text_size);
+}
+
+
+/**
+ * @brief Gets the ids at the start of the message in a RTV response.
+ *
+ * @param classic true for the classic dialect, false for the extended one
+ *
+ * @return message's header or empty if the message does not fit the dialect
+ */
+string_view Message::getMessageHeader(bool classic) const {
+    if (!classic) return string_view(this->_record, RECORD_HEADER_SIZE);
+    return this->_classic ? string_view(this->_record - CLASSIC_HEADER_SIZE, CLASSIC_HEADER_SIZE) : string_view();
+}
+
+
+/**
+ * @brief Gets what follows the header of the message in a RTV response, file header included.
+ *
+ * @return message's body
+ */
+string_view Message::getMessageBody() const {
+    return string_view(this->_record + RECORD_HEADER_SIZE, this->_record_size - RECORD_HEADER_SIZE);
 }
 
 
@@ -45,24 +80,77 @@ string& Message::getMessageText() {
  *
  * @return user's id
  */
-string& Message::getMessageUid() {
+uint32_t Message::getMessageUid() const {
     return this->_uid;
 }
 
+
+/**
+ * @brief Checks if a file was posted with the message.
+ *
+ * @return true if there is a file
+ */
+bool Message::hasFile() const {
+    return this->_filename != nullptr;
+}
+
+
 /**
  * @brief Gets message's filename.
  *
- * @return user's id
+ * @return file's name or empty if there is no file
  */
-string& Message::getMessageFileName(){
-    return this->_filename;
+string_view Message::getMessageFileName() const {
+    return this->hasFile() ? string_view(this->_filename) : string_view();
 }
 
+
 /**
 * @brief Gets message's file's size.
 *
-* @return user's id
+* @return file's size
 */
-string& Message::getMessageFileSize(){
+long Message::getMessageFileSize() const {
     return this->_filesize;
 }
+
+
+/**
+ * @brief Arena constructor. No memory is allocated until something is stored
+ */
+Arena::Arena() {
+    this->_block_size = 0;
+    this->_used = 0;
+}
+
+
+/**
+ * @brief Copies bytes into the arena.
+ *
+ * @param data bytes to be stored
+ * @param terminate if true, a null terminator is stored after the bytes
+ *
+ * @return where the bytes were stored
+ */
+const char* Arena::store(string_view data, bool terminate) {
+
+    size_t length = data.size() + (terminate ? 1 : 0);
+
+    /* Last block is full, so a bigger one is started. Blocks that came before are kept as they are */
+    if (this->_blocks.empty() || this->_used + length > this->_block_size) {
+        this->_block_size = this->_blocks.empty() ? ARENA_FIRST_BLOCK_SIZE :
+                            min(this->_block_size * 2, (size_t) ARENA_MAX_BLOCK_SIZE);
+        this->_block_size = max(this->_block_size, length);
+        this->_blocks.emplace_back(new char[this->_block_size]);
+        this->_used = 0;
+    }
+
+    char* out = this->_blocks.back().get() + this->_used;
+    memcpy(out, data.data(), data.size());
+    if (terminate) out[data.size()] = '\0';
+    this->_used += length;
+
+    return out;
+
+}
+
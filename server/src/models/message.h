@@ -2,42 +2,77 @@
 #define PROJETO_RC_39_V2_MESSAGE_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#define ARENA_FIRST_BLOCK_SIZE 4096
+#define ARENA_MAX_BLOCK_SIZE 65536
+#define TEXT_MAX_SIZE 240
+#define RECORD_ID_SIZE 10
+#define RECORD_HEADER_SIZE (2 * RECORD_ID_SIZE + 2)
+#define CLASSIC_HEADER_SIZE 11
 
 
 using namespace std;
 
 
 /**
- * @brief Represents a Message
+ * @brief Represents a Message. Compact record whose wire format and file name live in the arena of its group, or
+ * in the page of the group's log that was last read.
+ * Both dialects send the same body, "Tsize "text"[ / Fname Fsize ]\n", after a header with the ids.
  */
 class Message {
 
     private:
 
         /**
-         * @brief message's id
+         * @brief message as it is sent in an extended RTV response, "MID UID Tsize "text"[ / Fname Fsize ]\n",
+         * with both ids zero padded to RECORD_ID_SIZE digits (not null terminated). Messages that fit the
+         * classic dialect have its "MID UID " header right before
+         */
+        const char* _record;
+
+        /**
+         * @brief file's name (nullptr if the message has no file)
          */
-        string _id;
+        const char* _filename;
 
         /**
-         * @brief message's text
+         * @brief file's size
          */
-        string _text;
+        long _filesize;
 
         /**
          * @brief author identifier
          */
-        string _uid;
+        uint32_t _uid;
 
         /**
-         * @brief file's name
+         * @brief message's id
          */
-        string _filename;
+        uint32_t _id;
 
         /**
-         * @brief file's size
+         * @brief length of message's record
+         */
+        uint32_t _record_size;
+
+        /**
+         * @brief length of message's text
+         */
+        uint16_t _text_size;
+
+        /**
+         * @brief position of message's text in the record
+         */
+        uint8_t _text_offset;
+
+        /**
+         * @brief Is true if the message has a classic header
          */
-        string _filesize;
+        bool _classic;
 
     public:
 
@@ -46,45 +81,118 @@ class Message {
          *
          * @param id message's id
          * @param uid message's author
-         * @param text message's text
+         * @param record message's wire format, which must outlive the message
+         * @param text_offset position of message's text in the record
+         * @param text_size length of message's text
+         * @param classic true if the record comes right after a classic header
+         * @param filename file's name, null terminated and outliving the message, or nullptr if none
+         * @param filesize file's size
          */
-        explicit Message(const string& id, const string& uid,  const string& text, string& filename, string& filesize);
+        explicit Message(uint32_t id, uint32_t uid, string_view record, size_t text_offset, size_t text_size,
+                         bool classic, const char* filename, long filesize);
 
         /**
          * @brief Returns message's id.
          *
-         * @return string with 4 chars containing the id
+         * @return message's id
          */
-        string& getMessageId();
+        uint32_t getMessageId() const;
 
         /**
          * @brief Gets message's contents.
          *
          * @return message's text
          */
-        string& getMessageText();
+        string_view getMessageText() const;
+
+        /**
+         * @brief Gets the ids at the start of the message in a RTV response.
+         *
+         * @param classic true for the classic dialect, false for the extended one
+         *
+         * @return message's header or empty if the message does not fit the dialect
+         */
+        string_view getMessageHeader(bool classic) const;
+
+        /**
+         * @brief Gets what follows the header of the message in a RTV response, file header included.
+         *
+         * @return message's body
+         */
+        string_view getMessageBody() const;
 
         /**
          * @brief Gets message's author identifier.
          *
          * @return user's id
          */
-        string& getMessageUid();
+        uint32_t getMessageUid() const;
+
+        /**
+         * @brief Checks if a file was posted with the message.
+         *
+         * @return true if there is a file
+         */
+        bool hasFile() const;
 
         /**
          * @brief Gets message's filename.
          *
-         * @return user's id
+         * @return file's name or empty if there is no file
          */
-        string& getMessageFileName();
+        string_view getMessageFileName() const;
 
         /**
          * @brief Gets message's file's size.
          *
-         * @return user's id
+         * @return file's size
+         */
+        long getMessageFileSize() const;
+
+};
+
+
+/**
+ * @brief Hands out memory for bytes that are kept until the server stops. Memory comes from blocks that
+ * are never moved, so what was stored stays where it is.
+ */
+class Arena {
+
+    private:
+
+        /**
+         * @brief Blocks allocated so far. Each one is twice the size of the last, up to a maximum
+         */
+        vector<unique_ptr<char[]>> _blocks;
+
+        /**
+         * @brief Size of the last block
+         */
+        size_t _block_size;
+
+        /**
+         * @brief Number of bytes used in the last block
          */
-        string& getMessageFileSize();
+        size_t _used;
+
+    public:
+
+        /**
+         * @brief Arena constructor. No memory is allocated until something is stored
+         */
+        Arena();
+
+        /**
+         * @brief Copies bytes into the arena.
+         *
+         * @param data bytes to be stored
+         * @param terminate if true, a null terminator is stored after the bytes
+         *
+         * @return where the bytes were stored
+         */
+        const char* store(string_view data, bool terminate);
 
 };
 
+
 #endif
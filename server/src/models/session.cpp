@@ -0,0 +1,584 @@
+#include "session.h"
+#include "../misc/helpers.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <cerrno>
+
+
+/**
+ * @brief Session class constructor.
+ *
+ * @param fd connected client's socket
+ * @param ip client's ip
+ * @param port client's port
+ * @param request_limit longest line the client may send without its \n before it is turned away
+ */
+Session::Session(int fd, const string& ip, const string& port, size_t request_limit) {
+    this->_fd = fd;
+    this->_client_ip = ip;
+    this->_client_port = port;
+    this->_state = SESSION_READING;
+    this->_persistent = false;
+    this->_ended = false;
+    this->_request_limit = request_limit;
+    this->_failed = false;
+    this->_in_offset = 0;
+    this->_file_fd = -1;
+    this->_file_remaining = 0;
+    this->_file_offset = 0;
+    this->_file_store = nullptr;
+    this->_pipe[0] = -1;
+    this->_pipe[1] = -1;
+}
+
+
+/**
+ * @brief Gets client's socket.
+ *
+ * @return client's socket
+ */
+int Session::getSocket() const {
+    return this->_fd;
+}
+
+
+/**
+ * @brief Gets client's ip.
+ *
+ * @return client's ip
+ */
+string Session::getClientIP() {
+    return this->_client_ip;
+}
+
+
+/**
+ * @brief Gets client's port.
+ *
+ * @return client's port
+ */
+string Session::getClientPort() {
+    return this->_client_port;
+}
+
+
+/**
+ * @brief Gets current stage of the exchange.
+ *
+ * @return session state
+ */
+SessionState Session::getState() const {
+    return this->_state;
+}
+
+
+/**
+ * @brief Sets current stage of the exchange.
+ *
+ * @param state new state
+ */
+void Session::setState(SessionState state) {
+    this->_state = state;
+}
+
+
+/**
+ * @brief Checks if the connection carries more than one request.
+ *
+ * @return true if the client asked to keep the connection open
+ */
+bool Session::isPersistent() const {
+    return this->_persistent;
+}
+
+
+/**
+ * @brief Keeps the connection open after each response, so the client can send more requests.
+ */
+void Session::setPersistent() {
+    this->_persistent = true;
+}
+
+
+/**
+ * @brief Checks if the client is not going to send anything else.
+ *
+ * @return true if the client closed its side of the connection
+ */
+bool Session::isEnded() const {
+    return this->_ended;
+}
+
+
+/**
+ * @brief Stops reading from a client that closed its side of the connection. Requests that were already
+ * read are still answered, and the connection is closed once they are sent.
+ *
+ * @return false if the client closed it in the middle of a file, which is dropped along with the connection
+ */
+bool Session::endInput() {
+
+    this->_ended = true;
+    if (this->getState() == SESSION_RECEIVING_FILE) return false;
+
+    /* Whatever is left is a request that will never be complete */
+    this->_in.clear();
+    this->_in_offset = 0;
+    this->setState(SESSION_WRITING);
+    return true;
+
+}
+
+
+/**
+ * @brief Moves on to the next request once the current one has been read, which means going back
+ * to reading if the connection is persistent or to writing otherwise.
+ */
+void Session::requestDone() {
+    this->setState(this->isPersistent() ? SESSION_READING : SESSION_WRITING);
+}
+
+
+/**
+ * @brief Reads a chunk of data sent by the client into the session.
+ *
+ * @return number of bytes read, 0 if the client closed the connection and -1 on error (errno is set)
+ */
+ssize_t Session::receive() {
+
+    char buffer[SESSION_READ_SIZE];
+
+    ssize_t n = read(this->getSocket(), buffer, SESSION_READ_SIZE);
+    if (n > 0) this->append(buffer, n);
+
+    return n;
+
+}
+
+
+/**
+ * @brief Adds data received from the client to the session. Bytes that were already consumed are dropped first,
+ * once for every chunk that is read instead of once for every request.
+ *
+ * @param data received bytes
+ * @param length number of received bytes
+ */
+void Session::append(const char* data, size_t length) {
+    if (this->_in_offset > 0) {
+        this->_in.erase(0, this->_in_offset);
+        this->_in_offset = 0;
+    }
+    this->_in.append(data, length);
+}
+
+
+/**
+ * @brief Extracts the next complete request that the client sent.
+ *
+ * @param request will point to the request without the trailing \n, until more data is added
+ *
+ * @return true if a complete request was available. A line that is already longer than any request
+ * is answered with ERR and ends the connection
+ */
+bool Session::nextRequest(string_view& request) {
+
+    /* Request is only complete once we get its \n. Client that never sends it is not buffered forever */
+    size_t end = this->_in.find('\n', this->_in_offset);
+    if (end == string::npos) {
+        if (this->_in.size() - this->_in_offset > this->_request_limit) {
+            this->queue("ERR\n");
+            this->endInput();
+        }
+        return false;
+    }
+
+    request = string_view(this->_in).substr(this->_in_offset, end - this->_in_offset);
+    this->_in_offset = end + 1;
+
+    return true;
+
+}
+
+
+/**
+ * @brief Prepares the session to receive a file right after the current request.
+ *
+ * @param store where the file is kept, nullptr if its data is read and dropped
+ * @param file_path path where the file is going to be stored
+ * @param file_size size of the file
+ */
+void Session::expectFile(AttachmentStore* store, const string& file_path, long file_size) {
+
+    /* Clients send files right after the request, as is, exactly file_size bytes */
+    this->_file_remaining = file_size;
+    this->_file_offset = 0;
+    this->_file_store = store;
+    this->_file_path = file_path;
+
+    this->_file_fd = store != nullptr ? store->create(file_path) : -1;
+    this->setState(SESSION_RECEIVING_FILE);
+
+}
+
+
+/**
+ * @brief Writes to disk all the file data that has already been read. Moves on to writing the
+ * response when the whole file has arrived. File that can't be written fails the session.
+ */
+void Session::consumeFile() {
+
+    const char* data;
+    size_t n = this->pendingFileData(&data);
+
+    /* Writes from buffer to file */
+    if (n > 0 && this->getFileDescriptor() != -1 &&
+        pwrite(this->getFileDescriptor(), data, n, this->getFileOffset()) != (ssize_t) n) {
+        this->_failed = true;
+        return;
+    }
+
+    this->fileWritten(n);
+
+}
+
+
+/**
+ * @brief Gets file that is being received from the client.
+ *
+ * @return file descriptor or -1 if none
+ */
+int Session::getFileDescriptor() const {
+    return this->_file_fd;
+}
+
+
+/**
+ * @brief Gets position in the file where the next received bytes are going to be written.
+ *
+ * @return file offset
+ */
+off_t Session::getFileOffset() const {
+    return this->_file_offset;
+}
+
+
+/**
+ * @brief Gets file data that was already read and is waiting to be written to disk.
+ *
+ * @param data will point to the first byte
+ *
+ * @return number of bytes waiting
+ */
+size_t Session::pendingFileData(const char** data) {
+    *data = this->_in.data() + this->_in_offset;
+    return min((size_t) this->_file_remaining, this->_in.size() - this->_in_offset);
+}
+
+
+/**
+ * @brief Marks received file data as written to disk. Moves on to writing the response when the whole
+ * file has arrived.
+ *
+ * @param length number of bytes written
+ */
+void Session::fileWritten(size_t length) {
+    this->_in_offset += length;
+    this->fileStored(length);
+}
+
+
+/**
+ * @brief Moves file data that is waiting in the socket straight to disk, without copying it through
+ * the session. Should only be called once the data that was already read has been consumed.
+ *
+ * @return number of bytes moved, 0 if the client closed the connection and -1 on error (errno is set). File
+ * that can't be written fails the session
+ */
+ssize_t Session::spliceFile() {
+
+    /* File could not be created, so its data is just read and discarded. Small files are not worth a pipe */
+    if (this->getFileDescriptor() == -1 || this->_file_remaining < SESSION_READ_SIZE) return this->receive();
+
+    /* Without a pipe, the file is read through the session */
+    if (this->_pipe[0] == -1) {
+        if (pipe2(this->_pipe, O_CLOEXEC) != 0) {
+            this->_pipe[0] = this->_pipe[1] = -1;
+            return this->receive();
+        }
+        fcntl(this->_pipe[1], F_SETPIPE_SZ, SESSION_PIPE_SIZE);  /* Bigger pipe means fewer calls, but is optional */
+    }
+
+    /* Only takes the file's bytes. Anything after them is the next request */
+    ssize_t n = splice(this->getSocket(), nullptr, this->_pipe[1], nullptr, this->_file_remaining,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n <= 0) return n;
+
+    /* Empties the pipe into the file */
+    for (ssize_t left = n; left > 0; ) {
+        loff_t offset = this->getFileOffset();
+        ssize_t m = splice(this->_pipe[0], nullptr, this->getFileDescriptor(), &offset, left, SPLICE_F_MOVE);
+        if (m <= 0) {
+            this->_failed = true;
+            errno = EIO;
+            return -1;
+        }
+        this->fileStored(m);
+        left -= m;
+    }
+
+    return n;
+
+}
+
+
+/**
+ * @brief Marks file data as stored on disk. Moves on to the next request when the whole file has
+ * arrived.
+ *
+ * @param length number of bytes stored
+ */
+void Session::fileStored(size_t length) {
+
+    this->_file_remaining -= (long) length;
+    this->_file_offset += (off_t) length;
+
+    /* Whole file has arrived, so it is handed over to the store, which may have to drop it */
+    if (this->_file_remaining == 0) {
+        if (this->_file_fd != -1 && !this->_file_store->keep(this->_file_fd, this->_file_path)) this->_failed = true;
+        this->_file_fd = -1;
+        this->requestDone();
+    }
+
+}
+
+
+/**
+ * @brief Adds data to be sent to the client.
+ *
+ * @param data bytes to be sent
+ */
+void Session::queue(const string& data) {
+    if (!data.empty()) this->_out.push_back({data, 0, -1, 0, false});
+}
+
+
+/**
+ * @brief Adds a file to be streamed to the client.
+ *
+ * @param file_path path of the file
+ * @param file_length number of bytes to be sent
+ *
+ * @return false if the file could not be opened, which fails the session
+ */
+bool Session::queueFile(const string& file_path, long file_length) {
+
+    /* File may be gone or out of descriptors, which only concerns this client */
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        this->_failed = true;
+        return false;
+    }
+
+    bool compressed = AttachmentStore::isCompressed(fd);
+    this->_out.push_back({"", compressed ? sizeof(CompressedFile) : 0, fd, file_length, compressed});
+    return true;
+
+}
+
+
+/**
+ * @brief Checks if a response could not be put together or a file could not be stored, so the connection
+ * has to be closed.
+ *
+ * @return true if the session failed
+ */
+bool Session::hasFailed() const {
+    return this->_failed;
+}
+
+
+/**
+ * @brief Gets first segment of the response that is still to be sent.
+ *
+ * @return segment or nullptr if everything was sent
+ */
+Segment* Session::frontSegment() {
+    return this->_out.empty() ? nullptr : &this->_out.front();
+}
+
+
+/**
+ * @brief Discards first segment of the response, closing its file if it has one.
+ */
+void Session::popSegment() {
+    if (this->_out.front().fd != -1) close(this->_out.front().fd);
+    this->_out.pop_front();
+}
+
+
+/**
+ * @brief Takes a chunk read from the file in the first segment and stages it to be sent before the rest
+ * of the file.
+ *
+ * @param chunk bytes read from the file
+ * @param length number of bytes read
+ */
+void Session::stageChunk(const char* chunk, size_t length) {
+
+    Segment& segment = this->_out.front();
+    segment.offset += length;
+    segment.length -= (long) length;
+
+    this->_out.push_front({string(chunk, length), 0, -1, 0, false});
+
+}
+
+
+/**
+ * @brief Decompresses the next block of the compressed file in the first segment and stages it to be sent
+ * before the rest of the file.
+ *
+ * @return false if the file could not be read
+ */
+bool Session::stageBlock() {
+
+    Segment& segment = this->_out.front();
+    auto offset = (off_t) segment.offset;
+    string block;
+    if (!AttachmentStore::readBlock(segment.fd, offset, block) || (long) block.size() > segment.length) return false;
+
+    segment.offset = offset;
+    segment.length -= (long) block.size();
+
+    this->_out.push_front({move(block), 0, -1, 0, false});
+    return true;
+
+}
+
+
+/**
+ * @brief Describes the segments at the front of the response that are not files, so they can be sent
+ * together with a single system call.
+ *
+ * @param iov will describe each segment
+ * @param more will be true if a file comes right after them
+ *
+ * @return number of segments described
+ */
+int Session::gather(struct iovec* iov, bool* more) {
+
+    int n = 0;
+    *more = false;
+
+    for (auto& segment: this->_out) {
+        if (segment.fd != -1) { *more = true; break; }
+        if (n == SESSION_IOV_MAX) break;
+        iov[n++] = {(void*) (segment.data.data() + segment.offset), segment.data.size() - segment.offset};
+    }
+
+    return n;
+
+}
+
+
+/**
+ * @brief Marks bytes at the front of the response as sent, which may span several segments.
+ *
+ * @param length number of bytes sent
+ */
+void Session::sent(size_t length) {
+
+    while (length > 0) {
+
+        Segment& segment = this->_out.front();
+        size_t remaining = segment.data.size() - segment.offset;
+
+        /* Segment was only partially sent */
+        if (length < remaining) { segment.offset += length; return; }
+
+        length -= remaining;
+        this->_out.pop_front();
+
+    }
+
+}
+
+
+/**
+ * @brief Sends as much of the pending response as the socket accepts without blocking.
+ *
+ * @return false if the connection failed
+ */
+bool Session::flush() {
+
+    Segment* segment;
+
+    while ((segment = this->frontSegment()) != nullptr) {
+
+        /* Files go straight from the page cache to the socket, exactly as many bytes as announced */
+        if (segment->fd != -1) {
+
+            if (segment->length <= 0) { this->popSegment(); continue; }
+
+            /* Compressed files are decompressed a block at a time, right before the block is sent */
+            if (segment->compressed) {
+                if (!this->stageBlock()) return false;
+                continue;
+            }
+
+            auto offset = (off_t) segment->offset;
+            ssize_t n = sendfile(this->getSocket(), segment->fd, &offset, segment->length);
+            if (n == -1) return errno == EAGAIN || errno == EWOULDBLOCK;
+            if (n == 0) return false;  /* File is shorter than announced */
+
+            segment->offset += n;
+            segment->length -= n;
+            continue;
+
+        }
+
+        /* Sends every segment up to the next file at once. If a file follows, the kernel is told to hold
+         * the last packet so the file's first bytes go with it */
+        struct iovec iov[SESSION_IOV_MAX];
+        struct msghdr msg{};
+        bool more;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = this->gather(iov, &more);
+
+        ssize_t n = sendmsg(this->getSocket(), &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (n == -1) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        this->sent(n);
+
+    }
+
+    return true;
+
+}
+
+
+/**
+ * @brief Checks if there is nothing else to be sent to the client.
+ *
+ * @return true if the whole response was sent
+ */
+bool Session::isFlushed() const {
+    return this->_out.empty();
+}
+
+
+/**
+ * @brief Cleans and frees everything related to the Session.
+ */
+void Session::clean() {
+    for (auto& segment: this->_out) if (segment.fd != -1) close(segment.fd);
+    this->_out.clear();
+    /* File that was cut short is left to its message as it is, without being shared */
+    if (this->_file_fd != -1) close(this->_file_fd);
+    this->_file_fd = -1;
+    if (this->_pipe[0] != -1) { close(this->_pipe[0]); close(this->_pipe[1]); }
+    close(this->getSocket());
+}
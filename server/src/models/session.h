@@ -0,0 +1,420 @@
+#ifndef PROJETO_RC_39_V2_SESSION_H
+#define PROJETO_RC_39_V2_SESSION_H
+
+#include "attachment.h"
+
+#include <string>
+#include <deque>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define SESSION_READ_SIZE 65536
+#define SESSION_PIPE_SIZE 1048576
+#define SESSION_IOV_MAX 64
+
+
+using namespace std;
+
+
+/**
+ * @brief Stages in which a tcp connection with a client can be.
+ */
+enum SessionState {
+    SESSION_READING,         /* Waiting for a complete request */
+    SESSION_RECEIVING_FILE,  /* Request was processed and we are receiving its attached file */
+    SESSION_WRITING,         /* Response is being sent back to the client */
+};
+
+
+/**
+ * @brief Piece of a response that is waiting to be sent to the client.
+ */
+struct Segment {
+
+    /**
+     * @brief Bytes to be sent when this segment is not a file.
+     */
+    string data;
+
+    /**
+     * @brief Number of bytes of data that were already sent or, for files, where the next read starts.
+     */
+    size_t offset;
+
+    /**
+     * @brief File that is going to be streamed to the client (-1 if this segment is not a file).
+     */
+    int fd;
+
+    /**
+     * @brief Number of bytes of the file that are still to be streamed.
+     */
+    long length;
+
+    /**
+     * @brief Is true if the file is kept compressed, so it is decompressed a block at a time as it is streamed.
+     */
+    bool compressed;
+
+};
+
+
+/**
+ * @brief Represents a tcp connection with a client. Drives the non-blocking exchange of a request and
+ * its response by keeping track of what has been read and what is still to be written.
+ */
+class Session {
+
+    private:
+
+        /**
+         * @brief File descriptor of the connected client.
+         */
+        int _fd;
+
+        /**
+         * @brief Client's ip.
+         */
+        string _client_ip;
+
+        /**
+         * @brief Client's port.
+         */
+        string _client_port;
+
+        /**
+         * @brief Current stage of the exchange.
+         */
+        SessionState _state;
+
+        /**
+         * @brief Is true if the client asked to keep the connection open for more requests.
+         */
+        bool _persistent;
+
+        /**
+         * @brief Is true if the client is not going to send anything else.
+         */
+        bool _ended;
+
+        /**
+         * @brief Longest line the client may send without its \n before it is turned away.
+         */
+        size_t _request_limit;
+
+        /**
+         * @brief Is true if a response could not be put together or a file could not be stored, so the connection
+         * has to be closed.
+         */
+        bool _failed;
+
+        /**
+         * @brief Bytes that were read from the client. Those before _in_offset were already consumed.
+         */
+        string _in;
+
+        /**
+         * @brief Position in _in of the first byte that was not consumed yet.
+         */
+        size_t _in_offset;
+
+        /**
+         * @brief Response segments waiting to be sent.
+         */
+        deque<Segment> _out;
+
+        /**
+         * @brief File that is being received from the client (-1 if none).
+         */
+        int _file_fd;
+
+        /**
+         * @brief Number of bytes of the file that are still to be written to disk.
+         */
+        long _file_remaining;
+
+        /**
+         * @brief Position in the file where the next received bytes are going to be written.
+         */
+        off_t _file_offset;
+
+        /**
+         * @brief Where the file that is being received is kept once it is complete (nullptr if it is dropped).
+         */
+        AttachmentStore* _file_store;
+
+        /**
+         * @brief Path of the file that is being received.
+         */
+        string _file_path;
+
+        /**
+         * @brief Pipe through which file data is spliced from the socket to disk (-1 until first needed).
+         */
+        int _pipe[2];
+
+    private:
+
+        /**
+         * @brief Marks file data as stored on disk. Moves on to the next request when the whole file has
+         * arrived.
+         *
+         * @param length number of bytes stored
+         */
+        void fileStored(size_t length);
+
+    public:
+
+        /**
+         * @brief Session class constructor.
+         *
+         * @param fd connected client's socket
+         * @param ip client's ip
+         * @param port client's port
+         * @param request_limit longest line the client may send without its \n before it is turned away
+         */
+        explicit Session(int fd, const string& ip, const string& port, size_t request_limit);
+
+        /**
+         * @brief Gets client's socket.
+         *
+         * @return client's socket
+         */
+        int getSocket() const;
+
+        /**
+         * @brief Gets client's ip.
+         *
+         * @return client's ip
+         */
+        string getClientIP();
+
+        /**
+         * @brief Gets client's port.
+         *
+         * @return client's port
+         */
+        string getClientPort();
+
+        /**
+         * @brief Gets current stage of the exchange.
+         *
+         * @return session state
+         */
+        SessionState getState() const;
+
+        /**
+         * @brief Sets current stage of the exchange.
+         *
+         * @param state new state
+         */
+        void setState(SessionState state);
+
+        /**
+         * @brief Checks if the connection carries more than one request.
+         *
+         * @return true if the client asked to keep the connection open
+         */
+        bool isPersistent() const;
+
+        /**
+         * @brief Keeps the connection open after each response, so the client can send more requests.
+         */
+        void setPersistent();
+
+        /**
+         * @brief Checks if the client is not going to send anything else.
+         *
+         * @return true if the client closed its side of the connection
+         */
+        bool isEnded() const;
+
+        /**
+         * @brief Stops reading from a client that closed its side of the connection. Requests that were already
+         * read are still answered, and the connection is closed once they are sent.
+         *
+         * @return false if the client closed it in the middle of a file, which is dropped along with the connection
+         */
+        bool endInput();
+
+        /**
+         * @brief Moves on to the next request once the current one has been read, which means going back
+         * to reading if the connection is persistent or to writing otherwise.
+         */
+        void requestDone();
+
+        /**
+         * @brief Reads a chunk of data sent by the client into the session.
+         *
+         * @return number of bytes read, 0 if the client closed the connection and -1 on error (errno is set)
+         */
+        ssize_t receive();
+
+        /**
+         * @brief Adds data received from the client to the session.
+         *
+         * @param data received bytes
+         * @param length number of received bytes
+         */
+        void append(const char* data, size_t length);
+
+        /**
+         * @brief Extracts the next complete request that the client sent.
+         *
+         * @param request will point to the request without the trailing \n, until more data is added
+         *
+         * @return true if a complete request was available. A line that is already longer than any request
+         * is answered with ERR and ends the connection
+         */
+        bool nextRequest(string_view& request);
+
+        /**
+         * @brief Prepares the session to receive a file right after the current request.
+         *
+         * @param store where the file is kept, nullptr if its data is read and dropped
+         * @param file_path path where the file is going to be stored
+         * @param file_size size of the file
+         */
+        void expectFile(AttachmentStore* store, const string& file_path, long file_size);
+
+        /**
+         * @brief Writes to disk all the file data that has already been read. Moves on to writing the
+         * response when the whole file has arrived. File that can't be written fails the session.
+         */
+        void consumeFile();
+
+        /**
+         * @brief Moves file data that is waiting in the socket straight to disk, without copying it through
+         * the session. Should only be called once the data that was already read has been consumed.
+         *
+         * @return number of bytes moved, 0 if the client closed the connection and -1 on error (errno is set). File
+         * that can't be written fails the session
+         */
+        ssize_t spliceFile();
+
+        /**
+         * @brief Gets file that is being received from the client.
+         *
+         * @return file descriptor or -1 if none
+         */
+        int getFileDescriptor() const;
+
+        /**
+         * @brief Gets position in the file where the next received bytes are going to be written.
+         *
+         * @return file offset
+         */
+        off_t getFileOffset() const;
+
+        /**
+         * @brief Gets file data that was already read and is waiting to be written to disk.
+         *
+         * @param data will point to the first byte
+         *
+         * @return number of bytes waiting
+         */
+        size_t pendingFileData(const char** data);
+
+        /**
+         * @brief Marks received file data as written to disk. Moves on to writing the response when the whole
+         * file has arrived.
+         *
+         * @param length number of bytes written
+         */
+        void fileWritten(size_t length);
+
+        /**
+         * @brief Adds data to be sent to the client.
+         *
+         * @param data bytes to be sent
+         */
+        void queue(const string& data);
+
+        /**
+         * @brief Adds a file to be streamed to the client.
+         *
+         * @param file_path path of the file
+         * @param file_length number of bytes to be sent
+         *
+         * @return false if the file could not be opened, which fails the session
+         */
+        bool queueFile(const string& file_path, long file_length);
+
+        /**
+         * @brief Checks if a response could not be put together or a file could not be stored, so the connection
+         * has to be closed.
+         *
+         * @return true if the session failed
+         */
+        bool hasFailed() const;
+
+        /**
+         * @brief Gets first segment of the response that is still to be sent.
+         *
+         * @return segment or nullptr if everything was sent
+         */
+        Segment* frontSegment();
+
+        /**
+         * @brief Discards first segment of the response, closing its file if it has one.
+         */
+        void popSegment();
+
+        /**
+         * @brief Takes a chunk read from the file in the first segment and stages it to be sent before the rest
+         * of the file.
+         *
+         * @param chunk bytes read from the file
+         * @param length number of bytes read
+         */
+        void stageChunk(const char* chunk, size_t length);
+
+        /**
+         * @brief Decompresses the next block of the compressed file in the first segment and stages it to be sent
+         * before the rest of the file.
+         *
+         * @return false if the file could not be read
+         */
+        bool stageBlock();
+
+        /**
+         * @brief Describes the segments at the front of the response that are not files, so they can be sent
+         * together with a single system call.
+         *
+         * @param iov will describe each segment
+         * @param more will be true if a file comes right after them
+         *
+         * @return number of segments described
+         */
+        int gather(struct iovec* iov, bool* more);
+
+        /**
+         * @brief Marks bytes at the front of the response as sent, which may span several segments.
+         *
+         * @param length number of bytes sent
+         */
+        void sent(size_t length);
+
+        /**
+         * @brief Sends as much of the pending response as the socket accepts without blocking.
+         *
+         * @return false if the connection failed
+         */
+        bool flush();
+
+        /**
+         * @brief Checks if there is nothing else to be sent to the client.
+         *
+         * @return true if the whole response was sent
+         */
+        bool isFlushed() const;
+
+        /**
+         * @brief Cleans and frees everything related to the Session.
+         */
+        void clean();
+
+};
+
+
+#endif //PROJETO_RC_39_V2_SESSION_H
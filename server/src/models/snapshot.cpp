@@ -0,0 +1,411 @@
+#include "snapshot.h"
+#include "../misc/helpers.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <csignal>
+#include <new>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+
+
+using namespace std;
+
+
+/**
+ * @brief Snapshot being written. Bytes are gathered in a buffer, which goes to the file whenever it would not fit
+ * them. Everything is allocated before the snapshot is written, so a forked copy of the server does not allocate.
+ */
+struct SnapshotOutput {
+    int fd;                                 /* Snapshot's file */
+    string path;                            /* Where the snapshot goes once it is complete */
+    string temporary;                       /* Where the snapshot is written */
+    string buffer;                          /* Bytes not written yet, which never grow past its capacity */
+    uint64_t position;                      /* Position of the next byte in the snapshot */
+    bool failed;                            /* Is true if a write failed, after which nothing else is written */
+    vector<const User*> registered;         /* Users, in the order they are written */
+    vector<StoredGroup> stored_groups;      /* Groups, written at the end */
+};
+
+
+/**
+ * @brief Writes bytes to the snapshot's file, unless an earlier write failed.
+ *
+ * @param out snapshot being written
+ * @param data bytes to be written
+ * @param size number of bytes
+ */
+static void write_output(SnapshotOutput& out, const char* data, size_t size) {
+
+    size_t written = 0;
+    while (!out.failed && written < size) {
+        ssize_t n = write(out.fd, data + written, size - written);
+        if (n > 0) written += n;
+        else if (errno != EINTR) out.failed = true;
+    }
+
+}
+
+
+/**
+ * @brief Writes whatever is left in the buffer.
+ *
+ * @param out snapshot being written
+ */
+static void flush_output(SnapshotOutput& out) {
+    write_output(out, out.buffer.data(), out.buffer.size());
+    out.buffer.clear();
+}
+
+
+/**
+ * @brief Appends bytes to the snapshot. Bytes that do not fit in the whole buffer are written as they are.
+ *
+ * @param out snapshot being written
+ * @param data bytes to be appended
+ * @param size number of bytes
+ */
+static void output(SnapshotOutput& out, const void* data, size_t size) {
+    out.position += size;
+    if (out.buffer.size() + size > out.buffer.capacity()) flush_output(out);
+    if (size > out.buffer.capacity()) write_output(out, (const char*) data, size);
+    else out.buffer.append((const char*) data, size);
+}
+
+
+/**
+ * @brief Pads the snapshot, so that what comes next starts in a multiple of 8.
+ *
+ * @param out snapshot being written
+ */
+static void align_output(SnapshotOutput& out) {
+    static const char zeros[8] = {};
+    output(out, zeros, (8 - out.position % 8) % 8);
+}
+
+
+/**
+ * @brief Snapshot class constructor.
+ *
+ * @param directory directory where the server keeps its data
+ * @param journal_limit size the journal has to reach for a new snapshot to be taken
+ */
+Snapshot::Snapshot(const string& directory, uint64_t journal_limit) {
+    this->_directory = directory;
+    this->_generation = 0;
+    this->_journal_limit = journal_limit;
+    this->_child = 0;
+    this->_state = SNAPSHOT_IDLE;
+    this->_group_count = 0;
+    this->_pause = 0;
+    this->_duration = 0;
+
+    /* Progress is written by the copy of the process that takes the snapshot, so it lives in shared memory */
+    void* shared = mmap(nullptr, sizeof(SnapshotProgress), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert_(shared != MAP_FAILED, "Could not share the snapshot's progress\n")
+    this->_progress = new (shared) SnapshotProgress();
+}
+
+
+/**
+ * @brief Rebuilds users and groups from the last snapshot. Logs of the groups are cut back to where
+ * the snapshot says they end.
+ *
+ * @param users empty table of users
+ * @param groups empty table of groups
+ *
+ * @return generation of the snapshot, 0 if there was none
+ */
+uint64_t Snapshot::load(UserTable* users, GroupTable* groups) {
+
+    string path = this->_directory + "/" + SNAPSHOT_FILE;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) return 0;
+    assert_(fd != -1, "Could not open the snapshot\n")
+
+    struct stat info{};
+    assert_(fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(SnapshotHeader), "Snapshot is too short\n")
+
+    /* Snapshot is read where it is mapped */
+    size_t size = info.st_size;
+    const char* data = (const char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert_(data != MAP_FAILED, "Could not map the snapshot\n")
+    close(fd);
+
+    const auto* header = (const SnapshotHeader*) data;
+    assert_(memcmp(header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0 && header->size == size &&
+            header->users + header->user_count * sizeof(StoredUser) <= size &&
+            header->groups + header->group_count * sizeof(StoredGroup) <= size, "Snapshot is corrupted\n")
+
+    /* Users are registered again, logged out */
+    const auto* stored_users = (const StoredUser*) (data + header->users);
+    for (uint32_t i = 0; i < header->user_count; i++) {
+        users->add(stored_users[i].uid, string_view(stored_users[i].password, PASSWORD_SIZE));
+    }
+
+    /* Groups are created again in the order of their ids, along with their logs */
+    const auto* stored_groups = (const StoredGroup*) (data + header->groups);
+    for (uint32_t i = 0; i < header->group_count; i++) {
+
+        const StoredGroup& stored = stored_groups[i];
+        uint32_t gid = i + 1;
+        Group* group = groups->add(string_view(data + stored.name, stored.name_size),
+                                   {stored.message_count, stored.log_segment, stored.log_size});
+
+        /* Subscribers come in ascending order, as do the groups of each of them */
+        const auto* uids = (const uint32_t*) (data + stored.users);
+        for (uint32_t j = 0; j < stored.user_count; j++) {
+            User* user = users->find(uids[j]);
+            if (user == nullptr) continue;
+            group->subscribeUser(uids[j]);
+            user->addGroup(gid);
+        }
+
+    }
+
+    this->_generation = header->generation;
+    munmap((void*) data, size);
+    return this->_generation;
+
+}
+
+
+/**
+ * @brief Gets a snapshot ready to be written: creates its temporary file and allocates everything writing it takes.
+ *
+ * @param out where the snapshot being written is kept
+ * @param users table of users
+ * @param groups table of groups
+ *
+ * @return true if the temporary file was created
+ */
+bool Snapshot::prepare(SnapshotOutput& out, UserTable* users, GroupTable* groups) {
+
+    out.path = this->_directory + "/" + SNAPSHOT_FILE;
+    out.temporary = out.path + ".tmp";
+    out.fd = open(out.temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    out.buffer.reserve(SNAPSHOT_BUFFER_SIZE);
+    out.position = 0;
+    out.failed = false;
+    out.registered = users->listUsers();
+    out.stored_groups.resize(groups->size());
+    this->_group_count = groups->size();
+    return out.fd != -1;
+
+}
+
+
+/**
+ * @brief Writes every user and group to a new snapshot, which replaces the last one once it is complete.
+ * Progress is shared with the process that started it. Nothing is allocated, so it can be run by a forked copy of
+ * the server.
+ *
+ * @param out snapshot that was prepared
+ * @param groups table of groups
+ * @param generation generation of the new snapshot
+ *
+ * @return true if the snapshot was written and replaced the last one
+ */
+bool Snapshot::write(SnapshotOutput& out, GroupTable* groups, uint64_t generation) {
+
+    /* Logs are not synced as messages are posted. Everything they had when the snapshot started is made durable
+     * first, so the positions kept below are there on restart. Logs share the data directory's file system */
+    int directory = open(this->_directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory == -1) return false;
+    if (syncfs(directory) != 0) out.failed = true;
+
+    /* Header is only filled in at the end, once every position is known */
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    header.generation = generation;
+    output(out, &header, sizeof header);
+    this->_progress->groups.store(0, memory_order_relaxed);
+
+    /* Users */
+    header.users = out.position;
+    header.user_count = (uint32_t) out.registered.size();
+    for (const User* user: out.registered) {
+        StoredUser stored{};
+        stored.uid = user->getId();
+        memcpy(stored.password, user->getPassword().data(), PASSWORD_SIZE);
+        output(out, &stored, sizeof stored);
+    }
+
+    /* Each group's name and subscribers, and where its log ends. Array of groups comes after them */
+    for (uint32_t gid = 1; gid <= out.stored_groups.size(); gid++) {
+
+        Group* group = groups->find(gid);
+        StoredGroup& stored = out.stored_groups[gid - 1];
+        this->_progress->groups.store(gid - 1, memory_order_relaxed);
+        this->_progress->bytes.store(out.position, memory_order_relaxed);
+
+        stored.name = out.position;
+        stored.name_size = (uint32_t) group->getName().size();
+        output(out, group->getName().data(), stored.name_size);
+
+        align_output(out);
+        stored.users = out.position;
+        stored.user_count = (uint32_t) group->getUsers().size();
+        output(out, group->getUsers().data(), stored.user_count * sizeof(uint32_t));
+
+        LogPosition position = group->getLogPosition();
+        stored.message_count = position.count;
+        stored.log_segment = position.segment;
+        stored.log_size = position.size;
+
+    }
+
+    /* Groups */
+    align_output(out);
+    header.groups = out.position;
+    header.group_count = (uint32_t) out.stored_groups.size();
+    output(out, out.stored_groups.data(), out.stored_groups.size() * sizeof(StoredGroup));
+    flush_output(out);
+
+    header.size = out.position;
+    bool written = !out.failed && pwrite(out.fd, &header, sizeof header, 0) == sizeof header &&
+                   fdatasync(out.fd) == 0;
+
+    /* Replaces the last snapshot at once, so there is always a complete one */
+    written = written && rename(out.temporary.c_str(), out.path.c_str()) == 0 && fsync(directory) == 0;
+    close(directory);
+    if (!written) return false;
+
+    this->_progress->groups.store(out.stored_groups.size(), memory_order_relaxed);
+    this->_progress->bytes.store(header.size, memory_order_relaxed);
+    return true;
+
+}
+
+
+/**
+ * @brief Writes every user and group to a new snapshot, which replaces the last one. Requests wait until it
+ * is done.
+ *
+ * @param users table of users
+ * @param groups table of groups
+ *
+ * @return generation of the new snapshot
+ */
+uint64_t Snapshot::take(UserTable* users, GroupTable* groups) {
+    SnapshotOutput out;
+    assert_(this->prepare(out, users, groups), "Could not create the snapshot\n")
+    bool written = this->write(out, groups, this->_generation + 1);
+    close(out.fd);
+    assert_(written, "Could not write the snapshot\n")
+    return ++this->_generation;
+}
+
+
+/**
+ * @brief Starts writing a new snapshot in a copy of the server's process, which sees users and groups as
+ * they are now while the server goes on changing them. Memory is only copied as the server writes to it.
+ *
+ * @param users table of users
+ * @param groups table of groups
+ */
+void Snapshot::start(UserTable* users, GroupTable* groups) {
+
+    pid_t parent = getpid();
+    this->_progress->groups.store(0, memory_order_relaxed);
+    this->_progress->bytes.store(0, memory_order_relaxed);
+
+    /* Other threads may hold the allocator's locks when the server forks, so the copy must not allocate */
+    SnapshotOutput out;
+    if (!this->prepare(out, users, groups)) {
+        this->_state = SNAPSHOT_FAILED;
+        return;
+    }
+
+    /* Only the page tables are copied, so this is the time during which requests wait */
+    auto started = chrono::steady_clock::now();
+    pid_t child = fork();
+    this->_pause = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+
+    /* Copy writes the snapshot and leaves. It goes away with the server instead of running its handlers, and
+     * only keeps the snapshot's file, so sockets the server closes meanwhile are really closed */
+    if (child == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        signal(SIGINT, SIG_DFL);
+        if (getppid() != parent) _exit(EXIT_FAILURE);
+        if (out.fd > STDERR_FILENO + 1) close_range(STDERR_FILENO + 1, out.fd - 1, 0);
+        close_range(out.fd + 1, ~0U, 0);
+        _exit(this->write(out, groups, this->_generation + 1) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(out.fd);
+    this->_child = child;
+    this->_started = started;
+    this->_state = child == -1 ? SNAPSHOT_FAILED : SNAPSHOT_RUNNING;
+    if (child == -1) this->_child = 0;
+
+}
+
+
+/**
+ * @brief Checks if the snapshot being written in the background is done.
+ *
+ * @return true if it was just completed
+ */
+bool Snapshot::poll() {
+
+    int status;
+    if (this->_child == 0 || waitpid(this->_child, &status, WNOHANG) != this->_child) return false;
+
+    this->_child = 0;
+    this->_duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - this->_started).count();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        this->_state = SNAPSHOT_FAILED;
+        return false;
+    }
+
+    this->_state = SNAPSHOT_IDLE;
+    this->_generation++;
+    return true;
+
+}
+
+
+/**
+ * @brief Checks if the journal grew enough for a new snapshot to be taken, and none is being written.
+ *
+ * @param journal_size size of the journal
+ *
+ * @return true if a snapshot should be taken
+ */
+bool Snapshot::isDue(uint64_t journal_size) const {
+    return this->_child == 0 && journal_size >= this->_journal_limit;
+}
+
+
+/**
+ * @brief Gets the generation of the last snapshot that was completed.
+ *
+ * @return generation, 0 if there was none
+ */
+uint64_t Snapshot::getGeneration() const {
+    return this->_generation;
+}
+
+
+/**
+ * @brief Tells how snapshots are going.
+ *
+ * @return "state generation groups_written groups bytes_written fork_pause_us duration_ms", where state is
+ * IDLE, RUNNING or FAILED and the rest refers to the last snapshot
+ */
+string Snapshot::getStatus() const {
+    static const char* states[] = {"IDLE", "RUNNING", "FAILED"};
+    return string(states[this->_state]) + " " + to_string(this->_generation) + " " +
+           to_string(this->_progress->groups.load(memory_order_relaxed)) + " " + to_string(this->_group_count) + " " +
+           to_string(this->_progress->bytes.load(memory_order_relaxed)) + " " + to_string(this->_pause) + " " +
+           to_string(this->_duration);
+}
+
@@ -0,0 +1,245 @@
+#ifndef PROJETO_RC_39_V2_SNAPSHOT_H
+#define PROJETO_RC_39_V2_SNAPSHOT_H
+
+#include "user.h"
+#include "group.h"
+#include "message.h"
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <sys/types.h>
+
+#define SNAPSHOT_FILE "snapshot"
+#define SNAPSHOT_MAGIC "RC39SNP2"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_BUFFER_SIZE (1 << 20)
+
+
+using namespace std;
+
+
+struct SnapshotOutput;
+
+
+/**
+ * @brief Start of a snapshot. Every position is counted from the start of the snapshot.
+ */
+struct SnapshotHeader {
+    char magic[SNAPSHOT_MAGIC_SIZE];  /* Is SNAPSHOT_MAGIC */
+    uint64_t generation;              /* Journals of this generation are applied on top of the snapshot */
+    uint64_t size;                    /* Size of the whole snapshot */
+    uint64_t users;                   /* Position of the StoredUser array */
+    uint64_t groups;                  /* Position of the StoredGroup array */
+    uint32_t user_count;              /* Number of users */
+    uint32_t group_count;             /* Number of groups, whose ids go from 1 up to it */
+};
+
+
+/**
+ * @brief User as it is kept in a snapshot.
+ */
+struct StoredUser {
+    uint32_t uid;                     /* User's id */
+    char password[PASSWORD_SIZE];     /* User's password */
+};
+
+
+/**
+ * @brief Group as it is kept in a snapshot. Its messages are in its log, up to where the snapshot says it ends.
+ */
+struct StoredGroup {
+    uint64_t name;                    /* Position of the group's name */
+    uint64_t users;                   /* Position of the ids of the subscribed users, in ascending order */
+    uint64_t log_size;                /* Size of the last segment of the group's log */
+    uint32_t name_size;               /* Length of the group's name */
+    uint32_t user_count;              /* Number of subscribed users */
+    uint32_t message_count;           /* Number of messages */
+    uint32_t log_segment;             /* Id of the first message in the last segment of the group's log */
+};
+
+
+/**
+ * @brief States of the snapshot taken in the background.
+ */
+enum SnapshotState {
+    SNAPSHOT_IDLE,     /* No snapshot is being written */
+    SNAPSHOT_RUNNING,  /* Copy of the process is writing a snapshot */
+    SNAPSHOT_FAILED,   /* Last snapshot did not complete */
+};
+
+
+/**
+ * @brief How far the snapshot being written went. Shared between the server and the copy that writes it.
+ */
+struct SnapshotProgress {
+    atomic<uint64_t> groups;          /* Groups written so far */
+    atomic<uint64_t> bytes;           /* Bytes written so far */
+};
+
+
+/**
+ * @brief Flat copy of every user and group, which is mapped as it is when the server starts. Messages are kept
+ * in the logs of their groups, so a snapshot only keeps where each log ends, after making sure that the logs
+ * are on disk. Restarting does not depend on how many messages were posted.
+ *
+ * Changes made after a snapshot is taken go to a journal of the same generation, which is applied on top of
+ * it. A snapshot is written next to the last one and only replaces it once it is complete. While the server
+ * runs, snapshots are written by a forked copy of it, so requests only wait for the fork.
+ */
+class Snapshot {
+
+    private:
+
+        /**
+         * @brief Directory where the server keeps its data
+         */
+        string _directory;
+
+        /**
+         * @brief Generation of the last snapshot, 0 if there was none
+         */
+        uint64_t _generation;
+
+        /**
+         * @brief Size the journal has to reach for a new snapshot to be taken
+         */
+        uint64_t _journal_limit;
+
+        /**
+         * @brief Copy of the process that is writing a snapshot, 0 if there is none
+         */
+        pid_t _child;
+
+        /**
+         * @brief State of the snapshot taken in the background
+         */
+        SnapshotState _state;
+
+        /**
+         * @brief Progress of the last snapshot, in memory shared with the copy that writes it
+         */
+        SnapshotProgress* _progress;
+
+        /**
+         * @brief Number of groups in the last snapshot
+         */
+        uint64_t _group_count;
+
+        /**
+         * @brief Time, in microseconds, the last fork kept requests waiting
+         */
+        uint64_t _pause;
+
+        /**
+         * @brief Time, in milliseconds, the last snapshot taken in the background took to be written
+         */
+        uint64_t _duration;
+
+        /**
+         * @brief When the snapshot being written in the background was started
+         */
+        chrono::steady_clock::time_point _started;
+
+        /**
+         * @brief Gets a snapshot ready to be written: creates its temporary file and allocates everything writing
+         * it takes.
+         *
+         * @param out where the snapshot being written is kept
+         * @param users table of users
+         * @param groups table of groups
+         *
+         * @return true if the temporary file was created
+         */
+        bool prepare(SnapshotOutput& out, UserTable* users, GroupTable* groups);
+
+        /**
+         * @brief Writes every user and group to a new snapshot, which replaces the last one once it is complete.
+         * Progress is shared with the process that started it. Nothing is allocated, so it can be run by a forked
+         * copy of the server.
+         *
+         * @param out snapshot that was prepared
+         * @param groups table of groups
+         * @param generation generation of the new snapshot
+         *
+         * @return true if the snapshot was written and replaced the last one
+         */
+        bool write(SnapshotOutput& out, GroupTable* groups, uint64_t generation);
+
+    public:
+
+        /**
+         * @brief Snapshot class constructor.
+         *
+         * @param directory directory where the server keeps its data
+         * @param journal_limit size the journal has to reach for a new snapshot to be taken
+         */
+        explicit Snapshot(const string& directory, uint64_t journal_limit);
+
+        /**
+         * @brief Rebuilds users and groups from the last snapshot. Logs of the groups are cut back to where
+         * the snapshot says they end.
+         *
+         * @param users empty table of users
+         * @param groups empty table of groups
+         *
+         * @return generation of the snapshot, 0 if there was none
+         */
+        uint64_t load(UserTable* users, GroupTable* groups);
+
+        /**
+         * @brief Writes every user and group to a new snapshot, which replaces the last one. Requests wait until it
+         * is done.
+         *
+         * @param users table of users
+         * @param groups table of groups
+         *
+         * @return generation of the new snapshot
+         */
+        uint64_t take(UserTable* users, GroupTable* groups);
+
+        /**
+         * @brief Starts writing a new snapshot in a copy of the server's process, which sees users and groups as
+         * they are now while the server goes on changing them. Memory is only copied as the server writes to it.
+         *
+         * @param users table of users
+         * @param groups table of groups
+         */
+        void start(UserTable* users, GroupTable* groups);
+
+        /**
+         * @brief Checks if the snapshot being written in the background is done.
+         *
+         * @return true if it was just completed
+         */
+        bool poll();
+
+        /**
+         * @brief Checks if the journal grew enough for a new snapshot to be taken, and none is being written.
+         *
+         * @param journal_size size of the journal
+         *
+         * @return true if a snapshot should be taken
+         */
+        bool isDue(uint64_t journal_size) const;
+
+        /**
+         * @brief Gets the generation of the last snapshot that was completed.
+         *
+         * @return generation, 0 if there was none
+         */
+        uint64_t getGeneration() const;
+
+        /**
+         * @brief Tells how snapshots are going.
+         *
+         * @return "state generation groups_written groups bytes_written fork_pause_us duration_ms", where state is
+         * IDLE, RUNNING or FAILED and the rest refers to the last snapshot
+         */
+        string getStatus() const;
+
+};
+
+
+#endif //PROJETO_RC_39_V2_SNAPSHOT_H
@@ -0,0 +1,125 @@
+#include "uring.h"
+#include "../misc/helpers.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+
+
+/**
+ * @brief Uring class constructor. Setups the ring and maps it.
+ *
+ * @param entries size of the submission ring
+ */
+Uring::Uring(unsigned entries) {
+
+    memset(&this->_params, 0, sizeof this->_params);
+    this->_to_submit = 0;
+
+    this->_fd = (int) syscall(__NR_io_uring_setup, entries, &this->_params);
+    assert_(this->_fd != -1, "Could not create io_uring instance")
+
+    /* Maps both rings and the submission entries */
+    this->_sq_ring_size = this->_params.sq_off.array + this->_params.sq_entries * sizeof(unsigned);
+    this->_cq_ring_size = this->_params.cq_off.cqes + this->_params.cq_entries * sizeof(struct io_uring_cqe);
+
+    this->_sq_ring = (char*) mmap(nullptr, this->_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  this->_fd, IORING_OFF_SQ_RING);
+    this->_cq_ring = (char*) mmap(nullptr, this->_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  this->_fd, IORING_OFF_CQ_RING);
+    this->_sqes = (struct io_uring_sqe*) mmap(nullptr, this->_params.sq_entries * sizeof(struct io_uring_sqe),
+                                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                              this->_fd, IORING_OFF_SQES);
+    assert_(this->_sq_ring != MAP_FAILED && this->_cq_ring != MAP_FAILED && this->_sqes != MAP_FAILED,
+            "Could not map io_uring")
+
+    this->_sq_head = (unsigned*) (this->_sq_ring + this->_params.sq_off.head);
+    this->_sq_tail = (unsigned*) (this->_sq_ring + this->_params.sq_off.tail);
+    this->_sq_mask = (unsigned*) (this->_sq_ring + this->_params.sq_off.ring_mask);
+    this->_sq_array = (unsigned*) (this->_sq_ring + this->_params.sq_off.array);
+
+    this->_cq_head = (unsigned*) (this->_cq_ring + this->_params.cq_off.head);
+    this->_cq_tail = (unsigned*) (this->_cq_ring + this->_params.cq_off.tail);
+    this->_cq_mask = (unsigned*) (this->_cq_ring + this->_params.cq_off.ring_mask);
+    this->_cqes = (struct io_uring_cqe*) (this->_cq_ring + this->_params.cq_off.cqes);
+
+}
+
+
+/**
+ * @brief Gets a clean submission entry, submitting what was prepared when the ring is full.
+ *
+ * @param op operation that is going to be notified on completion
+ *
+ * @return entry to be filled
+ */
+struct io_uring_sqe* Uring::getSQE(UringOp* op) {
+
+    unsigned tail = *this->_sq_tail;
+
+    /* Ring is full, so the kernel has to take what we have first */
+    while (tail - __atomic_load_n(this->_sq_head, __ATOMIC_ACQUIRE) >= this->_params.sq_entries) {
+        int n = (int) syscall(__NR_io_uring_enter, this->_fd, this->_to_submit, 0, 0, nullptr, 0);
+        assert_(n != -1 || errno == EINTR || errno == EAGAIN || errno == EBUSY, "Could not submit to io_uring")
+        if (n > 0) this->_to_submit -= n;
+    }
+
+    unsigned index = tail & *this->_sq_mask;
+    struct io_uring_sqe* sqe = &this->_sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->user_data = (unsigned long long) op;
+
+    this->_sq_array[index] = index;
+    __atomic_store_n(this->_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->_to_submit++;
+
+    return sqe;
+
+}
+
+
+/**
+ * @brief Submits every prepared entry and waits for at least one completion.
+ */
+void Uring::submitAndWait() {
+
+    int n = (int) syscall(__NR_io_uring_enter, this->_fd, this->_to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (n == -1 && errno == EINTR) return;  /* Interrupted by a signal, caller just waits again */
+    assert_(n != -1, "Could not submit to io_uring")
+
+    this->_to_submit -= n;
+
+}
+
+
+/**
+ * @brief Gets the next completion without consuming it.
+ *
+ * @return completion or nullptr if there are none
+ */
+struct io_uring_cqe* Uring::peekCQE() {
+    unsigned head = *this->_cq_head;
+    if (head == __atomic_load_n(this->_cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+    return &this->_cqes[head & *this->_cq_mask];
+}
+
+
+/**
+ * @brief Marks the completion returned by peekCQE as consumed.
+ */
+void Uring::seenCQE() {
+    __atomic_store_n(this->_cq_head, *this->_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Cleans and frees everything related to the ring.
+ */
+void Uring::clean() {
+    munmap(this->_sqes, this->_params.sq_entries * sizeof(struct io_uring_sqe));
+    munmap(this->_cq_ring, this->_cq_ring_size);
+    munmap(this->_sq_ring, this->_sq_ring_size);
+    close(this->_fd);
+}
@@ -0,0 +1,214 @@
+#ifndef PROJETO_RC_39_V2_URING_H
+#define PROJETO_RC_39_V2_URING_H
+
+#include "connect.h"
+#include "session.h"
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <string>
+
+#define URING_ENTRIES 256
+#define URING_UDP_SLOTS 32
+
+
+/**
+ * @brief Kinds of operations that the server submits to io_uring.
+ */
+enum UringOpType {
+    URING_ACCEPT,      /* Accepts a tcp connection */
+    URING_UDP_RECV,    /* Receives a udp request */
+    URING_UDP_SEND,    /* Sends a udp response */
+    URING_RECV,        /* Receives data from a tcp connection */
+    URING_SEND,        /* Sends data to a tcp connection */
+    URING_FILE_READ,   /* Reads a file that is being sent to a client */
+    URING_FILE_WRITE,  /* Writes a file that is being received from a client */
+    URING_STOP,        /* Waits for the server to be told to stop */
+};
+
+
+/**
+ * @brief Operation in flight. Its address goes in the user data of the submission, so we know what
+ * completed.
+ */
+struct UringOp {
+
+    /**
+     * @brief What the operation does.
+     */
+    UringOpType type;
+
+    /**
+     * @brief Socket that the operation refers to.
+     */
+    int fd;
+
+    /**
+     * @brief Connection or udp slot that submitted the operation.
+     */
+    void* owner;
+
+};
+
+
+/**
+ * @brief Tcp connection served through io_uring. Has at most one operation in flight.
+ */
+struct UringConnection {
+
+    /**
+     * @brief Operation in flight.
+     */
+    UringOp op;
+
+    /**
+     * @brief Request and response state of the connection.
+     */
+    Session* session;
+
+    /**
+     * @brief Buffer where the kernel puts received data and file chunks.
+     */
+    char buffer[SESSION_READ_SIZE];
+
+    /**
+     * @brief Describes the response segments that are being sent.
+     */
+    struct iovec iov[SESSION_IOV_MAX];
+    struct msghdr msg;
+
+};
+
+
+/**
+ * @brief Udp request served through io_uring. Each slot goes from receiving a request to sending its
+ * response and back.
+ */
+struct UringDatagram {
+
+    /**
+     * @brief Operation in flight.
+     */
+    UringOp op;
+
+    /**
+     * @brief Received request.
+     */
+    char buffer[MAX_REQUEST_SIZE + 1];
+
+    /**
+     * @brief Response to be sent.
+     */
+    string response;
+
+    /**
+     * @brief Client's address.
+     */
+    struct sockaddr_in addr;
+
+    /**
+     * @brief Describes buffer or response to the kernel.
+     */
+    struct iovec iov;
+    struct msghdr msg;
+
+};
+
+
+/**
+ * @brief Minimal io_uring instance, used through the raw system calls.
+ */
+class Uring {
+
+    private:
+
+        /**
+         * @brief Ring's file descriptor.
+         */
+        int _fd;
+
+        /**
+         * @brief Parameters filled by the kernel on setup.
+         */
+        struct io_uring_params _params;
+
+        /**
+         * @brief Mapped submission and completion rings.
+         */
+        char* _sq_ring;
+        char* _cq_ring;
+        size_t _sq_ring_size;
+        size_t _cq_ring_size;
+
+        /**
+         * @brief Mapped submission entries.
+         */
+        struct io_uring_sqe* _sqes;
+
+        /**
+         * @brief Pointers into the submission ring.
+         */
+        unsigned* _sq_head;
+        unsigned* _sq_tail;
+        unsigned* _sq_mask;
+        unsigned* _sq_array;
+
+        /**
+         * @brief Pointers into the completion ring.
+         */
+        unsigned* _cq_head;
+        unsigned* _cq_tail;
+        unsigned* _cq_mask;
+        struct io_uring_cqe* _cqes;
+
+        /**
+         * @brief Number of entries prepared since the last submission.
+         */
+        unsigned _to_submit;
+
+    public:
+
+        /**
+         * @brief Uring class constructor. Setups the ring and maps it.
+         *
+         * @param entries size of the submission ring
+         */
+        explicit Uring(unsigned entries);
+
+        /**
+         * @brief Gets a clean submission entry, submitting what was prepared when the ring is full.
+         *
+         * @param op operation that is going to be notified on completion
+         *
+         * @return entry to be filled
+         */
+        struct io_uring_sqe* getSQE(UringOp* op);
+
+        /**
+         * @brief Submits every prepared entry and waits for at least one completion.
+         */
+        void submitAndWait();
+
+        /**
+         * @brief Gets the next completion without consuming it.
+         *
+         * @return completion or nullptr if there are none
+         */
+        struct io_uring_cqe* peekCQE();
+
+        /**
+         * @brief Marks the completion returned by peekCQE as consumed.
+         */
+        void seenCQE();
+
+        /**
+         * @brief Cleans and frees everything related to the ring.
+         */
+        void clean();
+
+};
+
+
+#endif //PROJETO_RC_39_V2_URING_H
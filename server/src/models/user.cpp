@@ -1,58 +1,109 @@
 #include "user.h"
 
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
 
 using namespace std;
 
 
 /**
- * @brief User constructor
+ * @brief User constructor. Creates an empty slot
+ */
+User::User() {
+    memset(_groups, 0, sizeof _groups);
+    memset(_password, 0, sizeof _password);
+    _id = 0;
+    _registered = false;
+    _status = false;
+}
+
+
+/**
+ * @brief Fills this slot with a newly registered user
  *
- * @param id
- * @param password
+ * @param id user's id
+ * @param password user's password
  */
-User::User(string& id, string& password){
+void User::registerUser(uint32_t id, string_view password) {
+    memset(_groups, 0, sizeof _groups);
+    _extended_groups.reset();
+    memset(_password, 0, sizeof _password);
+    memcpy(_password, password.data(), min(password.size(), sizeof _password));
     _id = id;
-    _password = password;
+    _registered = true;
     _status = false;
-    _group_ids = {};
+}
+
+
+/**
+ * @brief Empties this slot
+ */
+void User::unregisterUser() {
+    *this = User();
+}
+
+
+/**
+ * @brief Checks if this slot holds a registered user
+ *
+ * @return true if registered
+ */
+bool User::isRegistered() const {
+    return _registered;
 }
 
 
 /**
  * @brief Gets user id
  *
- * @return user id as integer
+ * @return user id with 5 digits
+ */
+string User::getUserId() const {
+    char id[11];
+    snprintf(id, sizeof id, "%05u", _id);
+    return id;
+}
+
+
+/**
+ * @brief Gets user's numeric id
+ *
+ * @return user id
  */
-string User::getUserId(){
+uint32_t User::getId() const {
     return _id;
 }
 
 
 /**
- * @brief Gets user password
+ * @brief Gets user's password
  *
- * @return user password as string
+ * @return password
  */
-string User::getUserPassword(){
-    return _password;
+string_view User::getPassword() const {
+    return string_view(_password, sizeof _password);
 }
 
 
 /**
- *@brief Gets user's group
+ * @brief Checks if a password is the user's password
+ *
+ * @param password password to be checked
  *
- * @return group as unordered map
+ * @return true if it matches
  */
-list<string> User::getUserGroups(){
-    return _group_ids;
+bool User::checkPassword(string_view password) const {
+    return password.size() == sizeof _password && memcmp(_password, password.data(), sizeof _password) == 0;
 }
 
-//TODO:comentar isto!
+
 /**
  * @brief gets user status (true if logged in, false otherwise)
  * @return status as bool
  */
-bool User::getUserStatus() {
+bool User::getUserStatus() const {
     return _status;
 }
 
@@ -66,21 +117,200 @@ void User::toggleStatus() {
 
 
 /**
- * @brief add group to user's group list
+ * @brief add group to user's groups
  *
- * @param gId group's Id
+ * @param gid group's Id
  */
-void User::addGroup(string gId){
-    _group_ids.push_back(gId);
+void User::addGroup(uint32_t gid) {
+    if (gid < USER_GROUP_BITS) {
+        _groups[gid / 64] |= (uint64_t) 1 << (gid % 64);
+        return;
+    }
+    if (!_extended_groups) _extended_groups = make_unique<vector<uint32_t>>();
+    auto itr = lower_bound(_extended_groups->begin(), _extended_groups->end(), gid);
+    if (itr == _extended_groups->end() || *itr != gid) _extended_groups->insert(itr, gid);
 }
 
 
 /**
- * @brief remove group from user's group list
+ * @brief remove group from user's groups
  *
- * @param gId group's Id
+ * @param gid group's Id
  */
-void User::removeGroup(string gId){
-    _group_ids.remove(gId);
+void User::removeGroup(uint32_t gid) {
+    if (gid < USER_GROUP_BITS) {
+        _groups[gid / 64] &= ~((uint64_t) 1 << (gid % 64));
+        return;
+    }
+    if (!_extended_groups) return;
+    auto itr = lower_bound(_extended_groups->begin(), _extended_groups->end(), gid);
+    if (itr != _extended_groups->end() && *itr == gid) _extended_groups->erase(itr);
 }
 
+
+/**
+ * @brief Checks if the user is subscribed to a group
+ *
+ * @param gid group's Id
+ *
+ * @return true if subscribed
+ */
+bool User::isSubscribed(uint32_t gid) const {
+    if (gid < USER_GROUP_BITS) return (_groups[gid / 64] >> (gid % 64)) & 1;
+    return _extended_groups && binary_search(_extended_groups->begin(), _extended_groups->end(), gid);
+}
+
+
+/**
+ * @brief Counts the groups the user is subscribed to, up to a certain id
+ *
+ * @param limit highest group's Id to be counted
+ *
+ * @return number of groups
+ */
+int User::countGroups(uint32_t limit) const {
+
+    int count = 0;
+    for (uint32_t word = 0; word < USER_GROUP_BITS / 64 && word * 64 <= limit; word++) {
+
+        /* Ignores the bits after limit in its own word */
+        uint64_t bits = _groups[word];
+        if (limit - word * 64 < 63) bits &= ((uint64_t) 1 << (limit - word * 64 + 1)) - 1;
+
+        count += __builtin_popcountll(bits);
+
+    }
+
+    if (!_extended_groups) return count;
+    return count + (int) (upper_bound(_extended_groups->begin(), _extended_groups->end(), limit) -
+                          _extended_groups->begin());
+
+}
+
+
+/**
+ * @brief Finds the first group the user is subscribed to after a certain id
+ *
+ * @param gid group's Id after which groups are checked, 0 to start from the first one
+ *
+ * @return group's Id or 0 if there are no more groups
+ */
+uint32_t User::nextGroup(uint32_t gid) const {
+
+    /* Groups kept as bits come first, as their ids are the lowest */
+    uint64_t first = (uint64_t) gid + 1;
+    for (uint64_t word = first / 64; word < USER_GROUP_BITS / 64; word++) {
+
+        /* Ignores the bits up to gid in its own word */
+        uint64_t bits = _groups[word];
+        if (word == first / 64) bits &= ~(uint64_t) 0 << (first % 64);
+
+        if (bits != 0) return (uint32_t) (word * 64 + __builtin_ctzll(bits));
+
+    }
+
+    if (!_extended_groups) return 0;
+    auto itr = upper_bound(_extended_groups->begin(), _extended_groups->end(), gid);
+    return itr == _extended_groups->end() ? 0 : *itr;
+
+}
+
+
+/**
+ * @brief UserTable constructor. Every slot starts empty
+ */
+UserTable::UserTable() {
+    _size = 0;
+}
+
+
+/**
+ * @brief Finds a registered user
+ *
+ * @param uid user's id
+ *
+ * @return user or nullptr if there is no such user
+ */
+User* UserTable::find(uint32_t uid) {
+    size_t page = uid >> USER_PAGE_BITS;
+    if (page >= _pages.size() || _pages[page] == nullptr) return nullptr;
+
+    User* user = &_pages[page][uid & (USER_PAGE_SIZE - 1)];
+    return user->isRegistered() ? user : nullptr;
+}
+
+
+/**
+ * @brief Registers a user. Its id must not be taken
+ *
+ * @param uid user's id
+ * @param password user's password
+ *
+ * @return registered user
+ */
+User* UserTable::add(uint32_t uid, string_view password) {
+
+    /* Page is allocated the first time one of its ids registers, and kept from then on */
+    size_t page = uid >> USER_PAGE_BITS;
+    if (page >= _pages.size()) _pages.resize(page + 1);
+    if (_pages[page] == nullptr) _pages[page].reset(new User[USER_PAGE_SIZE]);
+
+    User* user = &_pages[page][uid & (USER_PAGE_SIZE - 1)];
+    user->registerUser(uid, password);
+    _size++;
+    return user;
+
+}
+
+
+/**
+ * @brief Unregisters a user
+ *
+ * @param uid user's id
+ */
+void UserTable::remove(uint32_t uid) {
+    this->find(uid)->unregisterUser();
+    _size--;
+}
+
+
+/**
+ * @brief Lists every registered user
+ *
+ * @return users, in ascending order of id
+ */
+vector<const User*> UserTable::listUsers() const {
+
+    vector<const User*> users;
+    users.reserve(_size);
+
+    for (const auto& page: _pages) {
+        if (page == nullptr) continue;
+        for (size_t i = 0; i < USER_PAGE_SIZE; i++) {
+            if (page[i].isRegistered()) users.push_back(&page[i]);
+        }
+    }
+
+    return users;
+
+}
+
+
+/**
+ * @brief Gets number of registered users
+ *
+ * @return number of users
+ */
+size_t UserTable::size() const {
+    return _size;
+}
+
+
+/**
+ * @brief Checks if there are no registered users
+ *
+ * @return true if empty
+ */
+bool UserTable::empty() const {
+    return _size == 0;
+}
@@ -3,33 +3,54 @@
 
 #include <unordered_map>
 #include <string>
-#include <list>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#define USER_LIMIT 99999
+#define PASSWORD_SIZE 8
+#define USER_PAGE_BITS 12
+#define USER_PAGE_SIZE (1 << USER_PAGE_BITS)
+#define USER_GROUP_BITS 128
 
 
 using namespace std;
 
 
 /**
- * @brief Represents a User.
+ * @brief Represents a User. Small record, which lives in the slot of the UserTable given by its id.
  */
 class User {
 
     private:
 
         /**
-         * @brief User's id
+         * @brief User's groups with ids below USER_GROUP_BITS, which every classic group has. Bit i is set if the
+         * user is subscribed to group i
+         */
+        uint64_t _groups[USER_GROUP_BITS / 64];
+
+        /**
+         * @brief ids of the other groups the user is subscribed to, in ascending order. Only allocated once the user
+         * subscribes to one of them
+         */
+        unique_ptr<vector<uint32_t>> _extended_groups;
+
+        /**
+         * @brief User's password (not null terminated)
          */
-        string _id;
+        char _password[PASSWORD_SIZE];
 
         /**
-         * @brief User's password
+         * @brief User's id
          */
-        string _password;
+        uint32_t _id;
 
         /**
-         * @brief User's group
+         * @brief Is true if this slot holds a registered user
          */
-         list<string> _group_ids;
+        bool _registered;
 
         /**
          * @brief holds the current status of the users (logged in or not)
@@ -39,40 +60,65 @@ class User {
     public:
 
         /**
-         * @brief User constructor
+         * @brief User constructor. Creates an empty slot
+         */
+        User();
+
+        /**
+         * @brief Fills this slot with a newly registered user
          *
-         * @param id
-         * @param password
+         * @param id user's id
+         * @param password user's password
          */
-        explicit User(string& id, string& password);
+        void registerUser(uint32_t id, string_view password);
+
+        /**
+         * @brief Empties this slot
+         */
+        void unregisterUser();
+
+        /**
+         * @brief Checks if this slot holds a registered user
+         *
+         * @return true if registered
+         */
+        bool isRegistered() const;
 
         /**
          * @brief Gets user id
          *
-         * @return user id as integer
+         * @return user id with 5 digits
          */
-        string getUserId();
+        string getUserId() const;
 
         /**
-        * @brief Gets user password
-        *
-        * @return user password as string
-        */
-        string getUserPassword();
+         * @brief Gets user's numeric id
+         *
+         * @return user id
+         */
+        uint32_t getId() const;
 
         /**
-        *@brief Gets user's group
-        *
-        * @return group as unordered map
-        */
-        list<string> getUserGroups();
+         * @brief Gets user's password
+         *
+         * @return password
+         */
+        string_view getPassword() const;
+
+        /**
+         * @brief Checks if a password is the user's password
+         *
+         * @param password password to be checked
+         *
+         * @return true if it matches
+         */
+        bool checkPassword(string_view password) const;
 
         /**
          * @brief Get's user status (logged in or not)
          * @return status as bool
          */
-        bool getUserStatus();
-
+        bool getUserStatus() const;
 
         /**
          * @brief Changes user's status  (logged in or not)
@@ -80,18 +126,121 @@ class User {
         void toggleStatus();
 
         /**
-        * @brief add group to user's group list
+        * @brief add group to user's groups
         *
-        * @param group group's pointer
+        * @param gid group's Id
         */
-        void addGroup(string gId);
+        void addGroup(uint32_t gid);
 
         /**
-        * @brief remove group from user's group list
+        * @brief remove group from user's groups
         *
-        * @param gId group's Id
+        * @param gid group's Id
         */
-        void removeGroup(string gId);
+        void removeGroup(uint32_t gid);
+
+        /**
+         * @brief Checks if the user is subscribed to a group
+         *
+         * @param gid group's Id
+         *
+         * @return true if subscribed
+         */
+        bool isSubscribed(uint32_t gid) const;
+
+        /**
+         * @brief Counts the groups the user is subscribed to, up to a certain id
+         *
+         * @param limit highest group's Id to be counted
+         *
+         * @return number of groups
+         */
+        int countGroups(uint32_t limit) const;
+
+        /**
+         * @brief Finds the first group the user is subscribed to after a certain id
+         *
+         * @param gid group's Id after which groups are checked, 0 to start from the first one
+         *
+         * @return group's Id or 0 if there are no more groups
+         */
+        uint32_t nextGroup(uint32_t gid) const;
+
+};
+
+
+/**
+ * @brief Holds every user in the server, indexed by the user's id. Ids are split in pages of USER_PAGE_SIZE
+ * slots, which are only allocated once one of their users registers.
+ */
+class UserTable {
+
+    private:
+
+        /**
+         * @brief Page i holds the slots of ids i * USER_PAGE_SIZE up to (i + 1) * USER_PAGE_SIZE - 1, or
+         * nullptr if none of them was ever registered
+         */
+        vector<unique_ptr<User[]>> _pages;
+
+        /**
+         * @brief Number of registered users
+         */
+        size_t _size;
+
+    public:
+
+        /**
+         * @brief UserTable constructor. Every slot starts empty
+         */
+        UserTable();
+
+        /**
+         * @brief Finds a registered user
+         *
+         * @param uid user's id
+         *
+         * @return user or nullptr if there is no such user
+         */
+        User* find(uint32_t uid);
+
+        /**
+         * @brief Registers a user. Its id must not be taken
+         *
+         * @param uid user's id
+         * @param password user's password
+         *
+         * @return registered user
+         */
+        User* add(uint32_t uid, string_view password);
+
+        /**
+         * @brief Unregisters a user
+         *
+         * @param uid user's id
+         */
+        void remove(uint32_t uid);
+
+        /**
+         * @brief Lists every registered user
+         *
+         * @return users, in ascending order of id
+         */
+        vector<const User*> listUsers() const;
+
+        /**
+         * @brief Gets number of registered users
+         *
+         * @return number of users
+         */
+        size_t size() const;
+
+        /**
+         * @brief Checks if there are no registered users
+         *
+         * @return true if empty
+         */
+        bool empty() const;
 
 };
 